@@ -3,6 +3,7 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include "Profiler.h"
 #include "Recorder.h"
 
 using adc::Channel;
@@ -78,5 +79,8 @@ void loop() {
         Serial.print("Error during recording. RC: ");
         Serial.println(static_cast<int32_t>(rc));
     }
+#ifdef CHRISPY_PROFILE
+    profiler::dump(Serial);
+#endif
     done();
 }
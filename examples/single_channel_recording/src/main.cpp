@@ -65,12 +65,50 @@ void setup() {
     Serial.println("Initialized");
 }
 
+void print_stats(const recording::Stats& stats) {
+    Serial.print("Achieved rate (mHz): ");
+    Serial.println(stats.rate_mhz);
+    Serial.print("Samples per channel: ");
+    Serial.println(stats.samples);
+    Serial.print("Dropped: ");
+    Serial.println(stats.dropped);
+    Serial.print("Most slots full at once: ");
+    Serial.println(stats.high_water);
+    Serial.print("Writes: ");
+    Serial.println(stats.nwrites);
+    Serial.print("Max/mean write (us): ");
+    Serial.print(stats.write_max_us);
+    Serial.print("/");
+    Serial.println(stats.write_mean_us());
+    for (uint8_t i = 0; i < recording::WRITE_HISTOGRAM_BINS; ++i) {
+        if (stats.write_histogram[i] == 0) {
+            continue;
+        }
+        if (i == recording::WRITE_HISTOGRAM_BINS - 1) {
+            Serial.print("  >= ");
+            Serial.print(1ul << (recording::WRITE_HISTOGRAM_SHIFT + i - 1));
+        } else {
+            Serial.print("  < ");
+            Serial.print(1ul << (recording::WRITE_HISTOGRAM_SHIFT + i));
+        }
+        Serial.print(" us: ");
+        Serial.println(stats.write_histogram[i]);
+    }
+    Serial.print("Truncate/finalize (us): ");
+    Serial.print(stats.truncate_us);
+    Serial.print("/");
+    Serial.println(stats.finalize_us);
+}
+
 void loop() {
+    recording::Stats stats;
     int64_t rc = recording::record(FILENAMES, RESOLUTION, SAMPLE_RATE,
-                                   DURATION_SEC * 1000, BUF, BUF_SZ);
+                                   DURATION_SEC * 1000, BUF, BUF_SZ,
+                                   recording::Options(), &stats);
     if (rc < 0) {
         Serial.print("Error during recording. RC: ");
         Serial.println(static_cast<int32_t>(rc));
     }
+    print_stats(stats);
     done();
 }
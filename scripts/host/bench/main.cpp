@@ -0,0 +1,927 @@
+/**
+ * Benchmark for the ADC buffer protocol and the recorder on Linux.
+ *
+ * `adc` mode consumes buffers with `swap_buffer`/`drain_buffer` while the
+ * simulated ADC interrupts the main loop, checks every sample's channel and
+ * counter tags, and reports throughput and drops. `record` mode runs
+ * `recording::record` (or `record_raw`/`record_continuous`) into ordinary
+ * files (or with `record_to` into sinks) and reports its statistics.
+ *
+ * Exits with a non-zero status if any sample ended up in the wrong channel
+ * buffer or out of order without a matching drop.
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "Adc.h"
+#include "Host.h"
+#include "Recorder.h"
+#include "Timebase.h"
+#include "Uart.h"
+
+using adc::AutotriggerSource;
+using adc::BitResolution;
+using adc::Channel;
+using recording::Encoding;
+
+#define MAX_CHANNELS 8
+#define MAX_BUF_SZ (1ul << 16)
+#define TAG_COUNTER_MASK 0xF
+// Pin the shared clock is logged on, which is on INT1
+#define SYNC_PIN 20
+// USART recordings are streamed over, which the Mega's USB bridge is on
+#define STREAM_PORT 0
+
+static uint8_t BUF[MAX_BUF_SZ];
+static Channel CHANNELS[MAX_CHANNELS] = {
+    Channel(A0, -1, false), Channel(A1, -1, false), Channel(A2, -1, false),
+    Channel(A3, -1, false), Channel(A4, -1, false), Channel(A5, -1, false),
+    Channel(A6, -1, false), Channel(A7, -1, false),
+};
+
+struct Args {
+    bool record = false;
+    uint8_t nchannels = 1;
+    BitResolution res = BitResolution::Eight;
+    Encoding encoding = Encoding::Pcm;
+    uint32_t rate = 20000;
+    size_t window = 1;
+    uint8_t nslots = 2;
+    size_t buf_sz = 4096;
+    uint32_t duration_ms = 2000;
+    bool pipelined = false;
+    bool interleave = false;
+    bool preallocate = false;
+    bool pre_erase = false;
+    uint32_t raw_sectors = 0;
+    uint32_t ntakes = 0;
+    uint32_t trigger_ms = 0;
+    uint16_t gate_threshold = 0;
+    uint32_t arm_ms = 0;
+    AutotriggerSource arm_source = AutotriggerSource::AnalogComparator;
+    AutotriggerSource clock = AutotriggerSource::TimCnt1CmpB;
+    uint32_t sync_ms = 0;
+    const char* sink = nullptr;
+    const char* stream = nullptr;
+    uint32_t baud = 2000000;
+    const char* dir = ".";
+    bool expect_drops = false;
+    host::Config sim;
+    host::SdTiming sd;
+};
+
+/**
+ * Result of checking the samples handed out by the ADC.
+ */
+struct Check {
+    /* !< Samples carrying another channel's tag, or no valid tag at all */
+    uint64_t misrouted = 0;
+    /* !< Places where a channel's counter skipped */
+    uint64_t discontinuities = 0;
+    /* !< Samples checked */
+    uint64_t samples = 0;
+    /* !< Next expected counter for each channel */
+    int16_t expected[MAX_CHANNELS];
+
+    Check() {
+        for (size_t i = 0; i < MAX_CHANNELS; ++i) {
+            expected[i] = -1;
+        }
+    }
+
+    void sample(size_t ch_index, uint8_t tag) {
+        ++samples;
+        if ((tag >> 4) != ch_index) {
+            ++misrouted;
+            return;
+        }
+        uint8_t counter = tag & TAG_COUNTER_MASK;
+        if (expected[ch_index] >= 0 && counter != expected[ch_index]) {
+            ++discontinuities;
+        }
+        expected[ch_index] = (counter + 1) & TAG_COUNTER_MASK;
+    }
+
+    /**
+     * @returns (uint16_t): Oversampled sample, before it is biased and shifted
+     * to 16 bits, of `factor` conversions from a channel starting at a
+     * counter.
+     */
+    static uint16_t oversampled_value(size_t ch_index, uint8_t counter,
+                                      uint8_t factor, uint8_t bits) {
+        uint16_t acc = 0;
+        for (uint8_t k = 0; k < factor; ++k) {
+            acc += host::tagged_signal(ch_index, counter + k);
+        }
+        return acc >> (bits - 10);
+    }
+
+    /**
+     * Check an oversampled sample, which sums the tags of `factor`
+     * conversions. The counter only shows in the sum, so it is found by
+     * trying every starting counter whenever the expected one does not fit.
+     */
+    void oversampled(size_t ch_index, uint16_t value, uint8_t factor,
+                     uint8_t bits) {
+        ++samples;
+        if (static_cast<size_t>(value >> (bits - 4)) != ch_index) {
+            ++misrouted;
+            return;
+        }
+        int16_t counter = expected[ch_index];
+        if (counter >= 0 &&
+            value != oversampled_value(ch_index, counter, factor, bits)) {
+            ++discontinuities;
+            counter = -1;
+        }
+        for (uint8_t c = 0; counter < 0 && c <= TAG_COUNTER_MASK; ++c) {
+            if (value == oversampled_value(ch_index, c, factor, bits)) {
+                counter = c;
+            }
+        }
+        if (counter < 0) {
+            ++misrouted;
+            expected[ch_index] = -1;
+            return;
+        }
+        expected[ch_index] = (counter + factor) & TAG_COUNTER_MASK;
+    }
+
+    void buffer(BitResolution res, size_t ch_index, const uint8_t* buf,
+                size_t sz) {
+        if (res == BitResolution::Eight) {
+            for (size_t i = 0; i < sz; ++i) {
+                sample(ch_index, buf[i]);
+            }
+            return;
+        }
+        if (res == BitResolution::TenPacked) {
+            for (size_t i = 0; i + adc::PACKED_GROUP_SZ <= sz;
+                 i += adc::PACKED_GROUP_SZ) {
+                for (size_t j = 0; j < adc::PACKED_GROUP_SAMPLES; ++j) {
+                    // Sample `j` starts at bit 10 * j of the group
+                    size_t bit = 10 * j;
+                    uint16_t bits = buf[i + bit / 8] |
+                                    (buf[i + bit / 8 + 1] << 8);
+                    uint16_t packed = (bits >> (bit % 8)) & 0x3FF;
+                    // Sign-extend from 10 bits
+                    int16_t s = packed & 0x200 ? packed - 0x400 : packed;
+                    uint16_t value = s + 0x1FF;
+                    sample(ch_index, value >> 2);
+                }
+            }
+            return;
+        }
+        const uint8_t factor = adc::oversample_factor(res);
+        const uint8_t bits = static_cast<uint8_t>(res);
+        for (size_t i = 0; i + 1 < sz; i += 2) {
+            int16_t s = buf[i] | (buf[i + 1] << 8);
+            if (factor > 1) {
+                // Undo the bias and shift `decimate` applied
+                uint16_t bias = (1u << (bits - 1)) - 1;
+                oversampled(ch_index, (s >> (16 - bits)) + bias, factor, bits);
+                continue;
+            }
+            uint16_t value = (s >> 6) + 0x1FF;
+            sample(ch_index, value >> 2);
+        }
+    }
+};
+
+/**
+ * @returns (const char*): Name of a bit resolution as given to `--bits`.
+ */
+static const char* bits_name(BitResolution res) {
+    switch (res) {
+        case BitResolution::Eight:
+            return "8";
+        case BitResolution::Ten:
+            return "10";
+        case BitResolution::TenPacked:
+            return "10p";
+        case BitResolution::Eleven:
+            return "11";
+        case BitResolution::Twelve:
+            return "12";
+    }
+    return "?";
+}
+
+/**
+ * Parse a `--bits` argument.
+ *
+ * @param arg: Argument to parse.
+ * @param res: Set to the bit resolution named by `arg`.
+ * @returns (bool): False if `arg` does not name a supported resolution.
+ */
+static bool parse_bits(const char* arg, BitResolution& res) {
+    static const BitResolution RESOLUTIONS[] = {
+        BitResolution::Eight,
+        BitResolution::Ten,
+        BitResolution::TenPacked,
+        BitResolution::Eleven,
+        BitResolution::Twelve,
+    };
+    for (BitResolution candidate : RESOLUTIONS) {
+        if (strcmp(arg, bits_name(candidate)) == 0) {
+            res = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Parse an `--encoding` argument.
+ *
+ * @param arg: Argument to parse.
+ * @param encoding: Set to the encoding named by `arg`.
+ * @returns (bool): False if `arg` does not name an encoding.
+ */
+static bool parse_encoding(const char* arg, Encoding& encoding) {
+    if (strcmp(arg, "pcm") == 0) {
+        encoding = Encoding::Pcm;
+    } else if (strcmp(arg, "adpcm") == 0) {
+        encoding = Encoding::ImaAdpcm;
+    } else if (strcmp(arg, "lossless") == 0) {
+        encoding = Encoding::Lossless;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Shared clock edges drained from the ADC's log.
+ */
+struct Syncs {
+    /* !< Marks drained */
+    uint32_t nmarks = 0;
+    /* !< Edges skipped in the numbering */
+    uint32_t lost = 0;
+    /* !< Fewest and most samples between consecutive edges */
+    uint32_t period_min = UINT32_MAX;
+    uint32_t period_max = 0;
+    adc::SyncMark last;
+
+    void drain() {
+        adc::SyncMark marks[adc::MAX_SYNC_COUNT];
+        size_t n = adc::syncs(marks, adc::MAX_SYNC_COUNT);
+        for (size_t i = 0; i < n; ++i) {
+            if (nmarks++ == 0) {
+                last = marks[i];
+                continue;
+            }
+            uint32_t edges = marks[i].edge - last.edge;
+            lost += edges - 1;
+            uint32_t period = (marks[i].index - last.index) / edges;
+            period_min = period < period_min ? period : period_min;
+            period_max = period > period_max ? period : period_max;
+            last = marks[i];
+        }
+    }
+};
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void usage(const char* name) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --record            Run recording::record instead of the ADC "
+            "loop\n"
+            "  --channels N        Channels (1-%d, default 1)\n"
+            "  --bits 8|10|10p|11|12\n"
+            "                      Bit resolution, with 10p packing 10-bit "
+            "samples and\n"
+            "                      11 and 12 oversampling (default 8)\n"
+            "  --encoding pcm|adpcm|lossless\n"
+            "                      Encoding recordings are written with "
+            "(default pcm)\n"
+            "  --noise             Record noise which does not compress "
+            "instead of the\n"
+            "                      tagged signal\n"
+            "  --rate HZ           Per-channel sample rate (default 20000)\n"
+            "  --window N          Samples per channel window (default 1)\n"
+            "  --slots N           Ring slots (default 2)\n"
+            "  --buf BYTES         Sample buffer size (default 4096)\n"
+            "  --ms MS             Duration (default 2000)\n"
+            "  --pipelined         Program the mux a conversion ahead (not "
+            "with an\n"
+            "                      external clock)\n"
+            "  --trigger-rate HZ   Override the simulated trigger rate\n"
+            "  --signal-us US      Microseconds between simulated interrupts\n"
+            "  --sd-us US          Card write time per 512 bytes\n"
+            "  --stall-us US       Card stall length\n"
+            "  --stall-every N     Stall every N writes. Runs without a stall "
+            "fail if\n"
+            "                      any sample is dropped\n"
+            "  --expect-drops      Fail unless samples are dropped\n"
+            "  --dir PATH          Directory for recordings (default .)\n"
+            "  --interleave        Record every channel into one file\n"
+            "  --preallocate       Preallocate recordings\n"
+            "  --pre-erase         Erase preallocated recordings first\n"
+            "  --alloc-us US       Card time per cluster allocated\n"
+            "  --prealloc-us US    Card time per preallocation\n"
+            "  --raw SECTORS       Record to the first SECTORS sectors of "
+            "card.img\n"
+            "  --takes N           Record N takes of --ms each without "
+            "stopping\n"
+            "  --trigger-ms MS     Record --ms after a trigger which fires MS "
+            "in\n"
+            "  --gate LEVEL        Leave out silent buffers, with a signal "
+            "that is\n"
+            "                      quiet 3/4 of the time\n"
+            "  --arm-ms MS         Sleep armed on the analog comparator until "
+            "an edge\n"
+            "                      MS in\n"
+            "  --arm-int0          Arm on INT0 instead of the comparator\n"
+            "  --ext-clock         Clock conversions from ICP1 at the sample "
+            "rate\n"
+            "  --ext-int0          Clock conversions from INT0 instead of "
+            "ICP1\n"
+            "  --clock-stop-ms MS  Stop the external clock MS in, which the "
+            "recorder\n"
+            "                      has to give up on\n"
+            "  --sync-ms MS        Log a shared clock edge every MS on INT1\n"
+            "  --sink KIND         Record with record_to into a null or file "
+            "sink\n"
+            "  --stream PATH       Record with record_to into frames sent "
+            "over USART 0\n"
+            "                      to PATH (e.g. a pty)\n"
+            "  --baud N            Baud rate to stream at (default 2000000)\n",
+            name, MAX_CHANNELS);
+}
+
+/**
+ * Tagged signal in bursts of 2048 samples per channel, with 3 bursts out of
+ * every 4 replaced by a quiet signal which only carries the counter tag.
+ */
+static uint16_t bursty_signal(uint8_t channel, uint32_t index) {
+    if (((index >> 11) & 3) == 0) {
+        return host::tagged_signal(channel, index);
+    }
+    return 0x200 | ((index & TAG_COUNTER_MASK) << 2);
+}
+
+/**
+ * Noise which no encoder can shrink. Every 256 samples of a channel hold each
+ * 8-bit value once, in a scrambled order which differs between channels.
+ * `check_signal.py --noise` mirrors this.
+ */
+static uint16_t noise_signal(uint8_t channel, uint32_t index) {
+    uint8_t x = index;
+    x *= 0x95;
+    x ^= x >> 3;
+    x *= 0x4B;
+    x ^= x >> 4;
+    return static_cast<uint8_t>(x ^ (channel << 5)) << 2;
+}
+
+static bool parse(int argc, char** argv, Args& args) {
+    enum {
+        RECORD,
+        CHANNELS,
+        BITS,
+        ENCODING,
+        RATE,
+        WINDOW,
+        SLOTS,
+        BUF_SZ,
+        MS,
+        PIPELINED,
+        TRIGGER_RATE,
+        SIGNAL_US,
+        SD_US,
+        STALL_US,
+        STALL_EVERY,
+        DIR,
+        INTERLEAVE,
+        PREALLOCATE,
+        PRE_ERASE,
+        ALLOC_US,
+        PREALLOC_US,
+        EXPECT_DROPS,
+        RAW,
+        TAKES,
+        TRIGGER_MS,
+        GATE,
+        NOISE,
+        ARM_MS,
+        ARM_INT0,
+        EXT_CLOCK,
+        EXT_INT0,
+        CLOCK_STOP_MS,
+        SYNC_MS,
+        SINK,
+        STREAM,
+        BAUD,
+    };
+    static const struct option OPTIONS[] = {
+        {"record", no_argument, nullptr, RECORD},
+        {"channels", required_argument, nullptr, CHANNELS},
+        {"bits", required_argument, nullptr, BITS},
+        {"encoding", required_argument, nullptr, ENCODING},
+        {"rate", required_argument, nullptr, RATE},
+        {"window", required_argument, nullptr, WINDOW},
+        {"slots", required_argument, nullptr, SLOTS},
+        {"buf", required_argument, nullptr, BUF_SZ},
+        {"ms", required_argument, nullptr, MS},
+        {"pipelined", no_argument, nullptr, PIPELINED},
+        {"trigger-rate", required_argument, nullptr, TRIGGER_RATE},
+        {"signal-us", required_argument, nullptr, SIGNAL_US},
+        {"sd-us", required_argument, nullptr, SD_US},
+        {"stall-us", required_argument, nullptr, STALL_US},
+        {"stall-every", required_argument, nullptr, STALL_EVERY},
+        {"dir", required_argument, nullptr, DIR},
+        {"interleave", no_argument, nullptr, INTERLEAVE},
+        {"preallocate", no_argument, nullptr, PREALLOCATE},
+        {"pre-erase", no_argument, nullptr, PRE_ERASE},
+        {"alloc-us", required_argument, nullptr, ALLOC_US},
+        {"prealloc-us", required_argument, nullptr, PREALLOC_US},
+        {"expect-drops", no_argument, nullptr, EXPECT_DROPS},
+        {"raw", required_argument, nullptr, RAW},
+        {"takes", required_argument, nullptr, TAKES},
+        {"trigger-ms", required_argument, nullptr, TRIGGER_MS},
+        {"gate", required_argument, nullptr, GATE},
+        {"noise", no_argument, nullptr, NOISE},
+        {"arm-ms", required_argument, nullptr, ARM_MS},
+        {"arm-int0", no_argument, nullptr, ARM_INT0},
+        {"ext-clock", no_argument, nullptr, EXT_CLOCK},
+        {"ext-int0", no_argument, nullptr, EXT_INT0},
+        {"clock-stop-ms", required_argument, nullptr, CLOCK_STOP_MS},
+        {"sync-ms", required_argument, nullptr, SYNC_MS},
+        {"sink", required_argument, nullptr, SINK},
+        {"stream", required_argument, nullptr, STREAM},
+        {"baud", required_argument, nullptr, BAUD},
+        {nullptr, 0, nullptr, 0},
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", OPTIONS, nullptr)) != -1) {
+        unsigned long v = optarg ? strtoul(optarg, nullptr, 10) : 0;
+        switch (opt) {
+            case RECORD:
+                args.record = true;
+                break;
+            case CHANNELS:
+                args.nchannels = v;
+                break;
+            case BITS:
+                if (!parse_bits(optarg, args.res)) {
+                    fprintf(stderr, "Unsupported --bits %s\n", optarg);
+                    return false;
+                }
+                break;
+            case ENCODING:
+                args.record = true;
+                if (!parse_encoding(optarg, args.encoding)) {
+                    fprintf(stderr, "Unsupported --encoding %s\n", optarg);
+                    return false;
+                }
+                break;
+            case RATE:
+                args.rate = v;
+                break;
+            case WINDOW:
+                args.window = v;
+                break;
+            case SLOTS:
+                args.nslots = v;
+                break;
+            case BUF_SZ:
+                args.buf_sz = v;
+                break;
+            case MS:
+                args.duration_ms = v;
+                break;
+            case PIPELINED:
+                args.pipelined = true;
+                break;
+            case TRIGGER_RATE:
+                args.sim.rate_override = v;
+                break;
+            case SIGNAL_US:
+                args.sim.signal_period_us = v;
+                break;
+            case SD_US:
+                args.sd.us_per_block = v;
+                break;
+            case STALL_US:
+                args.sd.stall_us = v;
+                break;
+            case STALL_EVERY:
+                args.sd.stall_every = v;
+                break;
+            case DIR:
+                args.dir = optarg;
+                break;
+            case INTERLEAVE:
+                args.interleave = true;
+                break;
+            case PREALLOCATE:
+                args.preallocate = true;
+                break;
+            case PRE_ERASE:
+                args.pre_erase = true;
+                break;
+            case ALLOC_US:
+                args.sd.us_per_alloc = v;
+                break;
+            case PREALLOC_US:
+                args.sd.us_per_prealloc = v;
+                break;
+            case EXPECT_DROPS:
+                args.expect_drops = true;
+                break;
+            case RAW:
+                args.record = true;
+                args.raw_sectors = v;
+                break;
+            case TAKES:
+                args.record = true;
+                args.ntakes = v;
+                break;
+            case TRIGGER_MS:
+                args.record = true;
+                args.trigger_ms = v;
+                break;
+            case GATE:
+                args.record = true;
+                args.gate_threshold = v;
+                args.sim.signal = bursty_signal;
+                break;
+            case NOISE:
+                args.record = true;
+                args.sim.signal = noise_signal;
+                break;
+            case ARM_MS:
+                args.arm_ms = v;
+                break;
+            case ARM_INT0:
+                args.arm_source = AutotriggerSource::ExternalIrq0;
+                break;
+            case EXT_CLOCK:
+                args.clock = AutotriggerSource::TimCnt1Cap;
+                break;
+            case EXT_INT0:
+                args.clock = AutotriggerSource::ExternalIrq0;
+                break;
+            case CLOCK_STOP_MS:
+                args.sim.external_clock_ms = v;
+                break;
+            case SYNC_MS:
+                args.sync_ms = v;
+                break;
+            case SINK:
+                args.record = true;
+                args.sink = optarg;
+                break;
+            case STREAM:
+                args.record = true;
+                args.stream = optarg;
+                break;
+            case BAUD:
+                args.baud = v;
+                break;
+            default:
+                return false;
+        }
+    }
+    // The external clock triggers every conversion. Without one, INT0 only
+    // sees the edges `schedule_edge` makes.
+    if (args.clock != AutotriggerSource::TimCnt1CmpB) {
+        args.sim.external_clock_hz = args.rate * args.nchannels;
+    }
+    // External clocks are never pipelined
+    return args.nchannels >= 1 && args.nchannels <= MAX_CHANNELS &&
+           args.buf_sz <= MAX_BUF_SZ &&
+           !(args.pipelined && args.clock != AutotriggerSource::TimCnt1CmpB);
+}
+
+/**
+ * @returns (bool): True if the samples dropped are as expected. Only a run
+ * which simulates a card stall may drop samples, and one which expects drops
+ * has to.
+ */
+static bool drops_ok(const Args& args, uint32_t dropped) {
+    if (args.expect_drops) {
+        return dropped != 0;
+    }
+    return (args.sd.stall_us != 0 && args.sd.stall_every != 0) || dropped == 0;
+}
+
+/**
+ * Consume buffers straight from the ADC and check every sample.
+ */
+static int run_adc(const Args& args) {
+    if (!adc::init(args.nchannels, CHANNELS, BUF, args.buf_sz, args.nslots)) {
+        fprintf(stderr, "adc::init failed\n");
+        return 1;
+    }
+    const bool armed = args.arm_ms != 0;
+    int8_t rc;
+    if (armed) {
+        // The edge's latency is measured against the timebase
+        timebase::start();
+        rc = adc::arm(args.res, args.rate, args.arm_source, adc::Edge::Rising,
+                      args.window, args.pipelined);
+    } else if (args.clock != AutotriggerSource::TimCnt1CmpB) {
+        rc = adc::start_external(args.res, args.rate, args.clock,
+                                 adc::Edge::Rising, args.window, 0);
+    } else {
+        rc = adc::start(args.res, args.rate, args.window, 0, args.pipelined);
+    }
+    if (rc != 0) {
+        fprintf(stderr, "adc::start failed: %d\n", rc);
+        return 1;
+    }
+    if (armed) {
+        host::schedule_edge(args.arm_source == AutotriggerSource::ExternalIrq0
+                                ? host::Event::Int0
+                                : host::Event::Comparator,
+                            args.arm_ms * 1000);
+        if (adc::await_edge(2 * args.arm_ms) != 0) {
+            fprintf(stderr, "adc::await_edge timed out\n");
+            return 1;
+        }
+    }
+    if (args.sync_ms != 0) {
+        rc = adc::log_sync(SYNC_PIN);
+        if (rc != 0) {
+            fprintf(stderr, "adc::log_sync failed: %d\n", rc);
+            return 1;
+        }
+        host::schedule_edge(host::Event::Int1, args.sync_ms * 500,
+                            args.sync_ms * 1000);
+    }
+    Syncs syncs;
+
+    Check check;
+    uint8_t* buf = nullptr;
+    size_t sz = 0;
+    size_t ch_index = 0;
+    uint64_t nbuffers = 0;
+    uint64_t bytes = 0;
+    uint64_t swap_ns = 0;
+    uint64_t nswaps = 0;
+    uint64_t begin = now_ns();
+    uint64_t end = begin + args.duration_ms * 1000000ull;
+    while (now_ns() < end) {
+        uint64_t before = now_ns();
+        rc = adc::swap_buffer(&buf, sz, ch_index);
+        swap_ns += now_ns() - before;
+        ++nswaps;
+        if (rc == 0 && buf != nullptr) {
+            check.buffer(args.res, ch_index, buf, sz);
+            ++nbuffers;
+            bytes += sz;
+        } else if (args.sync_ms != 0) {
+            syncs.drain();
+        }
+    }
+    uint32_t collected = adc::stop();
+    syncs.drain();
+    uint64_t elapsed_ns = now_ns() - begin;
+    while (adc::drain_buffer(&buf, sz, ch_index) == 0) {
+        if (buf != nullptr) {
+            check.buffer(args.res, ch_index, buf, sz);
+            bytes += sz;
+        }
+    }
+
+    host::Counters sim = host::counters();
+    printf("mode=adc channels=%u bits=%s rate=%lu window=%zu slots=%u "
+           "buf=%zu pipelined=%d\n",
+           args.nchannels, bits_name(args.res),
+           static_cast<unsigned long>(args.rate), args.window, args.nslots,
+           args.buf_sz, args.pipelined);
+    printf("collected=%lu dropped=%lu overruns=%u high_water=%u\n",
+           static_cast<unsigned long>(collected),
+           static_cast<unsigned long>(adc::dropped()), adc::overruns(),
+           adc::high_water());
+    printf("buffers=%llu bytes=%llu throughput_Bps=%.0f swap_ns=%.1f\n",
+           static_cast<unsigned long long>(nbuffers),
+           static_cast<unsigned long long>(bytes),
+           bytes * 1e9 / elapsed_ns,
+           nswaps ? static_cast<double>(swap_ns) / nswaps : 0.0);
+    printf("conversions=%llu interrupts=%llu lost_triggers=%llu "
+           "signals=%llu\n",
+           static_cast<unsigned long long>(sim.conversions),
+           static_cast<unsigned long long>(sim.interrupts),
+           static_cast<unsigned long long>(sim.lost_triggers),
+           static_cast<unsigned long long>(sim.signals));
+    printf("checked=%llu misrouted=%llu discontinuities=%llu\n",
+           static_cast<unsigned long long>(check.samples),
+           static_cast<unsigned long long>(check.misrouted),
+           static_cast<unsigned long long>(check.discontinuities));
+    uint32_t latency = 0;
+    if (armed) {
+        if (!adc::edge_latency(latency)) {
+            fprintf(stderr, "Edge latency was not measured\n");
+            return 2;
+        }
+        timebase::stop();
+        printf("edge_latency_ticks=%lu edge_latency_us=%.1f sleeps=%llu\n",
+               static_cast<unsigned long>(latency),
+               latency * 1e6 / timebase::TICKS_PER_SEC,
+               static_cast<unsigned long long>(sim.sleeps));
+    }
+
+    if (args.sync_ms != 0) {
+        printf("sync_edges=%lu marks=%lu lost_marks=%lu "
+               "sync_period_min=%lu sync_period_max=%lu\n",
+               static_cast<unsigned long>(adc::sync_edges()),
+               static_cast<unsigned long>(syncs.nmarks),
+               static_cast<unsigned long>(syncs.lost),
+               static_cast<unsigned long>(syncs.period_min),
+               static_cast<unsigned long>(syncs.period_max));
+        if (syncs.nmarks < 2) {
+            fprintf(stderr, "Too few shared clock edges were logged\n");
+            return 2;
+        }
+    }
+
+    // Skips are expected wherever samples were dropped, and nowhere else.
+    // Only a stalled card may make the ADC drop samples.
+    bool ok = check.misrouted == 0 &&
+              (adc::overruns() != 0 || check.discontinuities == 0) &&
+              drops_ok(args, adc::dropped());
+    return ok ? 0 : 2;
+}
+
+static uint32_t TRIGGER_AT_MS = 0;
+
+static bool poll_trigger() { return millis() >= TRIGGER_AT_MS; }
+
+static void name_take(uint32_t take, size_t file_index, char* out,
+                      size_t out_sz) {
+    snprintf(out, out_sz, "take_%lu_channel_%zu.wav",
+             static_cast<unsigned long>(take), file_index + 1);
+}
+
+/**
+ * Record to files and report the recorder's statistics.
+ */
+static int run_record(const Args& args) {
+    // Streams and null sinks run without a card, like on a tethered board
+    bool card = args.stream == nullptr &&
+                (args.sink == nullptr || strcmp(args.sink, "null") != 0);
+    SdFat sd;
+    sd.begin(SdSpiConfig(0, DEDICATED_SPI, SD_SCK_MHZ(8)));
+    bool initialized = card ? recording::init(args.nchannels, CHANNELS, &sd)
+                            : recording::init(args.nchannels, CHANNELS);
+    if (!initialized) {
+        fprintf(stderr, "recording::init failed\n");
+        return 1;
+    }
+    static char names[MAX_CHANNELS][16];
+    const char* filenames[MAX_CHANNELS];
+    // Lossless recordings are not WAV files
+    const char* extension =
+        args.encoding == Encoding::Lossless ? "bin" : "wav";
+    for (uint8_t i = 0; i < args.nchannels; ++i) {
+        snprintf(names[i], sizeof(names[i]), "channel_%u.%s", i + 1,
+                 extension);
+        filenames[i] = names[i];
+    }
+    recording::Options opts;
+    opts.nslots = args.nslots;
+    opts.encoding = args.encoding;
+    opts.interleave = args.interleave;
+    opts.preallocate = args.preallocate;
+    opts.pre_erase = args.pre_erase;
+    opts.gate_threshold = args.gate_threshold;
+    recording::Trigger trigger;
+    trigger.poll = poll_trigger;
+    if (args.trigger_ms != 0) {
+        TRIGGER_AT_MS = millis() + args.trigger_ms;
+        opts.trigger = &trigger;
+    }
+    if (args.arm_ms != 0) {
+        opts.start_on = args.arm_source;
+        opts.start_timeout_ms = 2 * args.arm_ms;
+        host::schedule_edge(args.arm_source == AutotriggerSource::ExternalIrq0
+                                ? host::Event::Int0
+                                : host::Event::Comparator,
+                            args.arm_ms * 1000);
+    }
+    opts.clock = args.clock;
+    if (args.sync_ms != 0) {
+        opts.sync_pin = SYNC_PIN;
+        host::schedule_edge(host::Event::Int1, args.sync_ms * 500,
+                            args.sync_ms * 1000);
+    }
+    recording::Stats stats;
+    int64_t rc;
+    const char* mode = "record";
+    uint32_t frame_waits = 0;
+    if (args.raw_sectors != 0) {
+        mode = "raw";
+        rc = recording::record_raw(0, args.raw_sectors, args.res, args.rate,
+                                   args.duration_ms, BUF, args.buf_sz, opts,
+                                   &stats);
+    } else if (args.sink != nullptr && strcmp(args.sink, "null") == 0) {
+        mode = "null_sink";
+        recording::NullSink sinks[MAX_CHANNELS];
+        rc = recording::record_to(sinks, args.res, args.rate,
+                                  args.duration_ms, BUF, args.buf_sz, opts,
+                                  &stats);
+    } else if (args.sink != nullptr && strcmp(args.sink, "file") == 0) {
+        mode = "file_sink";
+        recording::SdFileSink sinks[MAX_CHANNELS];
+        for (uint8_t i = 0; i < args.nchannels; ++i) {
+            sinks[i].filename = filenames[i];
+        }
+        rc = recording::record_to(sinks, args.res, args.rate,
+                                  args.duration_ms, BUF, args.buf_sz, opts,
+                                  &stats);
+    } else if (args.sink != nullptr) {
+        fprintf(stderr, "Unknown sink %s\n", args.sink);
+        return 1;
+    } else if (args.stream != nullptr) {
+        mode = "stream";
+        static uint8_t frames[2 * uart::BUFFER_SZ];
+        if (!host::uart_output(STREAM_PORT, args.stream)) {
+            perror(args.stream);
+            return 1;
+        }
+        rc = uart::begin(STREAM_PORT, args.baud, frames, sizeof(frames));
+        if (rc != 0) {
+            fprintf(stderr, "uart::begin failed: %lld\n",
+                    static_cast<long long>(rc));
+            return 1;
+        }
+        recording::FrameSink sinks[MAX_CHANNELS];
+        rc = recording::record_to(sinks, args.res, args.rate,
+                                  args.duration_ms, BUF, args.buf_sz, opts,
+                                  &stats);
+        frame_waits = uart::waits();
+        uart::end();
+    } else if (args.ntakes != 0) {
+        mode = "continuous";
+        rc = recording::record_continuous(name_take, args.res, args.rate,
+                                          args.duration_ms, args.ntakes, BUF,
+                                          args.buf_sz, opts, &stats);
+    } else {
+        rc = recording::record(filenames, args.res, args.rate,
+                               args.duration_ms, BUF, args.buf_sz, opts,
+                               &stats);
+    }
+    printf("mode=%s channels=%u bits=%s rate=%lu slots=%u buf=%zu "
+           "rc=%lld\n",
+           mode, args.nchannels, bits_name(args.res),
+           static_cast<unsigned long>(args.rate), args.nslots, args.buf_sz,
+           static_cast<long long>(rc));
+    printf("rate_mhz=%lu samples=%lu dropped=%lu overruns=%u high_water=%u\n",
+           static_cast<unsigned long>(stats.rate_mhz),
+           static_cast<unsigned long>(stats.samples),
+           static_cast<unsigned long>(stats.dropped), stats.overruns,
+           stats.high_water);
+    printf("writes=%lu write_max_us=%lu write_mean_us=%lu truncate_us=%lu "
+           "finalize_us=%lu trigger_sample=%lu silent_blocks=%lu "
+           "clipped=%lu rms_max=%u edge_latency_ticks=%lu sync_edges=%lu\n",
+           static_cast<unsigned long>(stats.nwrites),
+           static_cast<unsigned long>(stats.write_max_us),
+           static_cast<unsigned long>(stats.write_mean_us()),
+           static_cast<unsigned long>(stats.truncate_us),
+           static_cast<unsigned long>(stats.finalize_us),
+           static_cast<unsigned long>(stats.trigger_sample),
+           static_cast<unsigned long>(stats.silent_blocks),
+           static_cast<unsigned long>(stats.clipped), stats.rms_max,
+           static_cast<unsigned long>(stats.edge_latency_ticks),
+           static_cast<unsigned long>(stats.sync_edges));
+    if (args.stream != nullptr) {
+        printf("baud=%lu uart_bytes=%llu frame_waits=%lu\n",
+               static_cast<unsigned long>(args.baud),
+               static_cast<unsigned long long>(host::counters().uart_bytes),
+               static_cast<unsigned long>(frame_waits));
+    }
+    if (args.sim.external_clock_ms != 0) {
+        // Only a recorder which gave up on the clock got this far
+        return rc == -22 ? 0 : 1;
+    } else if (rc < 0) {
+        return 1;
+    }
+    return drops_ok(args, stats.dropped) ? 0 : 2;
+}
+
+int main(int argc, char** argv) {
+    Args args;
+    if (!parse(argc, argv, args)) {
+        usage(argv[0]);
+        return 1;
+    }
+    host::begin(args.sim);
+    host::sd_root(args.dir);
+    host::sd_timing(args.sd);
+    int rc = args.record ? run_record(args) : run_adc(args);
+    host::end();
+    return rc;
+}
@@ -0,0 +1,171 @@
+#!/usr/bin/env python3
+"""
+Check a recording of the host benchmark's simulated signal.
+
+The simulated ADC tags every conversion with its channel and a per-channel
+counter (`host::tagged_signal`), so every sample of a recording made without
+drops is known up to where the counter started. This finds that starting
+point for each channel and counts the samples which differ from what the
+ADC must have stored, exiting with status 1 if there are any. 11 and 12-bit
+samples sum 4 and 16 conversions, so they are checked against the same sums.
+`--noise` checks a recording of the benchmark's `--noise` signal instead.
+
+Recordings have to be plain PCM, so packed and encoded files go through
+`scripts/recordings` first. Lossy encodings are checked with `--max-rms`,
+which passes a channel whose error is at most that in 16-bit units instead
+of requiring every sample to match. 8-bit samples decoded to 16 bits are
+expected at 256 times their offset from the midpoint.
+
+Usage:
+    python check_signal.py channel_1.wav --bits 10 --channel 0
+    python check_signal.py interleaved.wav --bits 8
+    python check_signal.py decoded.wav --bits 8 --max-rms 512
+"""
+
+import argparse
+import math
+import struct
+import sys
+import wave
+
+TAG_PERIOD = 16
+NOISE_PERIOD = 256
+EIGHT_BIT_BIAS = 0x80
+CHANNEL_SHIFT = 6
+COUNTER_SHIFT = 2
+
+
+def to_int16(value: int) -> int:
+    value &= 0xFFFF
+    return value - 0x10000 if value & 0x8000 else value
+
+
+def tagged(channel: int, counter: int) -> int:
+    """
+    @returns: 10-bit value the simulated ADC converts for a channel.
+    """
+    return (channel << CHANNEL_SHIFT) | ((counter % TAG_PERIOD) << COUNTER_SHIFT)
+
+
+def noise(channel: int, counter: int) -> int:
+    """
+    @returns: 10-bit value the benchmark's `noise_signal` converts for a
+    channel.
+    """
+    x = (counter * 0x95) & 0xFF
+    x ^= x >> 3
+    x = (x * 0x4B) & 0xFF
+    x ^= x >> 4
+    return (x ^ (channel << 5)) << 2
+
+
+def oversample_factor(bits: int) -> int:
+    """
+    @returns: Number of conversions summed into each sample, as in
+    `adc::oversample_factor`.
+    """
+    return 4 ** (bits - 10) if bits > 10 else 1
+
+
+def expected(bits: int, channel: int, counter: int, conversion=tagged) -> int:
+    """
+    @returns: Sample the ADC stores for the conversions starting at a counter,
+    as read back from a WAV file (unsigned for 8-bit, signed otherwise).
+    """
+    if bits == 8:
+        return conversion(channel, counter) >> 2
+    total = sum(
+        conversion(channel, counter + k) for k in range(oversample_factor(bits))
+    )
+    # Same bias and shift as the ISR's `TEN_TO_SIXTEEN_BIT` and `decimate`
+    value = (total >> (bits - 10)) - ((1 << (bits - 1)) - 1)
+    return to_int16(value << (16 - bits))
+
+
+def read_wav(path: str) -> tuple[int, list[list[int]]]:
+    """
+    @returns: Sample width in bytes and the samples of every channel.
+    """
+    with wave.open(path, "rb") as w:
+        nchannels = w.getnchannels()
+        width = w.getsampwidth()
+        frames = w.readframes(w.getnframes())
+    if width == 1:
+        values = list(frames)
+    elif width == 2:
+        values = list(struct.unpack(f"<{len(frames) // 2}h", frames))
+    else:
+        raise ValueError(f"Unsupported sample width {width}")
+    return width, [values[i::nchannels] for i in range(nchannels)]
+
+
+def check_channel(
+    samples: list[int], bits: int, width: int, channel: int, conversion=tagged
+) -> tuple[int, int, float]:
+    """
+    @returns: Counter the channel most likely started at, and the number of
+    samples which differ from the signal starting there and their RMS error.
+    """
+    factor = oversample_factor(bits)
+    best = (0, len(samples) + 1, math.inf)
+    period = NOISE_PERIOD if conversion is noise else TAG_PERIOD
+    for start in range(period):
+        mismatches = 0
+        error = 0
+        for i, sample in enumerate(samples):
+            value = expected(bits, channel, start + i * factor, conversion)
+            if width == 2 and bits == 8:
+                value = (value - EIGHT_BIT_BIAS) * 256
+            mismatches += sample != value
+            error += (sample - value) ** 2
+        rms = math.sqrt(error / len(samples)) if samples else 0.0
+        if rms < best[2]:
+            best = (start, mismatches, rms)
+    return best
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("wav")
+    parser.add_argument(
+        "--bits", type=int, choices=(8, 10, 11, 12), required=True,
+        help="Bit resolution the recording was made at",
+    )
+    parser.add_argument(
+        "--channel", type=int, default=0,
+        help="ADC channel of the file's first channel",
+    )
+    parser.add_argument(
+        "--noise", action="store_true",
+        help="Check against the benchmark's --noise signal",
+    )
+    parser.add_argument(
+        "--max-rms", type=float, default=0.0,
+        help="Largest RMS error to accept, for lossy encodings",
+    )
+    args = parser.parse_args()
+    try:
+        width, channels = read_wav(args.wav)
+    except (OSError, EOFError, wave.Error, ValueError) as e:
+        print(e, file=sys.stderr)
+        sys.exit(1)
+    if width != 2 and not (width == 1 and args.bits == 8):
+        print(f"{args.wav} is not {args.bits}-bit PCM", file=sys.stderr)
+        sys.exit(1)
+    ok = True
+    for i, samples in enumerate(channels):
+        channel = args.channel + i
+        start, mismatches, rms = check_channel(
+            samples, args.bits, width, channel, noise if args.noise else tagged
+        )
+        print(
+            f"channel={channel} samples={len(samples)} start={start} "
+            f"mismatches={mismatches} rms={rms:.1f}"
+        )
+        passed = rms <= args.max_rms if args.max_rms else mismatches == 0
+        ok = ok and len(samples) > 0 and passed
+    sys.exit(0 if ok else 1)
+
+
+if __name__ == "__main__":
+    main()
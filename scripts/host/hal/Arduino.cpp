@@ -0,0 +1,165 @@
+#include "Arduino.h"
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "Host.h"
+
+HardwareSerial Serial;
+HardwareSerial Serial1;
+
+void pinMode(uint8_t pin, uint8_t mode) {
+    (void)pin;
+    (void)mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+    (void)pin;
+    (void)val;
+}
+
+int digitalRead(uint8_t pin) {
+    (void)pin;
+    return LOW;
+}
+
+// Handlers attached to INT0 - INT7, indexed by the INTn they are on
+static void (*HANDLERS[8])() = {};
+// INTn each interrupt number of the Mega is on
+static const uint8_t INT_NUMBERS[] = {4, 5, 0, 1, 2, 3};
+
+void attachInterrupt(uint8_t num, void (*fn)(), int mode) {
+    (void)mode;
+    if (num >= sizeof(INT_NUMBERS)) {
+        return;
+    }
+    HANDLERS[INT_NUMBERS[num]] = fn;
+    EIMSK |= 1 << INT_NUMBERS[num];
+}
+
+void detachInterrupt(uint8_t num) {
+    if (num >= sizeof(INT_NUMBERS)) {
+        return;
+    }
+    EIMSK &= ~(1 << INT_NUMBERS[num]);
+    HANDLERS[INT_NUMBERS[num]] = nullptr;
+}
+
+namespace host {
+
+void external_interrupt(uint8_t n) {
+    if ((EIMSK & (1 << n)) && HANDLERS[n] != nullptr) {
+        HANDLERS[n]();
+    }
+}
+
+}  // namespace host
+
+unsigned long millis() { return host::cycles() / (F_CPU / 1000); }
+
+unsigned long micros() { return host::cycles() / (F_CPU / 1000000); }
+
+void delay(unsigned long ms) {
+    struct timespec remaining;
+    remaining.tv_sec = ms / 1000;
+    remaining.tv_nsec = (ms % 1000) * 1000000;
+    // Simulated interrupts cut sleeps short
+    while (nanosleep(&remaining, &remaining) != 0 && errno == EINTR) {
+    }
+}
+
+void delayMicroseconds(unsigned int us) {
+    uint64_t end = host::cycles() + static_cast<uint64_t>(us) * (F_CPU / 1000000);
+    while (host::cycles() < end) {
+    }
+}
+
+size_t Print::write(uint8_t c) { return fwrite(&c, 1, 1, stdout); }
+
+size_t Print::write(const uint8_t* buf, size_t sz) {
+    size_t n = 0;
+    for (size_t i = 0; i < sz; ++i) {
+        n += write(buf[i]);
+    }
+    return n;
+}
+
+/**
+ * Print a formatted string through `Print::write`.
+ */
+static size_t print_format(Print& out, const char* fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static size_t print_format(Print& out, const char* fmt, ...) {
+    char buf[64];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    if (n < 0) {
+        return 0;
+    }
+    return out.write(reinterpret_cast<const uint8_t*>(buf),
+                     min(static_cast<size_t>(n), sizeof(buf) - 1));
+}
+
+/**
+ * Print an unsigned number in any base from 2 to 36.
+ */
+static size_t print_base(Print& out, unsigned long long v, int base) {
+    if (base == 10) {
+        return print_format(out, "%llu", v);
+    }
+    char buf[sizeof(v) * CHAR_BIT + 1];
+    char* p = &buf[sizeof(buf) - 1];
+    *p = '\0';
+    do {
+        uint8_t digit = v % base;
+        *--p = digit < 10 ? '0' + digit : 'A' + digit - 10;
+        v /= base;
+    } while (v != 0);
+    return out.write(p);
+}
+
+size_t Print::print(const __FlashStringHelper* s) {
+    return write(reinterpret_cast<const char*>(s));
+}
+
+size_t Print::print(const char* s) { return write(s); }
+
+size_t Print::print(char c) { return write(static_cast<uint8_t>(c)); }
+
+size_t Print::print(int v, int base) {
+    return print(static_cast<long long>(v), base);
+}
+
+size_t Print::print(unsigned int v, int base) {
+    return print(static_cast<unsigned long long>(v), base);
+}
+
+size_t Print::print(long v, int base) {
+    return print(static_cast<long long>(v), base);
+}
+
+size_t Print::print(unsigned long v, int base) {
+    return print(static_cast<unsigned long long>(v), base);
+}
+
+size_t Print::print(long long v, int base) {
+    if (base == 10 && v < 0) {
+        return print('-') + print_base(*this, -static_cast<unsigned long long>(v), base);
+    }
+    return print_base(*this, v, base);
+}
+
+size_t Print::print(unsigned long long v, int base) {
+    return print_base(*this, v, base);
+}
+
+size_t Print::print(double v, int digits) {
+    return print_format(*this, "%.*f", digits, v);
+}
+
+size_t Print::println() { return write("\r\n"); }
@@ -0,0 +1,588 @@
+#include "Host.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "util/atomic.h"
+
+// Interrupt vectors the library may define
+extern "C" void ADC_vect(void) __attribute__((weak));
+extern "C" void ANALOG_COMP_vect(void) __attribute__((weak));
+extern "C" void TIMER3_OVF_vect(void) __attribute__((weak));
+extern "C" void TIMER4_OVF_vect(void) __attribute__((weak));
+extern "C" void TIMER5_OVF_vect(void) __attribute__((weak));
+extern "C" void USART0_UDRE_vect(void) __attribute__((weak));
+extern "C" void USART1_UDRE_vect(void) __attribute__((weak));
+extern "C" void USART2_UDRE_vect(void) __attribute__((weak));
+extern "C" void USART3_UDRE_vect(void) __attribute__((weak));
+
+// Plain registers
+#define D8(name) volatile uint8_t name = 0;
+#define D16(name) volatile uint16_t name = 0;
+D8(PRR0) D8(PRR1)
+D8(ADCSRB) D8(ADMUX) D8(ADCL) D8(ADCH) D16(ADC) D8(DIDR0) D8(DIDR2)
+D8(ACSR) D8(DIDR1)
+D8(TCCR1A) D8(TCCR1B) D8(TCCR1C) D8(TIMSK1) D8(TIFR1) D16(TCNT1) D16(OCR1A)
+D16(OCR1B) D16(OCR1C) D16(ICR1)
+D8(TCCR3A) D8(TCCR3B) D8(TCCR3C) D8(TIMSK3) D16(OCR3A) D16(OCR3B) D16(ICR3)
+D8(TCCR4A) D8(TCCR4B) D8(TCCR4C) D8(TIMSK4) D16(OCR4A) D16(OCR4B) D16(ICR4)
+D8(TCCR5A) D8(TCCR5B) D8(TCCR5C) D8(TIMSK5) D16(OCR5A) D16(OCR5B) D16(ICR5)
+D8(EICRA) D8(EICRB) D8(EIMSK) D8(EIFR)
+D8(SMCR) D8(MCUCR) D8(SREG)
+D8(UCSR0A) D8(UCSR0B) D8(UCSR0C) D16(UBRR0)
+D8(UCSR1A) D8(UCSR1B) D8(UCSR1C) D16(UBRR1)
+D8(UCSR2A) D8(UCSR2B) D8(UCSR2C) D16(UBRR2)
+D8(UCSR3A) D8(UCSR3B) D8(UCSR3C) D16(UBRR3)
+#undef D8
+#undef D16
+
+// Simulated registers
+host::AdcControlRegister ADCSRA = {0};
+host::TimerCounter TCNT3 = {&TCCR3B, 0, 0};
+host::TimerCounter TCNT4 = {&TCCR4B, 0, 0};
+host::TimerCounter TCNT5 = {&TCCR5B, 0, 0};
+host::TimerFlags TIFR3 = {&TCNT3, 0, 0};
+host::TimerFlags TIFR4 = {&TCNT4, 0, 0};
+host::TimerFlags TIFR5 = {&TCNT5, 0, 0};
+host::UartData UDR0 = {0, 0};
+host::UartData UDR1 = {1, 0};
+host::UartData UDR2 = {2, 0};
+host::UartData UDR3 = {3, 0};
+
+namespace host {
+
+#define INTERRUPT_SIGNAL SIGRTMIN
+#define TIMER1_COMPARE_B 0b101
+#define FREE_RUNNING 0b000
+#define ANALOG_COMPARATOR 0b001
+#define EXTERNAL_IRQ_0 0b010
+#define TIMER1_CAPTURE 0b111
+#define NEVENTS 3
+#define ADC_CYCLES_PER_CONVERSION 13
+#define CS_MASK 0b111
+#define TIMER_TOP (UINT16_MAX + 1ull)
+#define NPORTS 4
+// Bits per byte on the wire with one start and one stop bit
+#define UART_BITS_PER_BYTE 10
+
+/**
+ * Transmitter of a USART. The data register empties as soon as its byte
+ * moves on to the shift register, which happens once the byte before it has
+ * been shifted out.
+ */
+struct Uart {
+    FILE* out;
+    /* !< Cycle count the data register empties at */
+    double empty_at;
+    /* !< Cycle count the shift register is done at */
+    double idle_at;
+    /* !< Cycle count the data register empty ISR runs at */
+    double isr_at;
+    /* !< Whether the data register empty ISR is running */
+    bool in_isr;
+    /* !< Whether bytes were written since `out` was last flushed */
+    bool dirty;
+};
+
+static struct {
+    Config cfg;
+    bool running = false;
+    timer_t timer;
+    struct timespec start;
+    /* !< Cycle count the next trigger is due at */
+    double next_trigger;
+    /* !< Trigger rate `next_trigger` was computed with */
+    uint32_t rate;
+    /* !< Whether the ISR already started the next conversion */
+    bool prelatched;
+    /* !< Channel latched by the next conversion */
+    uint8_t prelatched_channel;
+    /* !< Whether the ADC ISR is running */
+    bool in_isr;
+    uint32_t index[16];
+    Counters counters;
+    /* !< Flag for whether an edge is scheduled on each event */
+    bool edge_scheduled[NEVENTS];
+    /* !< Cycle count the next edge on each event is due at */
+    uint64_t edge_at[NEVENTS];
+    /* !< Cycles between edges on each event, or 0 for a single edge */
+    uint64_t edge_period[NEVENTS];
+    /* !< Cycle count `service` last ran at */
+    uint64_t serviced_at;
+    Uart uarts[NPORTS];
+} SIM;
+
+static volatile uint8_t* const UCSRA[NPORTS] = {&UCSR0A, &UCSR1A, &UCSR2A,
+                                                &UCSR3A};
+static volatile uint8_t* const UCSRB[NPORTS] = {&UCSR0B, &UCSR1B, &UCSR2B,
+                                                &UCSR3B};
+static volatile uint16_t* const UBRR[NPORTS] = {&UBRR0, &UBRR1, &UBRR2,
+                                                &UBRR3};
+static void (*const UDRE_VECTORS[NPORTS])(void) = {
+    USART0_UDRE_vect, USART1_UDRE_vect, USART2_UDRE_vect, USART3_UDRE_vect};
+
+// Calls the handler attached to INTn (see `attachInterrupt`)
+void external_interrupt(uint8_t n);
+
+static const uint16_t TIMER_PRESCALERS[] = {0, 1, 8, 64, 256, 1024, 0, 0};
+
+uint16_t tagged_signal(uint8_t channel, uint32_t index) {
+    return (static_cast<uint16_t>(channel) << 6) | ((index & 0xF) << 2);
+}
+
+uint64_t cycles() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t ns = (now.tv_sec - SIM.start.tv_sec) * 1000000000ull +
+                  (now.tv_nsec - SIM.start.tv_nsec);
+    return ns * (F_CPU / 1000000) / 1000;
+}
+
+static sigset_t interrupt_set() {
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, INTERRUPT_SIGNAL);
+    return set;
+}
+
+void interrupts_off() {
+    sigset_t set = interrupt_set();
+    sigprocmask(SIG_BLOCK, &set, nullptr);
+}
+
+void interrupts_on() {
+    sigset_t set = interrupt_set();
+    sigprocmask(SIG_UNBLOCK, &set, nullptr);
+}
+
+void block_interrupts(sigset_t* saved) {
+    sigset_t set = interrupt_set();
+    sigprocmask(SIG_BLOCK, &set, saved);
+}
+
+void restore_interrupts(const sigset_t* saved) {
+    sigprocmask(SIG_SETMASK, saved, nullptr);
+}
+
+/**
+ * @returns (uint8_t): ADC channel currently selected by the mux.
+ */
+static uint8_t mux_channel() {
+    uint8_t channel = ADMUX & 0b111;
+    if (ADCSRB & (1 << MUX5)) {
+        channel |= 0b1000;
+    }
+    return channel;
+}
+
+uint32_t trigger_rate() {
+    uint8_t adcsra = ADCSRA.value;
+    if (!(adcsra & (1 << ADEN)) || !(adcsra & (1 << ADATE))) {
+        return 0;
+    } else if (SIM.cfg.rate_override != 0) {
+        return SIM.cfg.rate_override;
+    }
+    switch (ADCSRB & 0b111) {
+        case FREE_RUNNING: {
+            uint8_t bits = adcsra & 0b111;
+            uint32_t prescaler = bits == 0 ? 2 : 1 << bits;
+            return F_CPU / (prescaler * ADC_CYCLES_PER_CONVERSION);
+        }
+        case TIMER1_COMPARE_B: {
+            uint32_t prescaler = TIMER_PRESCALERS[TCCR1B & CS_MASK];
+            if (prescaler == 0) {
+                return 0;
+            }
+            return F_CPU / (prescaler * (OCR1A + 1ul));
+        }
+        case TIMER1_CAPTURE:
+        case EXTERNAL_IRQ_0:
+            if (SIM.cfg.external_clock_ms != 0 &&
+                cycles() >= SIM.cfg.external_clock_ms * (F_CPU / 1000ull)) {
+                return 0;
+            }
+            return SIM.cfg.external_clock_hz;
+        default:
+            return 0;
+    }
+}
+
+/**
+ * Perform a single conversion and deliver its interrupt.
+ */
+static void convert() {
+    uint8_t channel = SIM.prelatched ? SIM.prelatched_channel : mux_channel();
+    SIM.prelatched = false;
+    uint16_t value = SIM.cfg.signal(channel, SIM.index[channel]++) & 0x3FF;
+    if (ADMUX & (1 << ADLAR)) {
+        ADCL = (value & 0b11) << 6;
+        ADCH = value >> 2;
+    } else {
+        ADCL = value & UINT8_MAX;
+        ADCH = value >> 8;
+    }
+    ADC = value;
+    ++SIM.counters.conversions;
+
+    uint8_t adcsra = (ADCSRA.value & ~(1 << ADSC)) | (1 << ADIF);
+    ADCSRA.value = adcsra;
+    if ((adcsra & (1 << ADIE)) && ADC_vect != nullptr) {
+        // The flag is cleared as the vector is entered
+        ADCSRA.value = adcsra & ~(1 << ADIF);
+        ++SIM.counters.interrupts;
+        SIM.in_isr = true;
+        ADC_vect();
+        SIM.in_isr = false;
+    }
+}
+
+/**
+ * Simulate the edge scheduled on an event.
+ */
+static void edge(Event event) {
+    uint8_t i = static_cast<uint8_t>(event);
+    if (SIM.edge_period[i] != 0) {
+        SIM.edge_at[i] += SIM.edge_period[i];
+    } else {
+        SIM.edge_scheduled[i] = false;
+    }
+    uint8_t adcsra = ADCSRA.value;
+    bool autotriggered = (adcsra & (1 << ADEN)) && (adcsra & (1 << ADATE));
+    if (event == Event::Comparator) {
+        autotriggered = autotriggered && (ADCSRB & 0b111) == ANALOG_COMPARATOR;
+    } else if (event == Event::Int0) {
+        autotriggered = autotriggered && (ADCSRB & 0b111) == EXTERNAL_IRQ_0;
+    } else {
+        autotriggered = false;
+    }
+    // The conversion latches its channel right away
+    if (autotriggered) {
+        SIM.prelatched = true;
+        SIM.prelatched_channel = mux_channel();
+    }
+    if (event == Event::Comparator) {
+        ACSR |= (1 << ACI);
+        if ((ACSR & (1 << ACIE)) && ANALOG_COMP_vect != nullptr) {
+            ACSR &= ~(1 << ACI);
+            ANALOG_COMP_vect();
+        }
+    } else {
+        uint8_t n = event == Event::Int0 ? INT0 : INT1;
+        EIFR |= (1 << n);
+        if (EIMSK & (1 << n)) {
+            EIFR &= ~(1 << n);
+            external_interrupt(n);
+        }
+    }
+    if (autotriggered) {
+        convert();
+    }
+}
+
+/**
+ * Deliver the overflow interrupts of a timer which came due.
+ */
+static void dispatch_overflows(TimerFlags& flags, volatile uint8_t& timsk,
+                               void (*vector)(void)) {
+    if (!(timsk & 1) || vector == nullptr) {
+        return;
+    }
+    uint64_t overflows = flags.counter->overflows();
+    while (flags.dispatched < overflows) {
+        ++flags.dispatched;
+        vector();
+    }
+}
+
+/**
+ * Perform the conversions which came due by some time.
+ *
+ * @param rate: Trigger rate conversions come at.
+ * @param until: Cycle count to convert up to.
+ * @param n: Conversions performed by this signal so far.
+ */
+static void convert_due(uint32_t rate, uint64_t until, uint32_t& n) {
+    if (rate == 0) {
+        return;
+    }
+    double period = static_cast<double>(F_CPU) / rate;
+    while (SIM.next_trigger <= until) {
+        if (n++ < SIM.cfg.max_burst) {
+            convert();
+        } else {
+            ++SIM.counters.lost_triggers;
+        }
+        SIM.next_trigger += period;
+    }
+}
+
+/**
+ * @returns (double): CPU cycles it takes a USART to send a byte.
+ */
+static double byte_cycles(uint8_t port) {
+    // The baud rate is `F_CPU / (divisor * (UBRR + 1))`
+    uint8_t divisor = (*UCSRA[port] & (1 << U2X0)) ? 8 : 16;
+    return UART_BITS_PER_BYTE * divisor * (*UBRR[port] + 1.0);
+}
+
+/**
+ * Deliver the data register empty interrupts of every USART which came due
+ * by some time.
+ *
+ * @param until: Cycle count to transmit up to.
+ */
+static void transmit_due(uint64_t until) {
+    for (uint8_t i = 0; i < NPORTS; ++i) {
+        Uart& u = SIM.uarts[i];
+        if (UDRE_VECTORS[i] == nullptr) {
+            continue;
+        }
+        // The interrupt was enabled some time since the last signal
+        if (u.empty_at < SIM.serviced_at) {
+            u.empty_at = SIM.serviced_at;
+        }
+        while ((*UCSRB[i] & (1 << UDRIE0)) && u.empty_at <= until) {
+            uint64_t written = SIM.counters.uart_bytes;
+            u.isr_at = u.empty_at;
+            u.in_isr = true;
+            UDRE_VECTORS[i]();
+            u.in_isr = false;
+            // Nothing was written. The board would keep taking the
+            // interrupt, which would hang the simulation.
+            if (SIM.counters.uart_bytes == written) {
+                break;
+            }
+        }
+        if (u.dirty) {
+            fflush(u.out);
+            u.dirty = false;
+        }
+    }
+}
+
+/**
+ * Perform every conversion and edge which came due, in order, and deliver
+ * pending interrupts.
+ */
+static void service() {
+    uint64_t now = cycles();
+    uint32_t rate = trigger_rate();
+    if (rate != SIM.rate) {
+        // Started, stopped or reconfigured. Start counting periods over.
+        SIM.rate = rate;
+        SIM.next_trigger = now + static_cast<double>(F_CPU) / rate;
+    }
+    uint32_t n = 0;
+    while (true) {
+        int8_t due = -1;
+        for (uint8_t i = 0; i < NEVENTS; ++i) {
+            if (SIM.edge_scheduled[i] && SIM.edge_at[i] <= now &&
+                (due < 0 || SIM.edge_at[i] < SIM.edge_at[due])) {
+                due = i;
+            }
+        }
+        convert_due(rate, due < 0 ? now : SIM.edge_at[due], n);
+        if (due < 0) {
+            break;
+        }
+        edge(static_cast<Event>(due));
+    }
+    dispatch_overflows(TIFR3, TIMSK3, TIMER3_OVF_vect);
+    dispatch_overflows(TIFR4, TIMSK4, TIMER4_OVF_vect);
+    dispatch_overflows(TIFR5, TIMSK5, TIMER5_OVF_vect);
+    transmit_due(now);
+    SIM.serviced_at = now;
+}
+
+static void on_signal(int) {
+    ++SIM.counters.signals;
+    service();
+}
+
+void begin(const Config& cfg) {
+    SIM.cfg = cfg;
+    clock_gettime(CLOCK_MONOTONIC, &SIM.start);
+    if (cfg.mode != Mode::RealTime) {
+        return;
+    }
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = on_signal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(INTERRUPT_SIGNAL, &action, nullptr) != 0) {
+        perror("sigaction");
+        exit(1);
+    }
+    struct sigevent event;
+    memset(&event, 0, sizeof(event));
+    event.sigev_notify = SIGEV_SIGNAL;
+    event.sigev_signo = INTERRUPT_SIGNAL;
+    if (timer_create(CLOCK_MONOTONIC, &event, &SIM.timer) != 0) {
+        perror("timer_create");
+        exit(1);
+    }
+    struct itimerspec spec;
+    spec.it_interval.tv_sec = cfg.signal_period_us / 1000000;
+    spec.it_interval.tv_nsec = (cfg.signal_period_us % 1000000) * 1000;
+    spec.it_value = spec.it_interval;
+    timer_settime(SIM.timer, 0, &spec, nullptr);
+    SIM.running = true;
+}
+
+void end() {
+    if (SIM.running) {
+        timer_delete(SIM.timer);
+        SIM.running = false;
+    }
+    for (uint8_t i = 0; i < NPORTS; ++i) {
+        if (SIM.uarts[i].out != nullptr) {
+            fclose(SIM.uarts[i].out);
+            SIM.uarts[i].out = nullptr;
+        }
+    }
+}
+
+void step(uint32_t n) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        for (uint32_t i = 0; i < n; ++i) {
+            convert();
+        }
+        dispatch_overflows(TIFR3, TIMSK3, TIMER3_OVF_vect);
+        dispatch_overflows(TIFR4, TIMSK4, TIMER4_OVF_vect);
+        dispatch_overflows(TIFR5, TIMSK5, TIMER5_OVF_vect);
+    }
+}
+
+void schedule_edge(Event event, uint32_t delay_us, uint32_t period_us) {
+    uint8_t i = static_cast<uint8_t>(event);
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        SIM.edge_at[i] = cycles() + static_cast<uint64_t>(delay_us) *
+                                        (F_CPU / 1000000);
+        SIM.edge_period[i] = static_cast<uint64_t>(period_us) *
+                             (F_CPU / 1000000);
+        SIM.edge_scheduled[i] = true;
+    }
+}
+
+bool uart_output(uint8_t port, const char* path) {
+    if (port >= NPORTS) {
+        return false;
+    }
+    // Never make a pseudo-terminal the controlling terminal
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_NOCTTY, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    FILE* out = fdopen(fd, "wb");
+    if (out == nullptr) {
+        close(fd);
+        return false;
+    }
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (SIM.uarts[port].out != nullptr) {
+            fclose(SIM.uarts[port].out);
+        }
+        SIM.uarts[port].out = out;
+    }
+    return true;
+}
+
+void sleep_cpu() {
+    ++SIM.counters.sleeps;
+    // Returns once the next simulated interrupt has been handled
+    pause();
+}
+
+Counters counters() {
+    Counters c;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { c = SIM.counters; }
+    return c;
+}
+
+AdcControlRegister::operator uint8_t() {
+    uint8_t v = value;
+    // The pipelined ISR waits for the next conversion to latch its channel.
+    // Rather than stall the simulation, start that conversion right away.
+    if (SIM.in_isr && !(v & (1 << ADSC)) && (v & (1 << ADATE))) {
+        SIM.prelatched = true;
+        SIM.prelatched_channel = mux_channel();
+        v |= (1 << ADSC);
+        value = v;
+    }
+    return v;
+}
+
+AdcControlRegister& AdcControlRegister::operator=(uint8_t v) {
+    // Writing a one clears the interrupt flag
+    uint8_t flag = (v & (1 << ADIF)) ? 0 : (value & (1 << ADIF));
+    value = (v & ~(1 << ADIF)) | flag;
+    // A single conversion started by hand finishes right away
+    const uint8_t single = (1 << ADEN) | (1 << ADSC);
+    if ((v & single) == single && !(v & (1 << ADATE))) {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { convert(); }
+    }
+    return *this;
+}
+
+uint16_t TimerCounter::prescaler() const {
+    return TIMER_PRESCALERS[*tccrb & CS_MASK];
+}
+
+uint64_t TimerCounter::ticks() {
+    uint16_t p = prescaler();
+    if (p == 0) {
+        return start;
+    }
+    return start + (cycles() - base_cycles) / p;
+}
+
+uint64_t TimerCounter::overflows() { return ticks() / TIMER_TOP; }
+
+TimerCounter::operator uint16_t() { return ticks() % TIMER_TOP; }
+
+TimerCounter& TimerCounter::operator=(uint16_t v) {
+    base_cycles = cycles();
+    start = v;
+    return *this;
+}
+
+TimerFlags::operator uint8_t() {
+    uint8_t v = value;
+    if (counter->overflows() > dispatched) {
+        v |= 1;
+    }
+    return v;
+}
+
+TimerFlags& TimerFlags::operator=(uint8_t v) {
+    // Writing a one clears a flag
+    if (v & 1) {
+        dispatched = counter->overflows();
+    }
+    value &= ~v;
+    return *this;
+}
+
+UartData& UartData::operator=(uint8_t v) {
+    value = v;
+    Uart& u = SIM.uarts[port];
+    double at = u.in_isr ? u.isr_at : static_cast<double>(cycles());
+    double start = at > u.idle_at ? at : u.idle_at;
+    u.idle_at = start + byte_cycles(port);
+    u.empty_at = start;
+    ++SIM.counters.uart_bytes;
+    if (u.out != nullptr) {
+        fputc(v, u.out);
+        u.dirty = true;
+    }
+    return *this;
+}
+
+}  // namespace host
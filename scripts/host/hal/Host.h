@@ -0,0 +1,226 @@
+#pragma once
+
+/**
+ * Control over the simulated ATMEGA2560 the library runs against on Linux.
+ *
+ * The simulation runs entirely on the calling thread. Interrupts are
+ * delivered as a POSIX timer signal, so the ISR preempts the main loop at
+ * arbitrary instructions and never runs concurrently with it, just like on
+ * the microcontroller. `cli`, `sei` and `ATOMIC_BLOCK` mask that signal.
+ *
+ * The ADC converts on every trigger, at the rate its registers are
+ * configured for (timer 1 compare match B or free-running) or of a
+ * simulated external clock, optionally overridden. Every conversion reads from a signal function, which
+ * by default tags samples with their channel and a per-channel counter so
+ * consumers can check that nothing was lost, duplicated or misrouted.
+ *
+ * USARTs send a byte every time their data register empty interrupt writes
+ * the data register, at the baud rate they are configured for.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace host {
+
+/**
+ * Produces the 10-bit value of a conversion.
+ *
+ * @param channel: ADC channel (0 - 15) latched for the conversion.
+ * @param index: Number of conversions on this channel before this one.
+ *
+ * @returns (uint16_t): Conversion result (0 - 1023).
+ */
+typedef uint16_t (*SignalFn)(uint8_t channel, uint32_t index);
+
+/**
+ * Default signal. The top 4 bits hold the channel and the next 4 bits a
+ * per-channel counter, so both 8-bit (left adjusted) and 10-bit samples carry
+ * the channel and counter in their top 8 bits.
+ */
+uint16_t tagged_signal(uint8_t channel, uint32_t index);
+
+/**
+ * How conversions are triggered.
+ */
+enum struct Mode : uint8_t {
+    RealTime, /* !< A timer signal triggers conversions at the ADC's rate. */
+    Manual,   /* !< Conversions only happen when `step` is called. */
+};
+
+/**
+ * Simulation settings.
+ */
+struct Config {
+    /**
+     * How conversions are triggered.
+     */
+    Mode mode = Mode::RealTime;
+    /**
+     * Trigger rate (conversions per second) to use instead of the rate the
+     * registers are configured for. 0 uses the configured rate.
+     */
+    uint32_t rate_override = 0;
+    /**
+     * Rate (edges per second) of the external clock on ICP1 and INT0, which
+     * triggers conversions while the ADC is autotriggered by either. 0 leaves
+     * both quiet.
+     */
+    uint32_t external_clock_hz = 0;
+    /**
+     * Milliseconds after `begin` the external clock stops at, e.g. to check
+     * that recorders give up on it. 0 keeps it running.
+     */
+    uint32_t external_clock_ms = 0;
+    /**
+     * Microseconds between timer signals in real-time mode. Every signal
+     * performs all conversions which came due since the last one. Shorter
+     * periods interleave the ISR with the main loop more finely.
+     */
+    uint32_t signal_period_us = 50;
+    /**
+     * Most conversions performed per signal. Triggers beyond this are lost,
+     * like they are on hardware when the ISR falls behind.
+     */
+    uint32_t max_burst = 64;
+    /**
+     * Signal every conversion reads from.
+     */
+    SignalFn signal = tagged_signal;
+};
+
+/**
+ * Statistics about the simulation.
+ */
+struct Counters {
+    /* !< Conversions performed */
+    uint64_t conversions;
+    /* !< ADC interrupts delivered */
+    uint64_t interrupts;
+    /* !< Triggers lost because a signal came too late */
+    uint64_t lost_triggers;
+    /* !< Timer signals handled */
+    uint64_t signals;
+    /* !< Times the CPU went to sleep */
+    uint64_t sleeps;
+    /* !< Bytes transmitted by the USARTs */
+    uint64_t uart_bytes;
+};
+
+/**
+ * Hardware events the simulation can raise edges on. The comparator and
+ * INT0 can also autotrigger the ADC.
+ */
+enum struct Event : uint8_t {
+    Comparator, /* !< Analog comparator output changing */
+    Int0,       /* !< Edge on INT0 */
+    Int1,       /* !< Edge on INT1 */
+};
+
+/**
+ * Simulated write timing of the card, to see how the library copes with a
+ * slow or stalling card. Every write busy-waits (with interrupts enabled).
+ */
+struct SdTiming {
+    /**
+     * Microseconds per 512 bytes written.
+     */
+    uint32_t us_per_block = 0;
+    /**
+     * Extra microseconds spent by every `stall_every`th write (e.g. to
+     * simulate flash erases).
+     */
+    uint32_t stall_us = 0;
+    /**
+     * How often writes stall. 0 never stalls.
+     */
+    uint32_t stall_every = 0;
+    /**
+     * Extra microseconds spent for every cluster a write has to allocate
+     * (e.g. to simulate FAT updates). Preallocated clusters cost nothing.
+     */
+    uint32_t us_per_alloc = 0;
+    /**
+     * Microseconds every `preAllocate` takes however much it allocates (e.g.
+     * to simulate searching the FAT for a free extent).
+     */
+    uint32_t us_per_prealloc = 0;
+};
+
+/**
+ * Start the simulation. Must be called before anything else in the library.
+ *
+ * @param cfg: Simulation settings.
+ */
+void begin(const Config& cfg = Config());
+
+/**
+ * Stop delivering interrupts.
+ */
+void end();
+
+/**
+ * Perform conversions synchronously. Meant for `Mode::Manual`.
+ *
+ * @param n: Number of triggers to simulate.
+ */
+void step(uint32_t n = 1);
+
+/**
+ * Simulate an edge of a hardware event some time from now. The edge sets
+ * the event's flag, which starts a conversion if the ADC is autotriggered by
+ * it, then delivers the event's interrupt if it is enabled (before the
+ * conversion's, which takes longer).
+ *
+ * Each event has its own schedule, which replaces any earlier one.
+ *
+ * @param event: Event the edge is on.
+ * @param delay_us: Microseconds from now to simulate the edge at.
+ * @param period_us: Microseconds between edges after the first one (e.g.
+ * for a PPS signal), or 0 for a single edge.
+ */
+void schedule_edge(Event event, uint32_t delay_us, uint32_t period_us = 0);
+
+/**
+ * @returns (uint32_t): Conversions per second the ADC is triggered at right
+ * now, or 0 if it is not converting.
+ */
+uint32_t trigger_rate();
+
+/**
+ * @returns (uint64_t): CPU cycles at `F_CPU` since `begin`.
+ */
+uint64_t cycles();
+
+/**
+ * @returns (Counters): Statistics about the simulation so far.
+ */
+Counters counters();
+
+/**
+ * Write the bytes a USART transmits to a file, e.g. the slave side of a
+ * pseudo-terminal a receiver reads from. They are thrown away otherwise.
+ *
+ * @param port: USART (0 - 3).
+ * @param path: File to write to, created if it does not exist.
+ *
+ * @returns (bool): True if the file could be opened.
+ */
+bool uart_output(uint8_t port, const char* path);
+
+/**
+ * Set the directory files on the simulated card live in (default: current
+ * working directory).
+ *
+ * @param path: Directory path.
+ */
+void sd_root(const char* path);
+
+/**
+ * Set the simulated write timing of the card.
+ *
+ * @param timing: Timing to use.
+ */
+void sd_timing(const SdTiming& timing);
+
+}  // namespace host
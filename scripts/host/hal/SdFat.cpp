@@ -0,0 +1,256 @@
+#include "SdFat.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Host.h"
+
+#define BLOCK_SZ 512
+#define CLUSTER_SZ 32768ull
+#define FILE_MODE 0644
+#define CARD_IMAGE "card.img"
+
+namespace host {
+
+static struct {
+    char root[PATH_MAX] = ".";
+    SdTiming timing;
+    uint32_t nwrites = 0;
+} CARD;
+
+void sd_root(const char* path) {
+    snprintf(CARD.root, sizeof(CARD.root), "%s", path);
+}
+
+void sd_timing(const SdTiming& timing) { CARD.timing = timing; }
+
+/**
+ * Host path of a file on the card.
+ */
+struct HostPath {
+    explicit HostPath(const char* path) {
+        snprintf(buf, sizeof(buf), "%s/%s", CARD.root, path);
+    }
+    const char* c_str() const { return buf; }
+    char buf[2 * PATH_MAX];
+};
+
+/**
+ * Take as long as the simulated card would to write out some data.
+ *
+ * @param sz: Bytes written.
+ * @param nclusters: Clusters allocated to make room for them.
+ */
+static void simulate_write(size_t sz, uint64_t nclusters) {
+    uint64_t us = ((sz + BLOCK_SZ - 1) / BLOCK_SZ) * CARD.timing.us_per_block;
+    us += nclusters * CARD.timing.us_per_alloc;
+    ++CARD.nwrites;
+    if (CARD.timing.stall_every != 0 &&
+        CARD.nwrites % CARD.timing.stall_every == 0) {
+        us += CARD.timing.stall_us;
+    }
+    if (us != 0) {
+        delayMicroseconds(us);
+    }
+}
+
+}  // namespace host
+
+SdFile::~SdFile() { close(); }
+
+bool SdFile::open(const char* path, oflag_t oflag) {
+    if (isOpen()) {
+        return false;
+    }
+    do {
+        fd_ = ::open(host::HostPath(path).c_str(), oflag, FILE_MODE);
+    } while (fd_ < 0 && errno == EINTR);
+    allocated_ = (fileSize() + CLUSTER_SZ - 1) / CLUSTER_SZ * CLUSTER_SZ;
+    return fd_ >= 0;
+}
+
+bool SdFile::close() {
+    if (!isOpen()) {
+        return false;
+    }
+    bool ok = ::close(fd_) == 0;
+    fd_ = -1;
+    allocated_ = 0;
+    return ok;
+}
+
+bool SdFile::sync() { return isOpen() && fsync(fd_) == 0; }
+
+bool SdFile::remove() {
+    char link[64];
+    char path[PATH_MAX];
+    snprintf(link, sizeof(link), "/proc/self/fd/%d", fd_);
+    ssize_t n = readlink(link, path, sizeof(path) - 1);
+    if (n < 0 || !close()) {
+        return false;
+    }
+    path[n] = '\0';
+    return unlink(path) == 0;
+}
+
+size_t SdFile::write(const void* buf, size_t sz) {
+    if (!isOpen()) {
+        return 0;
+    }
+    uint64_t end = curPosition() + sz;
+    uint64_t nclusters = 0;
+    if (end > allocated_) {
+        nclusters = (end - allocated_ + CLUSTER_SZ - 1) / CLUSTER_SZ;
+        allocated_ += nclusters * CLUSTER_SZ;
+    }
+    host::simulate_write(sz, nclusters);
+    const uint8_t* p = static_cast<const uint8_t*>(buf);
+    size_t written = 0;
+    while (written < sz) {
+        ssize_t n = ::write(fd_, p + written, sz - written);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        written += n;
+    }
+    return written;
+}
+
+int SdFile::read(void* buf, size_t sz) {
+    if (!isOpen()) {
+        return -1;
+    }
+    ssize_t n;
+    do {
+        n = ::read(fd_, buf, sz);
+    } while (n < 0 && errno == EINTR);
+    return n;
+}
+
+int SdFile::read() {
+    uint8_t b;
+    return read(&b, 1) == 1 ? b : -1;
+}
+
+bool SdFile::seekSet(uint64_t pos) {
+    return isOpen() && lseek(fd_, pos, SEEK_SET) >= 0;
+}
+
+bool SdFile::seekCur(int64_t offset) {
+    return isOpen() && lseek(fd_, offset, SEEK_CUR) >= 0;
+}
+
+bool SdFile::seekEnd(int64_t offset) {
+    return isOpen() && lseek(fd_, offset, SEEK_END) >= 0;
+}
+
+uint64_t SdFile::curPosition() const {
+    off_t pos = isOpen() ? lseek(fd_, 0, SEEK_CUR) : 0;
+    return pos < 0 ? 0 : pos;
+}
+
+uint64_t SdFile::fileSize() const {
+    struct stat st;
+    if (!isOpen() || fstat(fd_, &st) != 0) {
+        return 0;
+    }
+    return st.st_size;
+}
+
+bool SdFile::truncate(uint64_t length) {
+    if (!isOpen() || ftruncate(fd_, length) != 0) {
+        return false;
+    }
+    // Clusters past the one holding the new end of file are freed
+    allocated_ = (length + CLUSTER_SZ - 1) / CLUSTER_SZ * CLUSTER_SZ;
+    // SdFat leaves the position at the new end of file
+    return seekSet(length);
+}
+
+bool SdFile::truncate() { return truncate(curPosition()); }
+
+bool SdFile::preAllocate(uint64_t length) {
+    // Like SdFat on FAT volumes, only empty files can be preallocated and
+    // they take on the preallocated size
+    if (!isOpen() || fileSize() != 0 || fallocate(fd_, 0, 0, length) != 0) {
+        return false;
+    }
+    allocated_ = (length + CLUSTER_SZ - 1) / CLUSTER_SZ * CLUSTER_SZ;
+    if (host::CARD.timing.us_per_prealloc != 0) {
+        delayMicroseconds(host::CARD.timing.us_per_prealloc);
+    }
+    return true;
+}
+
+bool SdFile::contiguousRange(uint32_t* bgnSector, uint32_t* endSector) {
+    // Files on the host have no sectors, so make some up
+    if (!isOpen() || allocated_ == 0) {
+        return false;
+    }
+    *bgnSector = 0;
+    *endSector = allocated_ / BLOCK_SZ - 1;
+    return true;
+}
+
+bool SdCard::erase(uint32_t firstSector, uint32_t lastSector) {
+    return firstSector <= lastSector;
+}
+
+bool SdCard::writeStart(uint32_t sector) {
+    if (fd_ >= 0) {
+        return false;
+    }
+    do {
+        fd_ = ::open(host::HostPath(CARD_IMAGE).c_str(), O_WRONLY | O_CREAT,
+                     FILE_MODE);
+    } while (fd_ < 0 && errno == EINTR);
+    sector_ = sector;
+    return fd_ >= 0;
+}
+
+bool SdCard::writeData(const uint8_t* src) {
+    if (fd_ < 0) {
+        return false;
+    }
+    host::simulate_write(BLOCK_SZ, 0);
+    off_t offset = static_cast<off_t>(sector_) * BLOCK_SZ;
+    ssize_t n;
+    do {
+        n = pwrite(fd_, src, BLOCK_SZ, offset);
+    } while (n < 0 && errno == EINTR);
+    ++sector_;
+    return n == BLOCK_SZ;
+}
+
+bool SdCard::writeStop() {
+    if (fd_ < 0) {
+        return false;
+    }
+    bool ok = ::close(fd_) == 0;
+    fd_ = -1;
+    return ok;
+}
+
+bool SdFat::begin(SdSpiConfig cfg) {
+    (void)cfg;
+    return true;
+}
+
+bool SdFat::exists(const char* path) {
+    struct stat st;
+    return stat(host::HostPath(path).c_str(), &st) == 0;
+}
+
+bool SdFat::remove(const char* path) {
+    return unlink(host::HostPath(path).c_str()) == 0;
+}
+
+bool SdFat::mkdir(const char* path) {
+    return ::mkdir(host::HostPath(path).c_str(), 0755) == 0 || errno == EEXIST;
+}
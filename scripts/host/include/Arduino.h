@@ -0,0 +1,131 @@
+#pragma once
+
+/**
+ * Linux stand-in for the subset of the Arduino core used by the library.
+ */
+
+#include <limits.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "avr/interrupt.h"
+#include "avr/io.h"
+#include "avr/pgmspace.h"
+
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+
+#define HIGH 0x1
+#define LOW 0x0
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+// Analog pins of the ATMEGA2560
+enum : uint8_t {
+    A0 = 54,
+    A1,
+    A2,
+    A3,
+    A4,
+    A5,
+    A6,
+    A7,
+    A8,
+    A9,
+    A10,
+    A11,
+    A12,
+    A13,
+    A14,
+    A15,
+};
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+void attachInterrupt(uint8_t num, void (*fn)(), int mode);
+void detachInterrupt(uint8_t num);
+#define digitalPinToInterrupt(p) \
+    ((p) == 2 ? 0 : ((p) == 3 ? 1 : ((p) >= 18 && (p) <= 21 ? 23 - (p) : -1)))
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper*>(s))
+
+/**
+ * Text output, printed to standard output.
+ */
+class Print {
+   public:
+    virtual ~Print() = default;
+    virtual size_t write(uint8_t c);
+    virtual size_t write(const uint8_t* buf, size_t sz);
+    size_t write(const char* s) {
+        return write(reinterpret_cast<const uint8_t*>(s), strlen(s));
+    }
+
+    size_t print(const __FlashStringHelper* s);
+    size_t print(const char* s);
+    size_t print(char c);
+    size_t print(int v, int base = 10);
+    size_t print(unsigned int v, int base = 10);
+    size_t print(long v, int base = 10);
+    size_t print(unsigned long v, int base = 10);
+    size_t print(long long v, int base = 10);
+    size_t print(unsigned long long v, int base = 10);
+    size_t print(double v, int digits = 2);
+
+    size_t println();
+    template <typename T>
+    size_t println(T v) {
+        return print(v) + println();
+    }
+    template <typename T>
+    size_t println(T v, int arg) {
+        return print(v, arg) + println();
+    }
+};
+
+/**
+ * Byte stream. Never has anything to read on the host.
+ */
+class Stream : public Print {
+   public:
+    virtual int available() { return 0; }
+    virtual int read() { return -1; }
+    virtual int peek() { return -1; }
+    virtual void flush() {}
+    virtual int availableForWrite() { return INT_MAX; }
+};
+
+/**
+ * Serial port, backed by standard output.
+ */
+class HardwareSerial : public Stream {
+   public:
+    void begin(unsigned long baud) { (void)baud; }
+    void end() {}
+    operator bool() { return true; }
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
@@ -0,0 +1,114 @@
+#pragma once
+
+/**
+ * Linux stand-in for the subset of SdFat used by the library. Files live in
+ * an ordinary directory (see `host::sd_root`), and writes can be slowed down
+ * to behave like a particular card (see `host::SdTiming`).
+ */
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Arduino.h"
+
+#ifndef O_WRITE
+#define O_WRITE O_WRONLY
+#endif
+#ifndef O_READ
+#define O_READ O_RDONLY
+#endif
+#define O_AT_END O_APPEND
+
+typedef int oflag_t;
+
+#define SHARED_SPI 0
+#define DEDICATED_SPI 1
+#define ENABLE_DEDICATED_SPI 1
+#define SD_SCK_MHZ(mhz) (1000000UL * (mhz))
+
+/**
+ * SPI configuration. Ignored on the host.
+ */
+struct SdSpiConfig {
+    SdSpiConfig(uint8_t cs, uint8_t opt, uint32_t clock)
+        : cs(cs), opt(opt), clock(clock) {}
+    uint8_t cs;
+    uint8_t opt;
+    uint32_t clock;
+};
+
+/**
+ * File on the simulated card.
+ */
+class SdFile {
+   public:
+    SdFile() = default;
+    ~SdFile();
+    SdFile(const SdFile&) = delete;
+    SdFile& operator=(const SdFile&) = delete;
+
+    bool open(const char* path, oflag_t oflag = O_RDONLY);
+    bool close();
+    bool isOpen() const { return fd_ >= 0; }
+    bool sync();
+    bool remove();
+
+    size_t write(const void* buf, size_t sz);
+    size_t write(uint8_t b) { return write(&b, 1); }
+    int read(void* buf, size_t sz);
+    int read();
+
+    bool seekSet(uint64_t pos);
+    bool seekCur(int64_t offset);
+    bool seekEnd(int64_t offset = 0);
+    uint64_t curPosition() const;
+    uint64_t fileSize() const;
+    bool truncate(uint64_t length);
+    bool truncate();
+    bool preAllocate(uint64_t length);
+    bool contiguousRange(uint32_t* bgnSector, uint32_t* endSector);
+
+   private:
+    int fd_ = -1;
+    /* !< Bytes of clusters allocated to the file */
+    uint64_t allocated_ = 0;
+};
+
+typedef SdFile FsFile;
+typedef SdFile File32;
+typedef SdFile File;
+
+/**
+ * Simulated card. Sectors written directly live in `card.img` (see
+ * `host::sd_root`), separate from the files.
+ */
+class SdCard {
+   public:
+    bool erase(uint32_t firstSector, uint32_t lastSector);
+    bool writeStart(uint32_t sector);
+    bool writeData(const uint8_t* src);
+    bool writeStop();
+
+   private:
+    int fd_ = -1;
+    uint32_t sector_ = 0;
+};
+
+/**
+ * Simulated card and volume.
+ */
+class SdFat {
+   public:
+    SdCard* card() { return &card_; }
+    bool begin(SdSpiConfig cfg);
+    bool begin(uint8_t cs) { return begin(SdSpiConfig(cs, SHARED_SPI, 0)); }
+    bool exists(const char* path);
+    bool remove(const char* path);
+    bool mkdir(const char* path);
+
+   private:
+    SdCard card_;
+};
+
+typedef SdFat SdFs;
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "avr/io.h"
+
+namespace host {
+void interrupts_off();
+void interrupts_on();
+}  // namespace host
+
+/**
+ * Interrupt vectors are plain C functions which the simulation calls with
+ * simulated interrupts masked, just like the hardware does.
+ */
+#define ISR(vector, ...)                          \
+    extern "C" void vector(void) __VA_ARGS__;     \
+    extern "C" void vector(void)
+
+#define cli() host::interrupts_off()
+#define sei() host::interrupts_on()
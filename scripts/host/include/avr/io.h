@@ -0,0 +1,267 @@
+#pragma once
+
+/**
+ * Linux stand-in for the ATMEGA2560 registers used by the library.
+ *
+ * Most registers are plain memory. The ones whose hardware behavior the
+ * library depends on (the ADC control register, timer counters and their
+ * overflow flags, USART data registers) are small classes which forward to
+ * the simulation in `hal/Host.cpp`.
+ */
+
+#include <stdint.h>
+
+namespace host {
+
+/**
+ * ADC control and status register A. Reading it from the ADC ISR while no
+ * conversion is in flight starts the next one early, which is what the ISR
+ * waits for when the mux is pipelined.
+ */
+struct AdcControlRegister {
+    volatile uint8_t value;
+
+    operator uint8_t();
+    AdcControlRegister& operator=(uint8_t v);
+    AdcControlRegister& operator|=(int v) { return *this = *this | v; }
+    AdcControlRegister& operator&=(int v) { return *this = *this & v; }
+};
+
+/**
+ * 16-bit timer counter which counts the host clock through the prescaler
+ * selected in its control register B.
+ */
+struct TimerCounter {
+    volatile uint8_t* tccrb;
+    /* !< Host cycle count the counter was last written at */
+    volatile uint64_t base_cycles;
+    /* !< Value the counter was last written with */
+    volatile uint16_t start;
+
+    uint16_t prescaler() const;
+    uint64_t ticks();
+    uint64_t overflows();
+    operator uint16_t();
+    TimerCounter& operator=(uint16_t v);
+};
+
+/**
+ * Timer interrupt flag register. The overflow flag is set whenever the
+ * counter wrapped more times than overflow interrupts were dispatched.
+ */
+struct TimerFlags {
+    TimerCounter* counter;
+    volatile uint8_t value;
+    volatile uint64_t dispatched;
+
+    operator uint8_t();
+    TimerFlags& operator=(uint8_t v);
+    TimerFlags& operator|=(int v) { return *this = v; }
+};
+
+/**
+ * USART data register. Writing it transmits a byte at the baud rate the
+ * USART's other registers are configured for.
+ */
+struct UartData {
+    uint8_t port;
+    volatile uint8_t value;
+
+    operator uint8_t() { return value; }
+    UartData& operator=(uint8_t v);
+};
+
+}  // namespace host
+
+#define R8(name) extern volatile uint8_t name;
+#define R16(name) extern volatile uint16_t name;
+
+// Power reduction
+R8(PRR0) R8(PRR1)
+
+// ADC
+extern host::AdcControlRegister ADCSRA;
+R8(ADCSRB) R8(ADMUX) R8(ADCL) R8(ADCH) R16(ADC) R8(DIDR0) R8(DIDR2)
+
+// Analog comparator
+R8(ACSR) R8(DIDR1)
+
+// Timer 1
+R8(TCCR1A) R8(TCCR1B) R8(TCCR1C) R8(TIMSK1) R8(TIFR1) R16(TCNT1) R16(OCR1A)
+R16(OCR1B) R16(OCR1C) R16(ICR1)
+
+// Timers 3 - 5
+R8(TCCR3A) R8(TCCR3B) R8(TCCR3C) R8(TIMSK3) R16(OCR3A) R16(OCR3B) R16(ICR3)
+R8(TCCR4A) R8(TCCR4B) R8(TCCR4C) R8(TIMSK4) R16(OCR4A) R16(OCR4B) R16(ICR4)
+R8(TCCR5A) R8(TCCR5B) R8(TCCR5C) R8(TIMSK5) R16(OCR5A) R16(OCR5B) R16(ICR5)
+extern host::TimerCounter TCNT3;
+extern host::TimerCounter TCNT4;
+extern host::TimerCounter TCNT5;
+extern host::TimerFlags TIFR3;
+extern host::TimerFlags TIFR4;
+extern host::TimerFlags TIFR5;
+
+// External interrupts
+R8(EICRA) R8(EICRB) R8(EIMSK) R8(EIFR)
+
+// Sleep and status
+R8(SMCR) R8(MCUCR) R8(SREG)
+
+// USART 0 - 3
+R8(UCSR0A) R8(UCSR0B) R8(UCSR0C) R16(UBRR0)
+R8(UCSR1A) R8(UCSR1B) R8(UCSR1C) R16(UBRR1)
+R8(UCSR2A) R8(UCSR2B) R8(UCSR2C) R16(UBRR2)
+R8(UCSR3A) R8(UCSR3B) R8(UCSR3C) R16(UBRR3)
+extern host::UartData UDR0;
+extern host::UartData UDR1;
+extern host::UartData UDR2;
+extern host::UartData UDR3;
+
+#undef R8
+#undef R16
+
+// PRR0
+#define PRADC 0
+#define PRUSART0 1
+#define PRSPI 2
+#define PRTIM1 3
+#define PRTIM0 5
+#define PRTIM2 6
+#define PRTWI 7
+
+// PRR1
+#define PRUSART1 0
+#define PRUSART2 1
+#define PRUSART3 2
+#define PRTIM3 3
+#define PRTIM4 4
+#define PRTIM5 5
+
+// ADCSRA
+#define ADPS0 0
+#define ADPS1 1
+#define ADPS2 2
+#define ADIE 3
+#define ADIF 4
+#define ADATE 5
+#define ADSC 6
+#define ADEN 7
+
+// ADCSRB
+#define ADTS0 0
+#define ADTS1 1
+#define ADTS2 2
+#define MUX5 3
+#define ACME 6
+
+// ADMUX
+#define MUX0 0
+#define MUX1 1
+#define MUX2 2
+#define MUX3 3
+#define MUX4 4
+#define ADLAR 5
+#define REFS0 6
+#define REFS1 7
+
+// ACSR
+#define ACIS0 0
+#define ACIS1 1
+#define ACIC 2
+#define ACIE 3
+#define ACI 4
+#define ACO 5
+#define ACBG 6
+#define ACD 7
+
+// Timer control registers (the same bit positions for timers 1, 3, 4, 5)
+#define WGM10 0
+#define WGM11 1
+#define WGM12 3
+#define WGM13 4
+#define CS10 0
+#define CS11 1
+#define CS12 2
+#define ICES1 6
+#define ICNC1 7
+#define CS30 0
+#define CS31 1
+#define CS32 2
+#define WGM32 3
+#define CS40 0
+#define CS41 1
+#define CS42 2
+#define WGM42 3
+#define CS50 0
+#define CS51 1
+#define CS52 2
+#define WGM52 3
+
+// Timer interrupt masks and flags
+#define TOIE1 0
+#define OCIE1A 1
+#define OCIE1B 2
+#define OCIE1C 3
+#define ICIE1 5
+#define TOV1 0
+#define OCF1A 1
+#define OCF1B 2
+#define OCF1C 3
+#define ICF1 5
+#define TOIE3 0
+#define TOV3 0
+#define TOIE4 0
+#define TOV4 0
+#define TOIE5 0
+#define TOV5 0
+
+// External interrupts
+#define ISC00 0
+#define ISC01 1
+#define ISC10 2
+#define ISC11 3
+#define INT0 0
+#define INT1 1
+#define INTF0 0
+#define INTF1 1
+
+// SMCR
+#define SE 0
+#define SM0 1
+#define SM1 2
+#define SM2 3
+
+// USART
+#define MPCM0 0
+#define U2X0 1
+#define UDRE0 5
+#define TXC0 6
+#define RXC0 7
+#define TXEN0 3
+#define RXEN0 4
+#define UDRIE0 5
+#define TXCIE0 6
+#define RXCIE0 7
+#define UCSZ00 1
+#define UCSZ01 2
+#define U2X1 1
+#define UDRE1 5
+#define TXC1 6
+#define RXC1 7
+#define TXEN1 3
+#define RXEN1 4
+#define UDRIE1 5
+#define TXCIE1 6
+#define RXCIE1 7
+#define UCSZ10 1
+#define UCSZ11 2
+#define U2X2 1
+#define TXEN2 3
+#define UDRIE2 5
+#define UCSZ20 1
+#define UCSZ21 2
+#define U2X3 1
+#define TXEN3 3
+#define UDRIE3 5
+#define UCSZ30 1
+#define UCSZ31 2
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "avr/io.h"
+
+namespace host {
+void sleep_cpu();
+}  // namespace host
+
+/**
+ * Sleeping waits for the next simulated interrupt. Only idle mode is
+ * simulated, since the simulation keeps every peripheral running anyway.
+ */
+#define SLEEP_MODE_IDLE 0
+
+#define set_sleep_mode(mode) \
+    (SMCR = (SMCR & ~((1 << SM2) | (1 << SM1) | (1 << SM0))) | (mode))
+#define sleep_enable() (SMCR |= (1 << SE))
+#define sleep_disable() (SMCR &= ~(1 << SE))
+#define sleep_cpu() host::sleep_cpu()
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <signal.h>
+
+namespace host {
+
+void block_interrupts(sigset_t* saved);
+void restore_interrupts(const sigset_t* saved);
+
+/**
+ * Masks simulated interrupts for as long as it lives, then restores the
+ * previous mask. Backs `ATOMIC_BLOCK` so early returns out of the block
+ * still restore interrupts.
+ */
+class InterruptGuard {
+   public:
+    InterruptGuard() { block_interrupts(&saved_); }
+    ~InterruptGuard() { restore_interrupts(&saved_); }
+
+   private:
+    sigset_t saved_;
+};
+
+}  // namespace host
+
+#define ATOMIC_RESTORESTATE 0
+#define ATOMIC_FORCEON 1
+#define ATOMIC_BLOCK(type)                             \
+    for (bool atomic_once = true; atomic_once;)        \
+        for (host::InterruptGuard atomic_guard; atomic_once; atomic_once = false)
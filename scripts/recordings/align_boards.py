@@ -0,0 +1,135 @@
+#!/usr/bin/env python3
+"""
+Line up recordings from several boards by the edges of a shared clock they
+all logged (`Options::sync_pin`).
+
+Each board's recording is a directory holding its WAV files along with the
+".syn" sidecar written next to the first of them, which lists the sample
+each edge of the shared clock came at. Every board's files are trimmed so
+the first edge all boards logged falls on the same sample, cut to a common
+length and written to `out_dir/<board>/`. The drift of each board's sample
+clock against the first board's between the first and last shared edges is
+reported as well, which is 0 when the boards share an external sample clock
+(`Options::clock`).
+
+Edge numbers only match if every board started logging between the same
+two edges of the shared clock (see `adc::log_sync`).
+
+Usage:
+    python align_boards.py out_dir board_a board_b [board_c ...]
+"""
+
+import argparse
+import glob
+import os
+import struct
+import sys
+import wave
+
+VERSION = 1
+SYNC_MAGIC = b"CHRY"
+SYNC_HEADER = struct.Struct("<4sBB2xII")
+MARK = struct.Struct("<II")
+
+
+class Board:
+    def __init__(self, path: str):
+        self.path = path
+        self.name = os.path.basename(os.path.normpath(path))
+        sidecars = glob.glob(os.path.join(path, "*.syn"))
+        if len(sidecars) != 1:
+            raise ValueError(f"{path} needs exactly one .syn sidecar")
+        self.wavs = sorted(glob.glob(os.path.join(path, "*.wav")))
+        if not self.wavs:
+            raise ValueError(f"{path} has no WAV files")
+        with open(sidecars[0], "rb") as f:
+            data = f.read()
+        magic, version, nchannels, rate, start_sample = (
+            SYNC_HEADER.unpack_from(data, 0)
+        )
+        if magic != SYNC_MAGIC:
+            raise ValueError(f"{sidecars[0]} is not a sync sidecar")
+        if version != VERSION:
+            raise ValueError(f"Unsupported version {version}")
+        self.sample_rate = rate
+        # Per-channel sample in the files each edge came at. Marks count
+        # samples across all channels from before any history was thrown
+        # away.
+        nmarks = (len(data) - SYNC_HEADER.size) // MARK.size
+        self.edges = {}
+        for i in range(nmarks):
+            edge, index = MARK.unpack_from(
+                data, SYNC_HEADER.size + i * MARK.size
+            )
+            self.edges[edge] = index // nchannels - start_sample
+
+
+def align(boards: list[Board]) -> tuple[int, int, list[int]]:
+    """
+    @returns: First and last edge every board logged, and how many samples
+    to drop from the start of each board's files.
+    """
+    shared = set.intersection(*(set(b.edges) for b in boards))
+    if not shared:
+        raise ValueError("No edge was logged by every board")
+    first, last = min(shared), max(shared)
+    lead = min(b.edges[first] for b in boards)
+    return first, last, [b.edges[first] - lead for b in boards]
+
+
+def drift_ppm(board: Board, reference: Board, first: int, last: int) -> float:
+    span = board.edges[last] - board.edges[first]
+    ref_span = reference.edges[last] - reference.edges[first]
+    if ref_span == 0:
+        return 0.0
+    return (span - ref_span) * 1e6 / ref_span
+
+
+def write_trimmed(src: str, dst: str, skip: int, nframes: int):
+    with wave.open(src, "rb") as r:
+        params = r.getparams()
+        r.setpos(skip)
+        frames = r.readframes(nframes)
+    with wave.open(dst, "wb") as w:
+        w.setparams(params)
+        w.writeframes(frames)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("out_dir")
+    parser.add_argument("boards", nargs="+", help="Recording of each board")
+    args = parser.parse_args()
+    try:
+        boards = [Board(path) for path in args.boards]
+        names = [b.name for b in boards]
+        if len(set(names)) != len(names):
+            raise ValueError("Boards need directories with different names")
+        first, last, skips = align(boards)
+        nframes = min(
+            wave.open(path, "rb").getnframes() - skip
+            for board, skip in zip(boards, skips)
+            for path in board.wavs
+        )
+        if nframes <= 0:
+            raise ValueError("The recordings do not overlap")
+        for board, skip in zip(boards, skips):
+            out = os.path.join(args.out_dir, board.name)
+            os.makedirs(out, exist_ok=True)
+            for path in board.wavs:
+                write_trimmed(
+                    path, os.path.join(out, os.path.basename(path)), skip, nframes
+                )
+            print(
+                f"{board.name}: edge {first} at sample {board.edges[first]}, "
+                f"skipped {skip}, drift "
+                f"{drift_ppm(board, boards[0], first, last):+.1f} ppm"
+            )
+    except (OSError, ValueError, EOFError, wave.Error, struct.error) as e:
+        print(e, file=sys.stderr)
+        sys.exit(1)
+    print(f"{len(boards)} boards aligned on edge {first}, {nframes} samples each")
+
+
+if __name__ == "__main__":
+    main()
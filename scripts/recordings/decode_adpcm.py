@@ -0,0 +1,92 @@
+#!/usr/bin/env python3
+"""
+Decode an IMA ADPCM recording (`recording::Encoding::ImaAdpcm`) to WAV.
+
+Recordings use the Microsoft block layout (`WAVE_FORMAT_IMA_ADPCM`): every
+block starts with its first sample and step index, followed by 4-bit codes
+packed low nibble first. The "fact" chunk says how many samples the file
+holds, since the last block may be cut short. Every resolution decodes to
+16-bit PCM, with 8-bit samples scaled up by 256 around their midpoint.
+
+Usage:
+    python decode_adpcm.py recording.wav out.wav
+"""
+
+import struct
+import sys
+import wave
+
+from unpack import read_chunks
+
+WAV_FORMAT_IMA_ADPCM = 0x11
+BLOCK_HEADER = struct.Struct("<hBB")
+MAX_STEP_INDEX = 88
+SIGN_BIT = 0b1000
+
+STEP_TABLE = [
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41,
+    45, 50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190,
+    209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+    876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499,
+    2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845,
+    8630, 9493, 10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350,
+    22385, 24623, 27086, 29794, 32767,
+]
+INDEX_TABLE = [-1, -1, -1, -1, 2, 4, 6, 8]
+
+
+def decode_block(block: bytes) -> list[int]:
+    predictor, index, _ = BLOCK_HEADER.unpack_from(block, 0)
+    samples = [predictor]
+    for byte in block[BLOCK_HEADER.size :]:
+        for code in (byte & 0xF, byte >> 4):
+            step = STEP_TABLE[index]
+            delta = step >> 3
+            if code & 0b100:
+                delta += step
+            if code & 0b010:
+                delta += step >> 1
+            if code & 0b001:
+                delta += step >> 2
+            predictor += -delta if code & SIGN_BIT else delta
+            predictor = max(-0x8000, min(0x7FFF, predictor))
+            index = max(0, min(MAX_STEP_INDEX, index + INDEX_TABLE[code & 0b111]))
+            samples.append(predictor)
+    return samples
+
+
+def decode(src: str, dst: str):
+    with open(src, "rb") as f:
+        chunks = read_chunks(f.read())
+    fmt = chunks.get(b"fmt ")
+    data = chunks.get(b"data")
+    fact = chunks.get(b"fact")
+    if fmt is None or data is None or fact is None:
+        raise ValueError("Missing fmt, fact or data chunk")
+    audio_format, nchannels, sample_rate, _, block_align, _ = struct.unpack_from(
+        "<HHIIHH", fmt, 0
+    )
+    if audio_format != WAV_FORMAT_IMA_ADPCM or nchannels != 1:
+        raise ValueError("Not a mono IMA ADPCM WAV file")
+    (length,) = struct.unpack_from("<I", fact, 0)
+
+    samples = []
+    for offset in range(0, len(data), block_align):
+        block = data[offset : offset + block_align]
+        if len(block) < BLOCK_HEADER.size or len(samples) >= length:
+            break
+        samples.extend(decode_block(block))
+    samples = samples[:length]
+
+    with wave.open(dst, "wb") as out:
+        out.setnchannels(1)
+        out.setsampwidth(2)
+        out.setframerate(sample_rate)
+        out.writeframes(struct.pack(f"<{len(samples)}h", *samples))
+
+
+if __name__ == "__main__":
+    if len(sys.argv) != 3:
+        print(__doc__)
+        sys.exit(1)
+    decode(sys.argv[1], sys.argv[2])
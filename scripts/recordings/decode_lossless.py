@@ -0,0 +1,138 @@
+#!/usr/bin/env python3
+"""
+Decode a lossless recording (`recording::Encoding::Lossless`) to WAV.
+
+8-bit recordings become 8-bit PCM and 10 to 12-bit recordings become 16-bit PCM,
+identical to what a PCM recording at the same resolution would contain.
+Prints how many blocks were stored raw (which the recorder falls back to when
+a block does not shrink or there is no time to encode it) and how many were
+Rice coded.
+
+Usage:
+    python decode_lossless.py recording.bin out.wav
+"""
+
+import struct
+import sys
+import wave
+
+MAGIC = b"CHRL"
+FILE_HEADER = struct.Struct("<4sBBHII")
+BLOCK_HEADER = struct.Struct("<BBHH")
+METHOD_RAW = 0
+METHOD_RICE = 1
+PARTITION_SAMPLES = 64
+ESCAPE_QUOTIENT = 24
+ESCAPE_BITS = 16
+PARAM_BITS = 4
+EIGHT_BIT_BIAS = 0x80
+
+
+class BitReader:
+    def __init__(self, data: bytes):
+        self.data = data
+        self.pos = 0
+
+    def bit(self) -> int:
+        byte = self.data[self.pos >> 3]
+        value = (byte >> (7 - (self.pos & 7))) & 1
+        self.pos += 1
+        return value
+
+    def bits(self, n: int) -> int:
+        value = 0
+        for _ in range(n):
+            value = (value << 1) | self.bit()
+        return value
+
+
+def signed16(value: int) -> int:
+    return value - 0x10000 if value & 0x8000 else value
+
+
+def unzigzag(value: int) -> int:
+    return (value >> 1) ^ -(value & 1)
+
+
+def decode_rice(payload: bytes, order: int, nsamples: int) -> list[int]:
+    reader = BitReader(payload)
+    samples = [signed16(reader.bits(ESCAPE_BITS)) for _ in range(order)]
+    for start in range(0, nsamples, PARTITION_SAMPLES):
+        first = max(start, order)
+        last = min(start + PARTITION_SAMPLES, nsamples)
+        if first >= last:
+            continue
+        k = reader.bits(PARAM_BITS)
+        for _ in range(first, last):
+            quotient = 0
+            while quotient < ESCAPE_QUOTIENT and reader.bit() == 0:
+                quotient += 1
+            if quotient == ESCAPE_QUOTIENT:
+                value = reader.bits(ESCAPE_BITS)
+            else:
+                value = (quotient << k) | reader.bits(k)
+            residual = unzigzag(value)
+            if order == 0:
+                prediction = 0
+            elif order == 1:
+                prediction = samples[-1]
+            else:
+                prediction = 2 * samples[-1] - samples[-2]
+            samples.append(signed16((prediction + residual) & 0xFFFF))
+    return samples
+
+
+def decode_raw(payload: bytes, bits: int) -> list[int]:
+    if bits == 8:
+        return [b - EIGHT_BIT_BIAS for b in payload]
+    count = len(payload) // 2
+    shift = 16 - bits
+    return [s >> shift for s in struct.unpack(f"<{count}h", payload)]
+
+
+def decode(src: str, dst: str):
+    with open(src, "rb") as f:
+        data = f.read()
+    magic, version, bits, nchannels, sample_rate, length = FILE_HEADER.unpack_from(
+        data, 0
+    )
+    if magic != MAGIC or version != 1:
+        raise ValueError("Not a lossless recording")
+    if bits not in (8, 10, 11, 12) or nchannels != 1:
+        raise ValueError("Unsupported recording")
+
+    samples = []
+    counts = {METHOD_RAW: 0, METHOD_RICE: 0}
+    offset = FILE_HEADER.size
+    while offset + BLOCK_HEADER.size <= len(data) and len(samples) < length:
+        method, order, nsamples, size = BLOCK_HEADER.unpack_from(data, offset)
+        offset += BLOCK_HEADER.size
+        payload = data[offset : offset + size]
+        offset += size
+        if method == METHOD_RAW:
+            samples.extend(decode_raw(payload, bits))
+        elif method == METHOD_RICE:
+            samples.extend(decode_rice(payload, order, nsamples))
+        else:
+            raise ValueError(f"Unknown block method {method}")
+        counts[method] += 1
+    samples = samples[:length]
+    print(f"raw_blocks={counts[METHOD_RAW]} rice_blocks={counts[METHOD_RICE]}")
+
+    with wave.open(dst, "wb") as out:
+        out.setnchannels(1)
+        out.setframerate(sample_rate)
+        if bits == 8:
+            out.setsampwidth(1)
+            out.writeframes(bytes(s + EIGHT_BIT_BIAS for s in samples))
+        else:
+            out.setsampwidth(2)
+            shifted = [s << (16 - bits) for s in samples]
+            out.writeframes(struct.pack(f"<{len(shifted)}h", *shifted))
+
+
+if __name__ == "__main__":
+    if len(sys.argv) != 3:
+        print(__doc__)
+        sys.exit(1)
+    decode(sys.argv[1], sys.argv[2])
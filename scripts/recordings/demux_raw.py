@@ -0,0 +1,251 @@
+#!/usr/bin/env python3
+"""
+Rebuild WAV files from a raw sector recording (`recording::record_raw`).
+
+Reads an image of the card (or the card's block device), checks the session
+header, follows the blocks in order until the trailer and reports any blocks
+which were lost along with the gaps the ADC logged. Each channel is rebuilt
+in parallel, with silence inserted wherever samples were lost so the output
+stays aligned in time, and written to its own WAV file (or all of them to one
+interleaved WAV file with `--interleave`).
+
+8-bit recordings become 8-bit PCM and every other resolution 16-bit PCM.
+
+Usage:
+    python demux_raw.py card.img out_dir [--sector N] [--interleave]
+"""
+
+import argparse
+import array
+import mmap
+import os
+import struct
+import sys
+import wave
+from concurrent.futures import ProcessPoolExecutor
+
+from unpack import unpack
+
+SECTOR_SZ = 512
+VERSION = 1
+SESSION_MAGIC = b"CHRH"
+BLOCK_MAGIC = b"CHRB"
+TRAILER_MAGIC = b"CHRT"
+SESSION_HEADER = struct.Struct("<4sBBBBII")
+BLOCK_HEADER = struct.Struct("<4sIIIIHBB")
+TRAILER = struct.Struct("<4sIQIIIIIHBB")
+GAP = struct.Struct("<II")
+MAX_GAP_COUNT = 16
+RESOLUTION_EIGHT = 8
+RESOLUTION_TEN_PACKED = 0x8A
+EIGHT_BIT_SILENCE = 0x80
+
+
+class Session:
+    def __init__(self, image: mmap.mmap, first_sector: int):
+        offset = first_sector * SECTOR_SZ
+        magic, version, nchannels, resolution, _, session, rate = (
+            SESSION_HEADER.unpack_from(image, offset)
+        )
+        if magic != SESSION_MAGIC:
+            raise ValueError(f"No session header at sector {first_sector}")
+        if version != VERSION:
+            raise ValueError(f"Unsupported version {version}")
+        self.image = image
+        self.nchannels = nchannels
+        self.resolution = resolution
+        self.session = session
+        self.sample_rate = rate
+        # (sample_index, offset, size) of every block, per channel
+        self.blocks = [[] for _ in range(nchannels)]
+        self.lost_blocks = 0
+        self.trailer = None
+        self.scan(offset + SECTOR_SZ)
+
+    def scan(self, offset: int):
+        expected = 0
+        while offset + SECTOR_SZ <= len(self.image):
+            magic, session = struct.unpack_from("<4sI", self.image, offset)
+            if session != self.session:
+                break
+            if magic == TRAILER_MAGIC:
+                self.read_trailer(offset)
+                break
+            if magic != BLOCK_MAGIC:
+                break
+            _, _, seq, _, sample_index, size, ch_index, _ = (
+                BLOCK_HEADER.unpack_from(self.image, offset)
+            )
+            if seq != expected:
+                self.lost_blocks += seq - expected
+            expected = seq + 1
+            if ch_index < self.nchannels:
+                self.blocks[ch_index].append(
+                    (sample_index, offset + BLOCK_HEADER.size, size)
+                )
+            offset += SECTOR_SZ
+
+    def read_trailer(self, offset: int):
+        fields = TRAILER.unpack_from(self.image, offset)
+        _, _, start_ticks, nblocks, rate_mhz, ticks_per_sec = fields[:6]
+        collected, dropped, overruns, ngaps = fields[6:10]
+        gaps = [
+            GAP.unpack_from(self.image, offset + TRAILER.size + i * GAP.size)
+            for i in range(min(ngaps, MAX_GAP_COUNT))
+        ]
+        self.trailer = {
+            "start_ticks": start_ticks,
+            "ticks_per_sec": ticks_per_sec,
+            "nblocks": nblocks,
+            "rate_mhz": rate_mhz,
+            "collected": collected,
+            "dropped": dropped,
+            "overruns": overruns,
+            "gaps": gaps,
+        }
+
+    @property
+    def sample_width(self) -> int:
+        return 1 if self.resolution == RESOLUTION_EIGHT else 2
+
+    @property
+    def rate(self) -> int:
+        if self.trailer is not None and self.trailer["rate_mhz"] != 0:
+            return round(self.trailer["rate_mhz"] / 1000)
+        return self.sample_rate
+
+    def silence(self, nsamples: int) -> bytes:
+        if self.sample_width == 1:
+            return bytes([EIGHT_BIT_SILENCE]) * nsamples
+        return bytes(2 * nsamples)
+
+    def decode(self, payload: bytes) -> bytes:
+        if self.resolution == RESOLUTION_TEN_PACKED:
+            return unpack(payload)
+        return payload
+
+    def channel(self, ch_index: int) -> bytes:
+        """
+        @returns: PCM samples of one channel, with silence in place of lost
+        blocks and samples the ADC dropped.
+        """
+        width = self.sample_width
+        stored = bytearray()
+        for sample_index, offset, size in sorted(self.blocks[ch_index]):
+            missing = sample_index - len(stored) // width
+            if missing > 0:
+                stored += self.silence(missing)
+            stored += self.decode(self.image[offset : offset + size])
+
+        # A gap starts `index / nchannels` samples into the channel counting
+        # the ones which were dropped, see `adc::Gap`
+        gaps = self.trailer["gaps"] if self.trailer is not None else []
+        out = bytearray()
+        consumed = 0
+        for index, length in gaps:
+            take = max(0, index // self.nchannels - len(out) // width)
+            out += stored[consumed * width : (consumed + take) * width]
+            consumed += take
+            out += self.silence(length // self.nchannels)
+        out += stored[consumed * width :]
+        return bytes(out)
+
+
+def interleave(channels: list[bytes], width: int) -> bytes:
+    nsamples = min(len(c) for c in channels) // width
+    code = "B" if width == 1 else "h"
+    out = array.array(code, bytes(nsamples * width * len(channels)))
+    for i, samples in enumerate(channels):
+        out[i :: len(channels)] = array.array(code, samples[: nsamples * width])
+    return out.tobytes()
+
+
+def write_wav(path: str, data: bytes, nchannels: int, width: int, rate: int):
+    with wave.open(path, "wb") as w:
+        w.setnchannels(nchannels)
+        w.setsampwidth(width)
+        w.setframerate(rate)
+        w.writeframes(data)
+
+
+def report(session: Session):
+    nblocks = sum(len(b) for b in session.blocks)
+    print(
+        f"session={session.session:08x} channels={session.nchannels} "
+        f"resolution={session.resolution:#x} rate={session.rate} blocks={nblocks}"
+    )
+    if session.lost_blocks:
+        print(f"lost_blocks={session.lost_blocks}")
+    t = session.trailer
+    if t is None:
+        print("No trailer, the recording was cut short", file=sys.stderr)
+        return
+    if t["nblocks"] != nblocks + session.lost_blocks:
+        print(f"Trailer counts {t['nblocks']} blocks", file=sys.stderr)
+    print(
+        f"collected={t['collected']} dropped={t['dropped']} "
+        f"overruns={t['overruns']} gaps={len(t['gaps'])}"
+    )
+    for index, length in t["gaps"]:
+        print(f"  gap at sample {index}: {length} dropped")
+
+
+# Session each worker process rebuilds channels from
+SESSION = None
+
+
+def open_session(src: str, first_sector: int) -> Session:
+    global SESSION
+    with open(src, "rb") as f:
+        image = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+    SESSION = Session(image, first_sector)
+    return SESSION
+
+
+def rebuild(ch_index: int) -> bytes:
+    return SESSION.channel(ch_index)
+
+
+def demux(src: str, dst: str, first_sector: int, interleaved: bool):
+    session = open_session(src, first_sector)
+    report(session)
+
+    width = session.sample_width
+    with ProcessPoolExecutor(
+        initializer=open_session, initargs=(src, first_sector)
+    ) as pool:
+        channels = list(pool.map(rebuild, range(session.nchannels)))
+    os.makedirs(dst, exist_ok=True)
+    if interleaved:
+        path = os.path.join(dst, "adc_rec.wav")
+        write_wav(
+            path, interleave(channels, width), session.nchannels, width, session.rate
+        )
+        print(path)
+        return
+    for ch_index, samples in enumerate(channels):
+        path = os.path.join(dst, f"adc_rec_{ch_index}.wav")
+        write_wav(path, samples, 1, width, session.rate)
+        print(path)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("image", help="Card image or block device")
+    parser.add_argument("out_dir")
+    parser.add_argument(
+        "--sector", type=int, default=0, help="First sector of the recording"
+    )
+    parser.add_argument(
+        "--interleave", action="store_true", help="Write one multi-channel file"
+    )
+    args = parser.parse_args()
+    try:
+        demux(args.image, args.out_dir, args.sector, args.interleave)
+    except (OSError, ValueError, struct.error) as e:
+        print(e, file=sys.stderr)
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
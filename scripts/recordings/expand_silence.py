@@ -0,0 +1,87 @@
+#!/usr/bin/env python3
+"""
+Restore the silence an energy-gated recording left out (`Options::gate_threshold`).
+
+Gated recordings only store the buffers which were loud enough, and list the
+runs of samples which were left out in a sidecar file next to the recording
+(`channel_0.wav` and `channel_0.sil`). This inserts silence for every run so
+the samples line up in time again and writes the result to a new WAV file.
+
+Usage:
+    python expand_silence.py in.wav out.wav [--sidecar in.sil]
+"""
+
+import argparse
+import os
+import struct
+import sys
+import wave
+
+VERSION = 1
+SIDECAR_MAGIC = b"CHRS"
+SIDECAR_HEADER = struct.Struct("<4sB3x")
+RUN = struct.Struct("<II")
+EIGHT_BIT_SILENCE = 0x80
+
+
+def read_runs(path: str) -> list[tuple[int, int]]:
+    """
+    @returns: (start, length) of every silent run, in samples counted from
+    the start of the full recording.
+    """
+    with open(path, "rb") as f:
+        data = f.read()
+    magic, version = SIDECAR_HEADER.unpack_from(data, 0)
+    if magic != SIDECAR_MAGIC:
+        raise ValueError(f"{path} is not a silence sidecar")
+    if version != VERSION:
+        raise ValueError(f"Unsupported version {version}")
+    nruns = (len(data) - SIDECAR_HEADER.size) // RUN.size
+    return [
+        RUN.unpack_from(data, SIDECAR_HEADER.size + i * RUN.size)
+        for i in range(nruns)
+    ]
+
+
+def expand(samples: bytes, width: int, runs: list[tuple[int, int]]) -> bytes:
+    fill = bytes([EIGHT_BIT_SILENCE]) if width == 1 else bytes(width)
+    out = bytearray()
+    consumed = 0
+    for start, length in sorted(runs):
+        take = max(0, start - len(out) // width)
+        out += samples[consumed * width : (consumed + take) * width]
+        consumed += take
+        out += fill * length
+    out += samples[consumed * width :]
+    return bytes(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("src", help="Gated recording")
+    parser.add_argument("dst", help="Where to write the expanded recording")
+    parser.add_argument(
+        "--sidecar", help="Silent runs (default: src with a .sil extension)"
+    )
+    args = parser.parse_args()
+    sidecar = args.sidecar or os.path.splitext(args.src)[0] + ".sil"
+    try:
+        runs = read_runs(sidecar)
+        with wave.open(args.src, "rb") as r:
+            params = r.getparams()
+            samples = r.readframes(params.nframes)
+        if params.nchannels != 1:
+            raise ValueError("Gated recordings have one channel per file")
+        expanded = expand(samples, params.sampwidth, runs)
+        with wave.open(args.dst, "wb") as w:
+            w.setparams(params)
+            w.writeframes(expanded)
+    except (OSError, ValueError, EOFError, wave.Error, struct.error) as e:
+        print(e, file=sys.stderr)
+        sys.exit(1)
+    nsilent = sum(length for _, length in runs)
+    print(f"{args.dst}: {len(runs)} runs, {nsilent} silent samples restored")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,345 @@
+#!/usr/bin/env python3
+"""
+Receive a recording streamed over a serial link (`recording::FrameSink`).
+
+Reads frames from a serial port (or a file holding a captured stream) until
+the recording's trailer, checks every frame's CRC and rebuilds each channel
+into its own WAV file, with silence inserted wherever frames were lost or the
+ADC dropped samples so the output stays aligned in time. Reports frames which
+were corrupted or lost along with the gaps the ADC logged.
+
+With `--pty`, a pseudo-terminal is opened instead and `source` made a link
+to its other end, so a program on the same machine (e.g. the host benchmark)
+can stand in for the board.
+
+8-bit recordings become 8-bit PCM and every other resolution 16-bit PCM.
+
+Usage:
+    python receive_stream.py /dev/ttyACM0 out_dir [--baud 2000000]
+    python receive_stream.py --pty /tmp/board out_dir [--timeout 10]
+"""
+
+import argparse
+import binascii
+import os
+import select
+import struct
+import sys
+import termios
+import tty
+import wave
+
+from unpack import unpack
+
+VERSION = 1
+SESSION = ord("S")
+BLOCK = ord("B")
+END = ord("E")
+SESSION_HEADER = struct.Struct("<BBBBII")
+BLOCK_HEADER = struct.Struct("<BBHII")
+TRAILER = struct.Struct("<BBHIIIII")
+GAP = struct.Struct("<II")
+CRC_INIT = 0xFFFF
+CRC = struct.Struct("<H")
+RESOLUTION_EIGHT = 8
+RESOLUTION_TEN_PACKED = 0x8A
+EIGHT_BIT_SILENCE = 0x80
+READ_SZ = 1 << 16
+
+
+def cobs_decode(data: bytes) -> bytes:
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        if code == 0 or i + code > len(data):
+            raise ValueError("Malformed COBS frame")
+        out += data[i + 1 : i + code]
+        i += code
+        if code < 0xFF and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+class Recording:
+    def __init__(self, frame: bytes):
+        _, version, nchannels, resolution, session, rate = (
+            SESSION_HEADER.unpack_from(frame)
+        )
+        if version != VERSION:
+            raise ValueError(f"Unsupported version {version}")
+        self.nchannels = nchannels
+        self.resolution = resolution
+        self.session = session
+        self.sample_rate = rate
+        # (sample_index, payload) of every block, per channel
+        self.blocks = [[] for _ in range(nchannels)]
+        self.expected_seq = 0
+        self.lost_frames = 0
+        self.trailer = None
+
+    def block(self, frame: bytes):
+        _, ch_index, _, seq, sample_index = BLOCK_HEADER.unpack_from(frame)
+        if seq > self.expected_seq:
+            self.lost_frames += seq - self.expected_seq
+        self.expected_seq = max(self.expected_seq, seq + 1)
+        if ch_index < self.nchannels:
+            self.blocks[ch_index].append(
+                (sample_index, frame[BLOCK_HEADER.size :])
+            )
+
+    def end(self, frame: bytes):
+        fields = TRAILER.unpack_from(frame)
+        _, ngaps, overruns, session, nblocks, rate, collected, dropped = fields
+        if session != self.session:
+            raise ValueError("Trailer is from another recording")
+        gaps = [
+            GAP.unpack_from(frame, TRAILER.size + i * GAP.size)
+            for i in range(ngaps)
+        ]
+        # Frames lost after the last one which came through
+        self.lost_frames += max(0, nblocks - self.expected_seq)
+        self.trailer = {
+            "nblocks": nblocks,
+            "rate": rate,
+            "collected": collected,
+            "dropped": dropped,
+            "overruns": overruns,
+            "gaps": gaps,
+        }
+
+    @property
+    def sample_width(self) -> int:
+        return 1 if self.resolution == RESOLUTION_EIGHT else 2
+
+    @property
+    def rate(self) -> int:
+        if self.trailer is not None and self.trailer["rate"] != 0:
+            return self.trailer["rate"]
+        return self.sample_rate
+
+    def silence(self, nsamples: int) -> bytes:
+        if self.sample_width == 1:
+            return bytes([EIGHT_BIT_SILENCE]) * nsamples
+        return bytes(2 * nsamples)
+
+    def decode(self, payload: bytes) -> bytes:
+        if self.resolution == RESOLUTION_TEN_PACKED:
+            return unpack(payload)
+        return payload
+
+    def channel(self, ch_index: int) -> bytes:
+        """
+        @returns: PCM samples of one channel, with silence in place of lost
+        frames and samples the ADC dropped.
+        """
+        width = self.sample_width
+        stored = bytearray()
+        for sample_index, payload in sorted(self.blocks[ch_index]):
+            missing = sample_index - len(stored) // width
+            if missing > 0:
+                stored += self.silence(missing)
+            stored += self.decode(payload)
+
+        # A gap starts `index / nchannels` samples into the channel counting
+        # the ones which were dropped, see `adc::Gap`
+        gaps = self.trailer["gaps"] if self.trailer is not None else []
+        out = bytearray()
+        consumed = 0
+        for index, length in gaps:
+            take = max(0, index // self.nchannels - len(out) // width)
+            out += stored[consumed * width : (consumed + take) * width]
+            consumed += take
+            out += self.silence(length // self.nchannels)
+        out += stored[consumed * width :]
+        return bytes(out)
+
+
+class Receiver:
+    def __init__(self):
+        self.pending = bytearray()
+        self.recording = None
+        self.nframes = 0
+        self.crc_errors = 0
+        self.malformed = 0
+        self.skipped = 0
+        # Whether the next recording started before this one's trailer came
+        self.cut_short = False
+
+    def feed(self, data: bytes):
+        """
+        Split received bytes into frames and handle every complete one.
+        """
+        self.pending += data
+        *frames, self.pending = self.pending.split(b"\0")
+        for encoded in frames:
+            if self.done:
+                break
+            if encoded:
+                self.frame(encoded)
+
+    def frame(self, encoded: bytes):
+        try:
+            frame = cobs_decode(encoded)
+        except ValueError:
+            self.malformed += 1
+            return
+        if len(frame) < 1 + CRC.size:
+            self.malformed += 1
+            return
+        (crc,) = CRC.unpack_from(frame, len(frame) - CRC.size)
+        frame = frame[: -CRC.size]
+        if binascii.crc_hqx(frame, CRC_INIT) != crc:
+            self.crc_errors += 1
+            return
+        self.nframes += 1
+        kind = frame[0]
+        try:
+            if kind == SESSION:
+                if self.recording is not None:
+                    self.cut_short = True
+                    return
+                self.recording = Recording(frame)
+            elif self.recording is None:
+                # Joined the stream partway through a recording
+                self.skipped += 1
+            elif kind == BLOCK:
+                self.recording.block(frame)
+            elif kind == END:
+                self.recording.end(frame)
+            else:
+                self.malformed += 1
+        except struct.error:
+            self.malformed += 1
+
+    @property
+    def done(self) -> bool:
+        rec = self.recording
+        return rec is not None and (rec.trailer is not None or self.cut_short)
+
+
+def open_port(path: str, baud: int) -> int:
+    fd = os.open(path, os.O_RDONLY | os.O_NOCTTY)
+    if os.isatty(fd):
+        speed = getattr(termios, f"B{baud}", None)
+        if speed is None:
+            os.close(fd)
+            raise ValueError(f"Unsupported baud rate {baud}")
+        tty.setraw(fd)
+        attrs = termios.tcgetattr(fd)
+        attrs[4] = attrs[5] = speed
+        termios.tcsetattr(fd, termios.TCSANOW, attrs)
+        termios.tcflush(fd, termios.TCIFLUSH)
+    return fd
+
+
+def open_pty(link: str) -> tuple[int, int]:
+    """
+    @returns: Both ends of a new pseudo-terminal, with `link` pointing at the
+    one a stand-in for the board writes to. Keeping that end open here as well
+    keeps reads from failing before the stand-in opens it.
+    """
+    master, slave = os.openpty()
+    tty.setraw(slave)
+    if os.path.islink(link):
+        os.remove(link)
+    os.symlink(os.ttyname(slave), link)
+    return master, slave
+
+
+def receive(fd: int, receiver: Receiver, timeout: float | None):
+    while not receiver.done:
+        ready, _, _ = select.select([fd], [], [], timeout)
+        if not ready:
+            print(f"Nothing received for {timeout} s", file=sys.stderr)
+            return
+        try:
+            data = os.read(fd, READ_SZ)
+        except OSError:
+            # The other end of a pseudo-terminal was closed
+            return
+        if not data:
+            return
+        receiver.feed(data)
+
+
+def write_wav(path: str, data: bytes, width: int, rate: int):
+    with wave.open(path, "wb") as w:
+        w.setnchannels(1)
+        w.setsampwidth(width)
+        w.setframerate(rate)
+        w.writeframes(data)
+
+
+def report(receiver: Receiver):
+    rec = receiver.recording
+    nblocks = sum(len(b) for b in rec.blocks)
+    print(
+        f"session={rec.session:08x} channels={rec.nchannels} "
+        f"resolution={rec.resolution:#x} rate={rec.rate} blocks={nblocks}"
+    )
+    print(
+        f"frames={receiver.nframes} lost_frames={rec.lost_frames} "
+        f"crc_errors={receiver.crc_errors} malformed={receiver.malformed} "
+        f"skipped={receiver.skipped}"
+    )
+    t = rec.trailer
+    if t is None:
+        print("No trailer, the recording was cut short", file=sys.stderr)
+        return
+    print(
+        f"collected={t['collected']} dropped={t['dropped']} "
+        f"overruns={t['overruns']} gaps={len(t['gaps'])}"
+    )
+    for index, length in t["gaps"]:
+        print(f"  gap at sample {index}: {length} dropped")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument(
+        "source", help="Serial port or captured stream (link to make with --pty)"
+    )
+    parser.add_argument("out_dir")
+    parser.add_argument(
+        "--baud", type=int, default=2000000, help="Baud rate of a serial port"
+    )
+    parser.add_argument(
+        "--pty", action="store_true", help="Receive from a new pseudo-terminal"
+    )
+    parser.add_argument(
+        "--timeout", type=float, help="Give up after this many silent seconds"
+    )
+    args = parser.parse_args()
+    receiver = Receiver()
+    try:
+        if args.pty:
+            fd, slave = open_pty(args.source)
+            try:
+                receive(fd, receiver, args.timeout)
+            finally:
+                os.remove(args.source)
+                os.close(slave)
+                os.close(fd)
+        else:
+            fd = open_port(args.source, args.baud)
+            try:
+                receive(fd, receiver, args.timeout)
+            finally:
+                os.close(fd)
+        if receiver.recording is None:
+            raise ValueError("No recording was received")
+        report(receiver)
+        rec = receiver.recording
+        os.makedirs(args.out_dir, exist_ok=True)
+        for ch_index in range(rec.nchannels):
+            path = os.path.join(args.out_dir, f"channel_{ch_index + 1}.wav")
+            write_wav(path, rec.channel(ch_index), rec.sample_width, rec.rate)
+            print(path)
+    except (OSError, ValueError, termios.error) as e:
+        print(e, file=sys.stderr)
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
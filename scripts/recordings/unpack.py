@@ -0,0 +1,78 @@
+#!/usr/bin/env python3
+"""
+Convert a packed 10-bit WAV file (`BitResolution::TenPacked`) to 16-bit PCM.
+
+Packed files use audio format 0xFFFF with 10 bits per sample, and store every
+4 samples in 5 bytes as a little-endian bitstream. Each 10-bit sample is a
+signed value which becomes the same 16-bit sample `BitResolution::Ten` would
+have recorded once shifted left by 6 bits.
+
+Usage:
+    python unpack.py packed.wav out.wav
+"""
+
+import struct
+import sys
+import wave
+
+WAV_FORMAT_PACKED_TEN = 0xFFFF
+GROUP_SAMPLES = 4
+GROUP_SZ = 5
+SAMPLE_MASK = 0x3FF
+SIGN_BIT = 0x200
+
+
+def read_chunks(data: bytes) -> dict[bytes, bytes]:
+    riff, _, wave_id = struct.unpack_from("<4sI4s", data, 0)
+    if riff != b"RIFF" or wave_id != b"WAVE":
+        raise ValueError("Not a WAV file")
+    chunks = {}
+    offset = 12
+    while offset + 8 <= len(data):
+        chunk_id, size = struct.unpack_from("<4sI", data, offset)
+        offset += 8
+        chunks[chunk_id] = data[offset : offset + size]
+        # Chunks are padded to an even size
+        offset += size + (size & 1)
+    return chunks
+
+
+def unpack(packed: bytes) -> bytes:
+    ngroups = len(packed) // GROUP_SZ
+    out = bytearray(ngroups * GROUP_SAMPLES * 2)
+    for i in range(ngroups):
+        bits = int.from_bytes(packed[i * GROUP_SZ : (i + 1) * GROUP_SZ], "little")
+        for j in range(GROUP_SAMPLES):
+            sample = (bits >> (10 * j)) & SAMPLE_MASK
+            if sample & SIGN_BIT:
+                sample -= 2 * SIGN_BIT
+            struct.pack_into("<h", out, 2 * (i * GROUP_SAMPLES + j), sample << 6)
+    return bytes(out)
+
+
+def convert(src: str, dst: str):
+    with open(src, "rb") as f:
+        chunks = read_chunks(f.read())
+    fmt = chunks.get(b"fmt ")
+    data = chunks.get(b"data")
+    if fmt is None or data is None:
+        raise ValueError("Missing fmt or data chunk")
+    audio_format, nchannels, sample_rate, _, _, bits = struct.unpack_from(
+        "<HHIIHH", fmt, 0
+    )
+    if audio_format != WAV_FORMAT_PACKED_TEN or bits != 10:
+        raise ValueError("Not a packed 10-bit WAV file")
+    if nchannels != 1:
+        raise ValueError("Only mono packed files are supported")
+    with wave.open(dst, "wb") as out:
+        out.setnchannels(nchannels)
+        out.setsampwidth(2)
+        out.setframerate(sample_rate)
+        out.writeframes(unpack(data))
+
+
+if __name__ == "__main__":
+    if len(sys.argv) != 3:
+        print(__doc__)
+        sys.exit(1)
+    convert(sys.argv[1], sys.argv[2])
@@ -0,0 +1,180 @@
+#!/usr/bin/env python3
+"""
+Find the highest sample rate each configuration sustains without dropping
+samples, by running the benchmark firmware under simavr.
+
+Sweeps channels x resolution x `ch_window_sz` x buffer size, bisecting the
+per-channel sample rate of each combination, and prints a Markdown table
+with the highest rate which had no dropped samples or overruns along with
+the ISR cycle counts measured at that rate.
+
+Usage:
+    python bench.py --channels 1,2,4 --bits 8,10 --windows 1,4 --bufs 2048,4096
+"""
+
+import argparse
+import os
+import subprocess
+import sys
+from concurrent.futures import ThreadPoolExecutor
+from dataclasses import dataclass
+from itertools import product
+
+F_CPU = 16_000_000
+# ADC conversions take 13 ADC clocks, and the fastest ADC clock is F_CPU / 2
+MAX_CONVERSION_RATE = F_CPU // (2 * 13)
+RESOLUTIONS = {
+    "8": 8,
+    "10": 10,
+    "10p": 0x8A,
+    "11": 11,
+    "12": 12,
+}
+OVERSAMPLE = {"11": 4, "12": 16}
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+DEFAULT_HARNESS = os.path.join(HERE, "build", "harness")
+DEFAULT_FIRMWARE = os.path.join(
+    HERE, "firmware", ".pio", "build", "megaatmega2560", "firmware.elf"
+)
+
+
+@dataclass(frozen=True)
+class Point:
+    channels: int
+    bits: str
+    window: int
+    buf: int
+
+
+def csv(cast):
+    return lambda s: [cast(v) for v in s.split(",")]
+
+
+def run(args, point: Point, rate: int) -> dict[str, int] | None:
+    config = " ".join(
+        str(v)
+        for v in (
+            point.channels,
+            RESOLUTIONS[point.bits],
+            point.window,
+            args.slots,
+            point.buf,
+            rate,
+            args.ms,
+            int(args.pipelined),
+        )
+    )
+    cmd = [
+        args.harness,
+        "--block-us",
+        str(args.block_us),
+        "--stall-us",
+        str(args.stall_us),
+        "--stall-every",
+        str(args.stall_every),
+        args.firmware,
+        config,
+    ]
+    proc = subprocess.run(cmd, capture_output=True, text=True)
+    if proc.returncode != 0:
+        print(f"{cmd}: {proc.stderr.strip()}", file=sys.stderr)
+        return None
+    results = {}
+    for line in proc.stdout.splitlines():
+        key, sep, value = line.partition("=")
+        if not sep:
+            continue
+        if key == "error":
+            print(f"{point} at {rate} Hz: {value}", file=sys.stderr)
+            return None
+        results[key] = int(value)
+    return results
+
+
+def sustained(results: dict[str, int] | None) -> bool:
+    return (
+        results is not None
+        and results.get("collected", 0) > 0
+        and results.get("dropped", 1) == 0
+        and results.get("overruns", 1) == 0
+    )
+
+
+def bisect(args, point: Point) -> tuple[int, dict[str, int] | None]:
+    """
+    @returns: Highest sustained rate (0 if even the lowest rate drops
+    samples) and the results of running at it.
+    """
+    lo = args.min_rate
+    hi = min(
+        args.max_rate,
+        MAX_CONVERSION_RATE // (point.channels * OVERSAMPLE.get(point.bits, 1)),
+    )
+    best = run(args, point, lo)
+    if not sustained(best):
+        return 0, best
+    results = run(args, point, hi)
+    if sustained(results):
+        return hi, results
+    while hi - lo > args.step:
+        mid = (lo + hi) // 2
+        results = run(args, point, mid)
+        if sustained(results):
+            lo, best = mid, results
+        else:
+            hi = mid
+    return lo, best
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("--harness", default=DEFAULT_HARNESS)
+    parser.add_argument("--firmware", default=DEFAULT_FIRMWARE)
+    parser.add_argument("--channels", type=csv(int), default=[1, 2, 4])
+    parser.add_argument("--bits", type=csv(str), default=["8", "10"])
+    parser.add_argument("--windows", type=csv(int), default=[1, 4])
+    parser.add_argument("--bufs", type=csv(int), default=[2048, 4096])
+    parser.add_argument("--slots", type=int, default=2)
+    parser.add_argument("--pipelined", action="store_true")
+    parser.add_argument("--ms", type=int, default=500, help="Simulated run time")
+    parser.add_argument("--min-rate", type=int, default=1000)
+    parser.add_argument("--max-rate", type=int, default=MAX_CONVERSION_RATE)
+    parser.add_argument("--step", type=int, default=250)
+    parser.add_argument("--block-us", type=int, default=250)
+    parser.add_argument("--stall-us", type=int, default=0)
+    parser.add_argument("--stall-every", type=int, default=0)
+    parser.add_argument("--jobs", type=int, default=os.cpu_count())
+    args = parser.parse_args()
+    for bits in args.bits:
+        if bits not in RESOLUTIONS:
+            parser.error(f"Unknown resolution {bits} (one of {list(RESOLUTIONS)})")
+
+    points = [
+        Point(*p)
+        for p in product(args.channels, args.bits, args.windows, args.bufs)
+        # Pipelining needs at least 2 samples per channel window
+        if not (args.pipelined and p[0] > 1 and p[2] < 2)
+    ]
+    with ThreadPoolExecutor(max_workers=args.jobs) as pool:
+        outcomes = list(pool.map(lambda p: bisect(args, p), points))
+
+    print(
+        "| Channels | Bits | Window | Buffer | Max Rate (Hz) | ISR Cycles (min-max) "
+        "| Jitter Max | Latency Max | High Water |"
+    )
+    print("|---|---|---|---|---|---|---|---|---|")
+    for point, (rate, results) in zip(points, outcomes):
+        r = results or {}
+        print(
+            f"| {point.channels} | {point.bits} | {point.window} | {point.buf} "
+            f"| {rate} "
+            f"| {r.get('isr_min_cycles', '-')}-{r.get('isr_max_cycles', '-')} "
+            f"| {r.get('jitter_max_cycles', '-')} "
+            f"| {r.get('latency_max_samples', '-')} "
+            f"| {r.get('high_water', '-')} |"
+        )
+
+
+if __name__ == "__main__":
+    main()
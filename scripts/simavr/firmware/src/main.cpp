@@ -0,0 +1,216 @@
+/**
+ * Benchmark firmware run under simavr by `harness.c`.
+ *
+ * Waits for a configuration line on `Serial`, samples for the requested time
+ * while streaming every buffer to the simulated card over SPI the way SdFat
+ * streams a multi-block write, then prints `key=value` results and `done`.
+ *
+ * Configuration (whitespace separated integers):
+ *
+ *     nchannels bits ch_window_sz nslots buf_sz sample_rate duration_ms pipelined
+ *
+ * where `bits` is the numeric value of `adc::BitResolution`.
+ */
+
+#include <Arduino.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Adc.h"
+#include "Profiler.h"
+
+using adc::BitResolution;
+using adc::Channel;
+
+#define MAX_CHANNELS 8
+#define MAX_BUF_SZ 6144
+#define BLOCK_SZ 512
+#define SERIAL_BAUD 115200
+
+// SD card SPI protocol
+#define TOKEN_WRITE_MULTIPLE 0xFC
+#define DATA_RESPONSE_MASK 0x1F
+#define DATA_ACCEPTED 0x05
+#define CARD_READY 0xFF
+
+uint8_t BUF[MAX_BUF_SZ];
+Channel CHANNELS[MAX_CHANNELS] = {
+    Channel(A0, -1, false), Channel(A1, -1, false), Channel(A2, -1, false),
+    Channel(A3, -1, false), Channel(A4, -1, false), Channel(A5, -1, false),
+    Channel(A6, -1, false), Channel(A7, -1, false),
+};
+
+struct Config {
+    uint8_t nchannels;
+    BitResolution res;
+    size_t ch_window_sz;
+    uint8_t nslots;
+    size_t buf_sz;
+    uint32_t sample_rate;
+    uint32_t duration_ms;
+    bool pipelined;
+};
+
+/**
+ * Simulated card on the SPI bus, written to in 512 byte blocks.
+ */
+namespace card {
+
+/* !< Bytes written into the current block */
+size_t block_pos = 0;
+/* !< Blocks the card rejected */
+uint32_t errors = 0;
+/* !< Blocks written */
+uint32_t blocks = 0;
+/* !< Longest time spent writing a block (us) */
+uint32_t write_max_us = 0;
+
+void begin() {
+    // SS must be an output for the SPI to stay in master mode
+    pinMode(SS, OUTPUT);
+    pinMode(MOSI, OUTPUT);
+    pinMode(SCK, OUTPUT);
+    SPCR = (1 << SPE) | (1 << MSTR);
+    SPSR = (1 << SPI2X);
+}
+
+static inline uint8_t transfer(uint8_t b) {
+    SPDR = b;
+    while (!(SPSR & (1 << SPIF))) {
+    }
+    return SPDR;
+}
+
+/**
+ * Finish the current block and wait for the card to program it.
+ */
+static void end_block() {
+    // Dummy CRC
+    transfer(0xFF);
+    transfer(0xFF);
+    if ((transfer(0xFF) & DATA_RESPONSE_MASK) != DATA_ACCEPTED) {
+        ++errors;
+    }
+    while (transfer(0xFF) != CARD_READY) {
+    }
+    block_pos = 0;
+    ++blocks;
+}
+
+void write(const uint8_t* buf, size_t sz) {
+    uint32_t start = micros();
+    for (size_t i = 0; i < sz; ++i) {
+        if (block_pos == 0) {
+            transfer(TOKEN_WRITE_MULTIPLE);
+        }
+        transfer(buf[i]);
+        if (++block_pos == BLOCK_SZ) {
+            end_block();
+        }
+    }
+    uint32_t elapsed = micros() - start;
+    if (elapsed > write_max_us) {
+        write_max_us = elapsed;
+    }
+}
+
+}  // namespace card
+
+static bool read_config(Config& cfg) {
+    long values[8];
+    for (size_t i = 0; i < 8; ++i) {
+        values[i] = Serial.parseInt();
+    }
+    cfg.nchannels = values[0];
+    cfg.res = static_cast<BitResolution>(values[1]);
+    cfg.ch_window_sz = values[2];
+    cfg.nslots = values[3];
+    cfg.buf_sz = values[4];
+    cfg.sample_rate = values[5];
+    cfg.duration_ms = values[6];
+    cfg.pipelined = values[7] != 0;
+    return cfg.nchannels > 0 && cfg.nchannels <= MAX_CHANNELS &&
+           cfg.buf_sz <= MAX_BUF_SZ && cfg.sample_rate > 0;
+}
+
+static void report(const char* key, uint32_t value) {
+    Serial.print(key);
+    Serial.print('=');
+    Serial.println(value);
+}
+
+static void report(const char* key, int32_t value) {
+    Serial.print(key);
+    Serial.print('=');
+    Serial.println(value);
+}
+
+static void done() {
+    Serial.println("done");
+    Serial.flush();
+    while (true) {
+    }
+}
+
+void setup() {
+    Serial.begin(SERIAL_BAUD);
+    Serial.setTimeout(UINT32_MAX);
+    card::begin();
+    Serial.println("ready");
+
+    Config cfg;
+    if (!read_config(cfg)) {
+        Serial.println("error=config");
+        done();
+    }
+    if (!adc::init(cfg.nchannels, CHANNELS, BUF, cfg.buf_sz, cfg.nslots)) {
+        Serial.println("error=init");
+        done();
+    }
+    uint32_t period = F_CPU / (cfg.sample_rate * cfg.nchannels *
+                               adc::oversample_factor(cfg.res));
+    (void)period;
+#ifdef CHRISPY_PROFILE
+    profiler::start(min(period, static_cast<uint32_t>(UINT16_MAX)));
+#endif
+    if (adc::start(cfg.res, cfg.sample_rate, cfg.ch_window_sz, 0,
+                   cfg.pipelined) != 0) {
+        Serial.println("error=start");
+        done();
+    }
+
+    uint8_t* buf = nullptr;
+    size_t sz = 0;
+    size_t ch_index = 0;
+    uint32_t deadline = millis() + cfg.duration_ms;
+    while (millis() < deadline) {
+        if (adc::swap_buffer(&buf, sz, ch_index) == 0 && buf != nullptr) {
+            card::write(buf, sz);
+        }
+    }
+    uint32_t measured_rate = adc::measured_rate();
+    adc::stop();
+#ifdef CHRISPY_PROFILE
+    profiler::stop();
+#endif
+
+    report("rate", measured_rate);
+    report("collected", adc::collected());
+    report("dropped", adc::dropped());
+    report("overruns", static_cast<uint32_t>(adc::overruns()));
+    report("high_water", static_cast<uint32_t>(adc::high_water()));
+    report("blocks", card::blocks);
+    report("card_errors", card::errors);
+    report("write_max_us", card::write_max_us);
+#ifdef CHRISPY_PROFILE
+    const profiler::Profile& p = profiler::PROFILE;
+    report("isr_count", p.duration.count);
+    report("isr_min_cycles", static_cast<int32_t>(p.duration.min));
+    report("isr_max_cycles", static_cast<int32_t>(p.duration.max));
+    report("jitter_max_cycles", static_cast<int32_t>(p.jitter.max));
+    report("latency_max_samples", p.latency.max);
+#endif
+    done();
+}
+
+void loop() {}
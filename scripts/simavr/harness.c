@@ -0,0 +1,292 @@
+/**
+ * Runs the benchmark firmware on a simulated ATmega2560.
+ *
+ * - Drives ADC0-7 with a sine wave per channel.
+ * - Emulates an SD card on the SPI bus which takes a configurable time to
+ *   program each block, with occasional longer stalls like real cards.
+ * - Sends the firmware its configuration over UART0 once it prints `ready`
+ *   and copies everything it prints to stdout until it prints `done`.
+ *
+ * Usage:
+ *     harness [options] firmware.elf "nchannels bits ch_window_sz ..."
+ */
+
+#include <getopt.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <simavr/avr_adc.h>
+#include <simavr/avr_spi.h>
+#include <simavr/avr_uart.h>
+#include <simavr/sim_avr.h>
+#include <simavr/sim_elf.h>
+#include <simavr/sim_irq.h>
+#include <simavr/sim_time.h>
+
+#define F_CPU 16000000ul
+#define MCU "atmega2560"
+#define NCHANNELS 8
+#define VREF_MV 5000
+#define SIGNAL_BIAS_MV 2500
+#define SIGNAL_AMPLITUDE_MV 2000
+#define SIGNAL_BASE_HZ 440.0
+#define SIGNAL_UPDATE_US 10
+#define LINE_SZ 128
+
+// SD card SPI protocol
+#define BLOCK_SZ 512
+#define CRC_SZ 2
+#define TOKEN_WRITE_SINGLE 0xFE
+#define TOKEN_WRITE_MULTIPLE 0xFC
+#define DATA_ACCEPTED 0xE5
+#define CARD_BUSY 0x00
+#define CARD_READY 0xFF
+
+enum card_state {
+    CARD_IDLE,
+    CARD_DATA,
+    CARD_CRC,
+    CARD_RESPONSE,
+    CARD_PROGRAMMING,
+};
+
+struct options {
+    uint32_t block_us;
+    uint32_t stall_us;
+    uint32_t stall_every;
+    uint32_t timeout_ms;
+    const char *firmware;
+    const char *config;
+};
+
+static struct {
+    avr_t *avr;
+    struct options opts;
+    avr_irq_t *adc_in[NCHANNELS];
+    avr_irq_t *spi_in;
+    avr_irq_t *uart_in;
+    /* !< Card protocol state */
+    enum card_state card;
+    /* !< Bytes received in the current state */
+    uint32_t card_pos;
+    /* !< Blocks programmed */
+    uint32_t card_blocks;
+    /* !< Cycle the card finishes programming at */
+    avr_cycle_count_t card_busy_until;
+    /* !< Line printed by the firmware so far */
+    char line[LINE_SZ];
+    size_t line_len;
+    bool configured;
+    bool done;
+} SIM;
+
+static avr_cycle_count_t drive_adc(avr_t *avr, avr_cycle_count_t when,
+                                   void *param) {
+    (void)param;
+    double t = (double)when / F_CPU;
+    for (size_t ch = 0; ch < NCHANNELS; ++ch) {
+        double phase = 2 * M_PI * SIGNAL_BASE_HZ * (ch + 1) * t;
+        uint32_t mv = SIGNAL_BIAS_MV + SIGNAL_AMPLITUDE_MV * sin(phase);
+        avr_raise_irq(SIM.adc_in[ch], mv);
+    }
+    return when + avr_usec_to_cycles(avr, SIGNAL_UPDATE_US);
+}
+
+/**
+ * Reply to a byte the firmware shifted out to the card.
+ */
+static uint8_t card_transfer(uint8_t in) {
+    switch (SIM.card) {
+        case CARD_IDLE:
+            if (in == TOKEN_WRITE_SINGLE || in == TOKEN_WRITE_MULTIPLE) {
+                SIM.card = CARD_DATA;
+                SIM.card_pos = 0;
+            }
+            return CARD_READY;
+        case CARD_DATA:
+            if (++SIM.card_pos == BLOCK_SZ) {
+                SIM.card = CARD_CRC;
+                SIM.card_pos = 0;
+            }
+            return CARD_READY;
+        case CARD_CRC:
+            if (++SIM.card_pos == CRC_SZ) {
+                SIM.card = CARD_RESPONSE;
+            }
+            return CARD_READY;
+        case CARD_RESPONSE: {
+            uint32_t us = SIM.opts.block_us;
+            ++SIM.card_blocks;
+            if (SIM.opts.stall_every != 0 &&
+                SIM.card_blocks % SIM.opts.stall_every == 0) {
+                us += SIM.opts.stall_us;
+            }
+            SIM.card_busy_until =
+                SIM.avr->cycle + avr_usec_to_cycles(SIM.avr, us);
+            SIM.card = CARD_PROGRAMMING;
+            return DATA_ACCEPTED;
+        }
+        case CARD_PROGRAMMING:
+            if (SIM.avr->cycle < SIM.card_busy_until) {
+                return CARD_BUSY;
+            }
+            SIM.card = CARD_IDLE;
+            return CARD_READY;
+    }
+    return CARD_READY;
+}
+
+static void on_spi(struct avr_irq_t *irq, uint32_t value, void *param) {
+    (void)irq;
+    (void)param;
+    avr_raise_irq(SIM.spi_in, card_transfer(value));
+}
+
+static void send_config(void) {
+    for (const char *p = SIM.opts.config; *p != '\0'; ++p) {
+        avr_raise_irq(SIM.uart_in, *p);
+    }
+    avr_raise_irq(SIM.uart_in, '\n');
+    SIM.configured = true;
+}
+
+static void on_uart(struct avr_irq_t *irq, uint32_t value, void *param) {
+    (void)irq;
+    (void)param;
+    char c = value;
+    if (c == '\r') {
+        return;
+    } else if (c != '\n') {
+        if (SIM.line_len < LINE_SZ - 1) {
+            SIM.line[SIM.line_len++] = c;
+        }
+        return;
+    }
+    SIM.line[SIM.line_len] = '\0';
+    SIM.line_len = 0;
+    if (strcmp(SIM.line, "ready") == 0 && !SIM.configured) {
+        send_config();
+    } else if (strcmp(SIM.line, "done") == 0) {
+        SIM.done = true;
+    } else {
+        puts(SIM.line);
+    }
+}
+
+static void usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s [options] firmware.elf config\n"
+            "  --block-us US      Time to program each block (default 250)\n"
+            "  --stall-us US      Extra time for a stalled block (default 0)\n"
+            "  --stall-every N    Stall every N blocks (default 0, never)\n"
+            "  --timeout-ms MS    Simulated time to give up after "
+            "(default 10000)\n",
+            name);
+}
+
+static bool parse(int argc, char **argv, struct options *opts) {
+    static const struct option LONG_OPTS[] = {
+        {"block-us", required_argument, NULL, 'b'},
+        {"stall-us", required_argument, NULL, 's'},
+        {"stall-every", required_argument, NULL, 'e'},
+        {"timeout-ms", required_argument, NULL, 't'},
+        {NULL, 0, NULL, 0},
+    };
+    opts->block_us = 250;
+    opts->stall_us = 0;
+    opts->stall_every = 0;
+    opts->timeout_ms = 10000;
+    int c;
+    while ((c = getopt_long(argc, argv, "", LONG_OPTS, NULL)) != -1) {
+        switch (c) {
+            case 'b':
+                opts->block_us = strtoul(optarg, NULL, 0);
+                break;
+            case 's':
+                opts->stall_us = strtoul(optarg, NULL, 0);
+                break;
+            case 'e':
+                opts->stall_every = strtoul(optarg, NULL, 0);
+                break;
+            case 't':
+                opts->timeout_ms = strtoul(optarg, NULL, 0);
+                break;
+            default:
+                return false;
+        }
+    }
+    if (argc - optind != 2) {
+        return false;
+    }
+    opts->firmware = argv[optind];
+    opts->config = argv[optind + 1];
+    return true;
+}
+
+int main(int argc, char **argv) {
+    if (!parse(argc, argv, &SIM.opts)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    elf_firmware_t fw;
+    memset(&fw, 0, sizeof(fw));
+    if (elf_read_firmware(SIM.opts.firmware, &fw) != 0) {
+        fprintf(stderr, "Could not read %s\n", SIM.opts.firmware);
+        return 1;
+    }
+    fw.frequency = F_CPU;
+    SIM.avr = avr_make_mcu_by_name(MCU);
+    if (SIM.avr == NULL) {
+        fprintf(stderr, "simavr does not support %s\n", MCU);
+        return 1;
+    }
+    avr_init(SIM.avr);
+    avr_load_firmware(SIM.avr, &fw);
+    SIM.avr->avcc = VREF_MV;
+    SIM.avr->aref = VREF_MV;
+    SIM.avr->log = LOG_ERROR;
+
+    for (size_t ch = 0; ch < NCHANNELS; ++ch) {
+        SIM.adc_in[ch] = avr_io_getirq(SIM.avr, AVR_IOCTL_ADC_GETIRQ,
+                                       ADC_IRQ_ADC0 + ch);
+    }
+    avr_cycle_timer_register(SIM.avr, 1, drive_adc, NULL);
+
+    SIM.spi_in =
+        avr_io_getirq(SIM.avr, AVR_IOCTL_SPI_GETIRQ(0), SPI_IRQ_INPUT);
+    avr_irq_register_notify(
+        avr_io_getirq(SIM.avr, AVR_IOCTL_SPI_GETIRQ(0), SPI_IRQ_OUTPUT),
+        on_spi, NULL);
+
+    // Keep simavr from echoing the UART itself
+    uint32_t flags = 0;
+    avr_ioctl(SIM.avr, AVR_IOCTL_UART_GET_FLAGS('0'), &flags);
+    flags &= ~AVR_UART_FLAG_STDIO;
+    avr_ioctl(SIM.avr, AVR_IOCTL_UART_SET_FLAGS('0'), &flags);
+    SIM.uart_in =
+        avr_io_getirq(SIM.avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_INPUT);
+    avr_irq_register_notify(
+        avr_io_getirq(SIM.avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUTPUT),
+        on_uart, NULL);
+
+    avr_cycle_count_t limit =
+        avr_usec_to_cycles(SIM.avr, SIM.opts.timeout_ms * 1000ull);
+    while (!SIM.done) {
+        int state = avr_run(SIM.avr);
+        if (state == cpu_Done || state == cpu_Crashed) {
+            fprintf(stderr, "Firmware stopped (state %d)\n", state);
+            return 1;
+        } else if (SIM.avr->cycle > limit) {
+            fprintf(stderr, "Timed out\n");
+            return 1;
+        }
+    }
+    printf("sim_cycles=%llu\n", (unsigned long long)SIM.avr->cycle);
+    printf("card_blocks=%u\n", SIM.card_blocks);
+    return 0;
+}
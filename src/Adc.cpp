@@ -2,19 +2,17 @@
 
 #include <Arduino.h>
 #include <SdFat.h>
+#include <avr/sleep.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <util/atomic.h>
 
-namespace adc {
+#include "AdcIsr.h"
 
-#define TEN_BIT_BIAS 0x1FF
-#define TEN_TO_SIXTEEN_BIT(x) (((x) - TEN_BIT_BIAS) << 6)
+namespace adc {
 
 // Bit masks
-#define MUX_MASK 0b11111
 #define SOURCE_MASK 0b111
-#define LOW_CHANNEL_MASK 0b111
-#define HIGH_CHANNEL_MASK ~LOW_CHANNEL_MASK
 #define PRESCALER_MASK 0b111
 
 // Prescaler masks
@@ -29,14 +27,24 @@ namespace adc {
 
 #define MIN_BUF_SZ_PER_CHANNEL 512
 
-#define ADC_CYCLES_PER_SAMPLE 13.5
+// Timer 1 clock select bits, cleared to hold the timer
+#define CLOCK_SELECT_MASK ((1 << CS12) | (1 << CS11) | (1 << CS10))
+// Pin INT0 is on
+#define INT0_PIN 21
 
-const size_t MAX_CHANNEL_COUNT = 16;
+#define ADC_CYCLES_PER_SAMPLE 13.5
+// Most CPU cycles the pipelined ISR may spend waiting for timer 1 to trigger
+// the next conversion
+#define MAX_PIPELINE_SLACK_CYCLES 128
 
 // ISR helper functions
-static int8_t init_frame(BitResolution res, size_t ch_window_samples);
-static inline bool activate_adc_channel(Channel& ch);
+static int8_t init_frame(BitResolution res, size_t ch_window_samples,
+                         bool pipelined);
 static bool increment_channel_buffer_index();
+static inline uint8_t* slot_base(uint8_t slot);
+static size_t pack_ten_bit(uint8_t* buf, size_t sz);
+static size_t pack_once(uint8_t slot, size_t ch_index, uint8_t* buf,
+                        size_t sz);
 
 // Internal ADC control functions
 static uint8_t prescaler_mask(pre_t val);
@@ -45,8 +53,25 @@ static void disable_interrupts();
 static void enable_autotrigger();
 static void disable_autotrigger();
 static void set_source(AutotriggerSource src);
-static TimerRc set_frequency(uint32_t sample_rate);
+static TimerRc set_frequency(uint32_t sample_rate, bool pipelined);
+static TimerRc set_adc_clock(uint32_t conversion_rate, bool pipelined);
+static TimerRc compute_adc_clock(uint32_t conversion_rate, bool pipelined,
+                                 TimerConfig& cfg);
+static uint32_t pipeline_slack(uint32_t conversion_rate);
+static bool pipeline_fits(BitResolution res, uint32_t sample_rate,
+                          bool pipelined);
 static void configure_channels(size_t nchannels, Channel* channels);
+static void compute_channel_registers(BitResolution res);
+static void warmup(uint32_t ms);
+static int8_t prepare(BitResolution res, size_t ch_window_sz, bool pipelined,
+                      AutotriggerSource src);
+static void begin(uint32_t warmup_ms);
+static void clear_trigger_flag();
+static void on_edge();
+static void disarm();
+static void on_sync();
+static void stop_sync();
+static int interrupt_mode(Edge edge);
 
 static const size_t NPRESCALERS = 7;
 static const pre_t PRESCALERS[] = {2, 4, 8, 16, 32, 64, 128};
@@ -55,57 +80,13 @@ static pre_t SCRATCH_PRESCALERS[NPRESCALERS];
 // Global static used when swapping/draining buffers.
 // Needs to be global so it also gets reset when resetting ISR frame.
 static size_t CH_BUFFER_INDEX = 0;
+// Sequence number of the slot at the tail of the ring. Reset with the frame.
+static uint32_t SLOT_SEQ = 0;
+// Channel buffers of each slot which have been packed in place (one bit per
+// channel) with `TenPacked`. Cleared when the slot goes back to the ISR.
+static uint16_t PACKED[MAX_SLOT_COUNT];
 
-/**
- * Private/static data member for use by the ISR.
- *
- * Stores the configuration state passed in via public module functions
- * and metadata used by the ISR.
- */
-static struct AdcFrame {
-    /* !< Currently active channel */
-    volatile size_t ch_index;
-    /* !< Current sample index within the channel sub-buffer */
-    volatile size_t sample_index;
-    /* !< Channel `ch_index` sub-buffer */
-    volatile uint8_t* ch_buffer;
-
-    // Flags with frame state
-
-    /* !< "Index" into the double buffer */
-    volatile bool using_buf_1;
-    /* !< Flag indicating if the first buffer is full */
-    volatile bool buf1full;
-    /* !< Flag indicating if the second buffer is full */
-    volatile bool buf2full;
-
-    /* !< Flag indicating an error when switching between channels */
-    volatile bool ch_error;
-
-    /* !< First buffer being written to on ADC interrupts. */
-    uint8_t* buf1;
-    /* !< Second buffer being written to on ADC interrupts. */
-    uint8_t* buf2;
-
-    /* !< Number of channels in the `channels` array - 1 (save subtractions). */
-    size_t max_ch_index;
-    /* !< Number of samples to collect for a channel before swapping to the
-     * next.
-     */
-    size_t ch_window_sz;
-    /* !< `ch_window_sz` - 1. Cached result to save subtractions in ISR. This
-     * is a valid mask because we ensure the window size is a power of 2.*/
-    size_t ch_window_mask;
-    /* !< Number of bytes per channel buffer */
-    size_t ch_buf_sz;
-
-    /* !< Number of samples collected */
-    volatile uint32_t collected;
-    /* !< Flag for whether the frame is currently in use */
-    bool active;
-    /* !< Bit resolution for samples */
-    BitResolution res;
-} FRAME;
+AdcFrame FRAME;
 
 /**
  * Singleton instance of the ADC.
@@ -113,8 +94,11 @@ static struct AdcFrame {
 static struct Adc {
     uint8_t nchannels;
     Channel* channels;
+    /* !< Mux mask for each channel, validated in `init` */
+    uint8_t mux[MAX_CHANNEL_COUNT];
     uint8_t* buf;
     size_t sz;
+    uint8_t nslots;
     BitResolution res;
     bool initialized = false;
 } INSTANCE;
@@ -126,6 +110,40 @@ static struct State {
     uint8_t admux;
 } STATE;
 
+/**
+ * Sampling armed to start on an edge with `arm`.
+ */
+static struct Armed {
+    /* !< Flag for whether sampling is armed (until `stop`) */
+    bool armed = false;
+    /* !< Source the edge comes from */
+    AutotriggerSource src;
+    /* !< Timer 1 clock select bits, held back until the edge */
+    uint8_t clock;
+    /* !< Analog comparator state to restore */
+    uint8_t acsr;
+    /* !< Flag for whether the edge has happened */
+    volatile bool fired;
+    /* !< `timebase` ticks when the edge was handled */
+    uint64_t edge_ticks;
+} ARMED;
+
+/**
+ * Log of shared clock edges kept by `log_sync`.
+ */
+static struct Sync {
+    /* !< Interrupt number the edges come in on, or -1 if not logging */
+    int8_t irq = -1;
+    /* !< Edges seen since logging started */
+    uint32_t nedges;
+    /* !< Ring of marks which have not been drained */
+    SyncMark marks[MAX_SYNC_COUNT];
+    /* !< Index of the oldest mark in `marks` */
+    uint8_t first;
+    /* !< Number of marks in `marks` */
+    uint8_t count;
+} SYNC;
+
 static void save_state() {
     STATE.prr0 = PRR0;
     STATE.adcsra = ADCSRA;
@@ -142,65 +160,26 @@ static void restore_state() {
 
 /**
  * Interrupt service routine responsible for reading samples from the ADC.
+ *
+ * Weak so that applications can replace it with a dedicated body for a fixed
+ * configuration using `ADC_STATIC_ISR`.
  */
-ISR(ADC_vect) {
-    // 1) Immediately reenable timer so we don't miss a beat
-    TIFR1 = UINT8_MAX;
-
-    // 2) Check that we can actually perform work
-    if (!FRAME.active) {
-        return;
-    } else if (FRAME.buf1full && FRAME.buf2full) {
-        return;
-    } else if (FRAME.ch_error) {
-        return;
-    }
-
-    // 3) Read the sample
-    if (FRAME.res == BitResolution::Eight) {
-        FRAME.ch_buffer[FRAME.sample_index++] = ADCH;
-    } else {
-        // 10-bit is assumed here
-        uint8_t low = ADCL;
-        uint8_t high = ADCH;
-        uint16_t new_sample = TEN_TO_SIXTEEN_BIT((high << CHAR_BIT) | low);
-        FRAME.ch_buffer[FRAME.sample_index++] = new_sample & UINT8_MAX;
-        FRAME.ch_buffer[FRAME.sample_index++] = new_sample >> CHAR_BIT;
-    }
-    ++FRAME.collected;
-
-    // 4) Swap buffer we are writing to if we just filled the current one up
-    if (FRAME.sample_index == FRAME.ch_buf_sz &&
-        FRAME.ch_index == FRAME.max_ch_index) {
-        if (FRAME.using_buf_1) {
-            FRAME.buf1full = true;
-        } else {
-            FRAME.buf2full = true;
-        }
-        FRAME.using_buf_1 = !FRAME.using_buf_1;
-        FRAME.sample_index = 0;
-        FRAME.ch_index = 0;
-        FRAME.ch_buffer = FRAME.using_buf_1 ? FRAME.buf1 : FRAME.buf2;
-    }
-
-    // 5) Swap channels if it is time to
-    if (FRAME.max_ch_index > 0 && FRAME.sample_index > 0 &&
-        (FRAME.sample_index & FRAME.ch_window_mask) == 0) {
-        if (FRAME.ch_index == FRAME.max_ch_index) {
-            FRAME.ch_index = 0;
-        } else {
-            ++FRAME.ch_index;
-            FRAME.sample_index -= FRAME.ch_window_sz;
-        }
-        if (!activate_adc_channel(INSTANCE.channels[FRAME.ch_index])) {
-            FRAME.ch_error = true;
-        }
-        uint8_t* base = FRAME.using_buf_1 ? FRAME.buf1 : FRAME.buf2;
-        FRAME.ch_buffer = base + FRAME.ch_index * FRAME.ch_buf_sz;
-    }
+ISR(ADC_vect, __attribute__((weak))) {
+    PROFILE_ISR_ENTER();
+    isr_body<RuntimeConfig>();
+    PROFILE_ISR_EXIT();
 }
 
-int8_t drain_buffer(uint8_t** buf, size_t& sz, size_t& ch_index) {
+/**
+ * Analog comparator interrupt, which starts sampling armed with `arm`.
+ *
+ * Weak so that applications can use the comparator for something else when
+ * they never arm on it.
+ */
+ISR(ANALOG_COMP_vect, __attribute__((weak))) { on_edge(); }
+
+int8_t drain_buffer(uint8_t** buf, size_t& sz, size_t& ch_index,
+                    uint32_t* seq) {
     if (buf == nullptr) {
         return -1;
     } else if (FRAME.active) {
@@ -209,21 +188,25 @@ int8_t drain_buffer(uint8_t** buf, size_t& sz, size_t& ch_index) {
 
     // Drain full buffers first. Preserve old index in case this doesn't find
     // a full buffer but mutates global.
-    int8_t rc = swap_buffer(buf, sz, ch_index);
+    int8_t rc = swap_buffer(buf, sz, ch_index, seq);
     if (rc == 0) {
         return rc;
     }
 
     // Only drain samples if we have any full windows to check
-    size_t window_sz_bytes = FRAME.ch_window_sz * bytes_per_sample(FRAME.res);
-    if (FRAME.sample_index < window_sz_bytes) {
+    if (FRAME.sample_index < FRAME.ch_window_sz) {
         return -3;
     }
 
-    sz = FRAME.sample_index & ~(window_sz_bytes - 1);
+    sz = FRAME.sample_index & ~FRAME.ch_window_mask;
     ch_index = CH_BUFFER_INDEX;
-    *buf = FRAME.using_buf_1 ? FRAME.buf1 : FRAME.buf2;
-    *buf += sz * ch_index;
+    *buf = FRAME.head_base + FRAME.ch_buf_sz * ch_index;
+    if (seq != nullptr) {
+        *seq = SLOT_SEQ;
+    }
+    if (INSTANCE.res == BitResolution::TenPacked) {
+        sz = pack_once(FRAME.head, ch_index, *buf, sz);
+    }
 
     // Once this wraps around, reset the sample index so subsequent calls fail.
     if (increment_channel_buffer_index()) {
@@ -233,28 +216,26 @@ int8_t drain_buffer(uint8_t** buf, size_t& sz, size_t& ch_index) {
     return 0;
 }
 
-int8_t swap_buffer(uint8_t** buf, size_t& sz, size_t& ch_index) {
+int8_t swap_buffer(uint8_t** buf, size_t& sz, size_t& ch_index,
+                   uint32_t* seq) {
+    uint8_t tail = FRAME.tail;
     if (buf == nullptr) {
         return -1;
-    } else if (!(FRAME.buf1full || FRAME.buf2full)) {
+    } else if (!FRAME.full[tail]) {
         return -2;
     }
 
-    // Case 1) Not returning a pointer. Looking for channel 0 in full buffer.
+    // Case 1) Not returning a pointer. The oldest full slot is the tail.
     if (*buf == nullptr) {
-        if (FRAME.buf1full && FRAME.buf2full) {
-            // If both are full, the flag will indicate the next buffer to
-            // be written while is also the oldest uncleared one
-            *buf = FRAME.using_buf_1 ? FRAME.buf1 : FRAME.buf2;
-        } else if (FRAME.buf1full) {
-            *buf = FRAME.buf1;
-        } else if (FRAME.buf2full) {
-            *buf = FRAME.buf2;
-        } else {
-            return -3;
-        }
         ch_index = CH_BUFFER_INDEX;
         sz = FRAME.ch_buf_sz;
+        *buf = slot_base(tail) + ch_index * FRAME.ch_buf_sz;
+        if (seq != nullptr) {
+            *seq = SLOT_SEQ;
+        }
+        if (INSTANCE.res == BitResolution::TenPacked) {
+            sz = pack_once(tail, ch_index, *buf, sz);
+        }
         return 0;
     }
 
@@ -264,39 +245,83 @@ int8_t swap_buffer(uint8_t** buf, size_t& sz, size_t& ch_index) {
     sz = FRAME.ch_buf_sz;
     if (ch_index == 0) {
         // Case 2.1) Incrementing channel index wrapped around, so this was the
-        // last channel buffer. Figure out if it came from buf1 or buf2 and
-        // return it.
-        bool from_buf_1 = *buf < FRAME.buf2;
-        if (from_buf_1) {
-            FRAME.buf1full = false;
-            *buf = FRAME.buf2full ? FRAME.buf2 : nullptr;
-        } else {
-            FRAME.buf2full = false;
-            *buf = FRAME.buf1full ? FRAME.buf1 : nullptr;
+        // last channel buffer of the tail slot. Hand the slot back to the ISR
+        // and move on to the next one in the ring if it is full.
+        PROFILE_SLOT_FREED(tail, collected() + dropped());
+        PACKED[tail] = 0;
+        FRAME.full[tail] = false;
+        if (++tail == FRAME.nslots) {
+            tail = 0;
         }
-        if (*buf == nullptr) {
+        FRAME.tail = tail;
+        ++SLOT_SEQ;
+        if (!FRAME.full[tail]) {
+            *buf = nullptr;
             return -4;
         }
+        *buf = slot_base(tail);
     } else {
         // Case 2.2) Not the last channel buffer, increment to the next one.
         *buf += FRAME.ch_buf_sz;
     }
+    if (seq != nullptr) {
+        *seq = SLOT_SEQ;
+    }
+    if (INSTANCE.res == BitResolution::TenPacked) {
+        sz = pack_once(tail, ch_index, *buf, sz);
+    }
     return 0;
 }
 
-bool init(uint8_t nchannels, Channel* channels, uint8_t* buf, size_t sz) {
+int8_t newest_slot(const uint8_t** slot, size_t& ch_buf_sz, uint32_t& seq) {
+    if (slot == nullptr) {
+        return -1;
+    }
+    uint8_t newest = FRAME.head;
+    newest = newest == 0 ? FRAME.nslots - 1 : newest - 1;
+    if (!FRAME.full[newest]) {
+        return -2;
+    } else if (PACKED[newest] != 0) {
+        // Being handed out, and no longer as the ISR stored it
+        return -3;
+    }
+    // Full slots run from the tail up to the newest one
+    int8_t age = newest - FRAME.tail;
+    if (age < 0) {
+        age += FRAME.nslots;
+    }
+    seq = SLOT_SEQ + age;
+    ch_buf_sz = FRAME.ch_buf_sz;
+    *slot = slot_base(newest);
+    return 0;
+}
+
+bool init(uint8_t nchannels, Channel* channels, uint8_t* buf, size_t sz,
+          uint8_t nslots) {
     if (nchannels > MAX_CHANNEL_COUNT || FRAME.active) {
         return false;
+    } else if (nslots < 2 || nslots > MAX_SLOT_COUNT) {
+        return false;
+    }
+    for (size_t i = 0; i < nchannels; ++i) {
+        int8_t mask = channels[i].mux_mask();
+        if (mask < 0) {
+            return false;
+        }
+        INSTANCE.mux[i] = mask;
     }
 
     INSTANCE.nchannels = nchannels;
     INSTANCE.channels = channels;
     INSTANCE.buf = buf;
     INSTANCE.sz = sz;
+    INSTANCE.nslots = nslots;
     INSTANCE.initialized = true;
     return true;
 }
 
+uint8_t nchannels() { return INSTANCE.nchannels; }
+
 void on() {
     PRR0 &= ~(1 << PRADC);
     ADCSRA |= (1 << ADEN);
@@ -310,55 +335,477 @@ void sleep() {
 }
 
 int8_t start(BitResolution res, uint32_t sample_rate, size_t ch_window_sz,
-             uint32_t warmup_ms) {
+             uint32_t warmup_ms, bool pipelined) {
+    if (!pipeline_fits(res, sample_rate, pipelined)) {
+        return -4;
+    }
+    int8_t rc = prepare(res, ch_window_sz, pipelined,
+                        AutotriggerSource::TimCnt1CmpB);
+    if (rc) {
+        return rc;
+    }
+    // Timer triggers every conversion, several of which make up a sample
+    // when oversampling
+    set_frequency(sample_rate * FRAME.oversample, FRAME.pipelined);
+    begin(warmup_ms);
+    return 0;
+}
+
+int8_t start_free_running(BitResolution res, pre_t prescaler,
+                          size_t ch_window_sz, uint32_t warmup_ms) {
+    uint8_t mask = prescaler_mask(prescaler);
+    if (mask == 0) {
+        return -3;
+    }
+    // No time between conversions to switch the mux in, so it always has to
+    // be programmed ahead
+    int8_t rc =
+        prepare(res, ch_window_sz, true, AutotriggerSource::FreeRunning);
+    if (rc) {
+        return rc;
+    }
+    ADCSRA &= ~PRESCALER_MASK;
+    ADCSRA |= mask;
+    begin(warmup_ms);
+    return 0;
+}
+
+int8_t arm(BitResolution res, uint32_t sample_rate, AutotriggerSource src,
+           Edge edge, size_t ch_window_sz, bool pipelined) {
+    if (src != AutotriggerSource::AnalogComparator &&
+        src != AutotriggerSource::ExternalIrq0) {
+        return -3;
+    } else if (!pipeline_fits(res, sample_rate, pipelined)) {
+        return -4;
+    }
+    int8_t rc = prepare(res, ch_window_sz, pipelined, src);
+    if (rc) {
+        return rc;
+    }
+    set_frequency(sample_rate * FRAME.oversample, FRAME.pipelined);
+    // Hold timer 1 until the edge, which restarts it from 0
+    cli();
+    ARMED.clock = TCCR1B & CLOCK_SELECT_MASK;
+    TCCR1B &= ~CLOCK_SELECT_MASK;
+    TCNT1 = 0;
+    sei();
+
+    // The first conversion after enabling the ADC takes 25 ADC clocks
+    // instead of 13. Get it out of the way now rather than on the edge.
+    ADCSRA |= (1 << ADSC);
+    while (ADCSRA & (1 << ADSC)) {
+    }
+    ADCSRA |= (1 << ADIF);
+
+    ARMED.armed = true;
+    ARMED.src = src;
+    ARMED.fired = false;
+    ARMED.edge_ticks = 0;
+    // Select the edge before clearing the source's flag, which changing
+    // modes may set
+    int mode = CHANGE;
+    if (src == AutotriggerSource::AnalogComparator) {
+        ARMED.acsr = ACSR;
+        uint8_t bits = 0;
+        if (edge == Edge::Falling) {
+            bits = (1 << ACIS1);
+        } else if (edge == Edge::Rising) {
+            bits = (1 << ACIS1) | (1 << ACIS0);
+        }
+        ACSR = bits;
+        // Compare AIN0 against AIN1, leaving the ADC's mux alone
+        ADCSRB &= ~(1 << ACME);
+        compute_channel_registers(res);
+        activate_adc_channel(0);
+    } else {
+        uint8_t bits = (1 << ISC00);
+        if (edge == Edge::Falling) {
+            mode = FALLING;
+            bits = (1 << ISC01);
+        } else if (edge == Edge::Rising) {
+            mode = RISING;
+            bits = (1 << ISC01) | (1 << ISC00);
+        }
+        EICRA = (EICRA & ~((1 << ISC01) | (1 << ISC00))) | bits;
+    }
+
+    // From here on the edge starts the first conversion, which is delivered
+    // to the ISR like every one after it. An edge which comes before its
+    // interrupt is enabled leaves the interrupt pending.
+    FRAME.active = true;
+    enable_autotrigger();
+    enable_interrupts();
+    if (src == AutotriggerSource::AnalogComparator) {
+        // Writing back a set flag would clear it
+        ACSR = (ACSR & ~(1 << ACI)) | (1 << ACIE);
+    } else {
+        attachInterrupt(digitalPinToInterrupt(INT0_PIN), on_edge, mode);
+    }
+    return 0;
+}
+
+int8_t start_external(BitResolution res, uint32_t sample_rate,
+                      AutotriggerSource src, Edge edge, size_t ch_window_sz,
+                      uint32_t warmup_ms) {
+    if (src == AutotriggerSource::TimCnt1Cap) {
+        if (edge == Edge::Any) {
+            return -3;
+        }
+    } else if (src != AutotriggerSource::ExternalIrq0) {
+        return -3;
+    }
+    // Never pipelined, the ISR would have to wait on an edge which may not
+    // come
+    int8_t rc = prepare(res, ch_window_sz, false, src);
+    if (rc) {
+        return rc;
+    }
+    uint32_t conversion_rate = sample_rate * FRAME.oversample;
+    if (src == AutotriggerSource::TimCnt1Cap) {
+        // Timer 1 is saved and restored like for `start`, but only its input
+        // capture unit matters. Changing edges may set the capture flag,
+        // which `begin` clears.
+        set_frequency(conversion_rate, FRAME.pipelined);
+        if (edge == Edge::Rising) {
+            TCCR1B |= (1 << ICES1);
+        } else {
+            TCCR1B &= ~(1 << ICES1);
+        }
+    } else {
+        set_adc_clock(conversion_rate * INSTANCE.nchannels, FRAME.pipelined);
+        uint8_t bits = (1 << ISC00);
+        if (edge == Edge::Falling) {
+            bits = (1 << ISC01);
+        } else if (edge == Edge::Rising) {
+            bits = (1 << ISC01) | (1 << ISC00);
+        }
+        EICRA = (EICRA & ~((1 << ISC01) | (1 << ISC00))) | bits;
+    }
+    begin(warmup_ms);
+    return 0;
+}
+
+bool triggered() { return ARMED.armed && ARMED.fired; }
+
+int8_t await_edge(uint32_t timeout_ms) {
+    if (!ARMED.armed) {
+        return -1;
+    }
+    uint32_t begin = millis();
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    while (true) {
+        // Check and go to sleep with interrupts off, so an edge in between
+        // still wakes the CPU right after `sleep_cpu`
+        cli();
+        if (ARMED.fired) {
+            sei();
+            return 0;
+        } else if (timeout_ms != 0 && millis() - begin >= timeout_ms) {
+            sei();
+            return -2;
+        }
+        sleep_enable();
+        sei();
+        sleep_cpu();
+        sleep_disable();
+    }
+}
+
+bool edge_latency(uint32_t& ticks) {
+    uint64_t first_ticks;
+    bool stamped;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        first_ticks = FRAME.first_ticks;
+        stamped = ARMED.fired && FRAME.stamping && !FRAME.stamp_first;
+    }
+    if (!stamped) {
+        return false;
+    }
+    ticks = first_ticks - ARMED.edge_ticks;
+    return true;
+}
+
+/**
+ * Hand conversions over to timer 1 once the edge sampling was armed for has
+ * autotriggered the first one. Runs from the edge's interrupt.
+ */
+static void on_edge() {
+    if (!ARMED.armed || ARMED.fired) {
+        return;
+    }
+    if (FRAME.stamping) {
+        ARMED.edge_ticks = timebase::now_unlocked();
+        FRAME.stamp_first = true;
+    }
+    // Count the next conversion's period from the edge
+    TCNT1 = 0;
+    TIFR1 = UINT8_MAX;
+    TCCR1B |= ARMED.clock;
+    FRAME.source = AutotriggerSource::TimCnt1CmpB;
+    set_source(AutotriggerSource::TimCnt1CmpB);
+    for (uint8_t i = 0; i < INSTANCE.nchannels; ++i) {
+        FRAME.adcsrb[i] = (FRAME.adcsrb[i] & ~SOURCE_MASK) |
+                          static_cast<uint8_t>(AutotriggerSource::TimCnt1CmpB);
+    }
+    if (ARMED.src == AutotriggerSource::AnalogComparator) {
+        ACSR &= ~(1 << ACIE);
+    } else {
+        EIMSK &= ~(1 << INT0);
+    }
+    FRAME.start_us = micros();
+    ARMED.fired = true;
+}
+
+/**
+ * Release the comparator or INT0 if sampling was armed.
+ */
+static void disarm() {
+    if (!ARMED.armed) {
+        return;
+    }
+    if (ARMED.src == AutotriggerSource::AnalogComparator) {
+        ACSR = ARMED.acsr;
+    } else {
+        detachInterrupt(digitalPinToInterrupt(INT0_PIN));
+    }
+    ARMED.armed = false;
+}
+
+/**
+ * @returns (int): `attachInterrupt` mode for an edge.
+ */
+static int interrupt_mode(Edge edge) {
+    if (edge == Edge::Falling) {
+        return FALLING;
+    } else if (edge == Edge::Rising) {
+        return RISING;
+    }
+    return CHANGE;
+}
+
+int8_t log_sync(uint8_t pin, Edge edge) {
+    int8_t irq = digitalPinToInterrupt(pin);
+    if (irq < 0) {
+        return -1;
+    }
+    bool int0_taken = FRAME.source == AutotriggerSource::ExternalIrq0 ||
+                      (ARMED.armed &&
+                       ARMED.src == AutotriggerSource::ExternalIrq0);
+    if (pin == INT0_PIN && int0_taken) {
+        return -2;
+    } else if (!FRAME.active) {
+        return -3;
+    }
+    stop_sync();
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        SYNC.nedges = 0;
+        SYNC.first = 0;
+        SYNC.count = 0;
+    }
+    SYNC.irq = irq;
+    attachInterrupt(irq, on_sync, interrupt_mode(edge));
+    return 0;
+}
+
+size_t syncs(SyncMark* out, size_t n) {
+    if (out == nullptr) {
+        return 0;
+    }
+    size_t nmarks;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        nmarks = min(static_cast<size_t>(SYNC.count), n);
+        for (size_t i = 0; i < nmarks; ++i) {
+            out[i] = SYNC.marks[(SYNC.first + i) % MAX_SYNC_COUNT];
+        }
+        SYNC.first = (SYNC.first + nmarks) % MAX_SYNC_COUNT;
+        SYNC.count -= nmarks;
+    }
+    return nmarks;
+}
+
+uint32_t sync_edges() {
+    uint32_t n;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { n = SYNC.nedges; }
+    return n;
+}
+
+/**
+ * Mark an edge of the shared clock. Runs from its interrupt.
+ */
+static void on_sync() {
+    uint32_t edge = SYNC.nedges++;
+    if (SYNC.count == MAX_SYNC_COUNT) {
+        // Left for the skip in edge numbers to show
+        return;
+    }
+    SyncMark& mark = SYNC.marks[(SYNC.first + SYNC.count) % MAX_SYNC_COUNT];
+    mark.edge = edge;
+    mark.index = FRAME.collected + FRAME.dropped;
+    ++SYNC.count;
+}
+
+/**
+ * Release the shared clock's interrupt if edges are being logged. Marks
+ * which have not been drained are kept.
+ */
+static void stop_sync() {
+    if (SYNC.irq < 0) {
+        return;
+    }
+    detachInterrupt(SYNC.irq);
+    SYNC.irq = -1;
+}
+
+/**
+ * Set up the frame and every ADC register except the prescaler for sampling.
+ */
+static int8_t prepare(BitResolution res, size_t ch_window_sz, bool pipelined,
+                      AutotriggerSource src) {
     if (!INSTANCE.initialized) {
         return -1;
     }
-    int8_t rc = init_frame(res, ch_window_sz);
+    int8_t rc = init_frame(res, ch_window_sz, pipelined);
     if (rc) {
         return -2;
     }
     INSTANCE.res = res;
+    FRAME.source = src;
+    ARMED.fired = false;
 
     save_state();
     on();
     configure_channels(INSTANCE.nchannels, INSTANCE.channels);
-    set_source(AutotriggerSource::TimCnt1CmpB);
-    set_frequency(sample_rate);
-    // 5V analog reference
-    ADMUX = (1 << REFS0);
+    set_source(src);
     // Start with first channel
-    if (!activate_adc_channel(INSTANCE.channels[0])) {
-        return -3;
-    }
-    // Left adjust result so we can just read from ADCH in ISR
-    if (res == BitResolution::Eight) {
-        ADMUX |= (1 << ADLAR);
-    }
-    // Slight delay to allow channels to settle
+    compute_channel_registers(res);
+    activate_adc_channel(0);
+    return 0;
+}
+
+/**
+ * Start converting and begin delivering samples to the ISR once warmed up.
+ */
+static void begin(uint32_t warmup_ms) {
+    // Slight delay to allow channels to settle. Interrupts stay off until
+    // this is done so a dedicated ISR never needs to check `FRAME.active`.
     FRAME.active = false;
     enable_autotrigger();
-    enable_interrupts();
-    delay(warmup_ms);
+    if (FRAME.source == AutotriggerSource::FreeRunning) {
+        // Nothing else will start the first conversion
+        ADCSRA |= (1 << ADSC);
+    }
+    warmup(warmup_ms);
     FRAME.active = true;
+    FRAME.start_us = micros();
+    enable_interrupts();
+}
 
-    return 0;
+uint32_t collected() {
+    uint32_t n;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { n = FRAME.collected; }
+    return n;
+}
+
+uint32_t dropped() {
+    uint32_t n;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { n = FRAME.dropped; }
+    return n;
+}
+
+uint16_t overruns() {
+    uint16_t n;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { n = FRAME.overruns; }
+    return n;
+}
+
+uint32_t measured_rate() {
+    uint32_t conversions;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        conversions = FRAME.collected + FRAME.dropped;
+    }
+    uint32_t end = FRAME.active ? micros() : FRAME.stop_us;
+    uint32_t elapsed = end - FRAME.start_us;
+    if (elapsed == 0 || INSTANCE.nchannels == 0) {
+        return 0;
+    }
+    uint64_t rate = static_cast<uint64_t>(conversions) * 1000000 / elapsed;
+    return rate / INSTANCE.nchannels;
+}
+
+bool stamps(Stamp& first, Stamp& last) {
+    uint32_t nstamps;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        nstamps = FRAME.nstamps;
+        first = FRAME.first_stamp;
+        last = FRAME.last_stamp;
+    }
+    return nstamps >= 2;
 }
 
-uint32_t collected() { return FRAME.collected; }
+bool timing(Timing& out) {
+    Stamp first, last;
+    if (!stamps(first, last) || INSTANCE.nchannels == 0) {
+        return false;
+    }
+    uint64_t conversions = last.index - first.index;
+    uint64_t elapsed = last.ticks - first.ticks;
+    if (conversions == 0 || elapsed == 0) {
+        return false;
+    }
+    out.rate_mhz = conversions * timebase::TICKS_PER_SEC * 1000 /
+                   (elapsed * INSTANCE.nchannels);
+    // Work back from the first stamp to the first conversion
+    out.start_ticks =
+        first.ticks - (static_cast<uint64_t>(first.index - 1) * elapsed) /
+                          conversions;
+    return true;
+}
+
+uint8_t backlog() {
+    uint8_t n = 0;
+    for (uint8_t i = 0; i < FRAME.nslots; ++i) {
+        n += FRAME.full[i];
+    }
+    return n;
+}
+
+uint8_t high_water() { return FRAME.high_water; }
+
+size_t gaps(Gap* out, size_t n) {
+    if (out == nullptr) {
+        return 0;
+    }
+    size_t ngaps;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        ngaps = min(static_cast<size_t>(FRAME.overruns),
+                    static_cast<size_t>(MAX_GAP_COUNT));
+        ngaps = min(ngaps, n);
+        memcpy(out, FRAME.gaps, ngaps * sizeof(Gap));
+    }
+    return ngaps;
+}
 
 uint32_t stop() {
+    FRAME.stop_us = micros();
     off();
     disable_interrupts();
     disable_autotrigger();
     deactivate_t1();
+    disarm();
+    stop_sync();
     restore_state();
     uint32_t collected = FRAME.collected;
     FRAME.active = false;
     return collected;
 }
 
-static void enable_interrupts() { ADCSRA |= (1 << ADIE); }
+static void enable_interrupts() {
+    // Clear stale completion/trigger flags so the next trigger starts a fresh
+    // conversion which is delivered to the ISR
+    ADCSRA |= (1 << ADIF);
+    clear_trigger_flag();
+    ADCSRA |= (1 << ADIE);
+}
 
 static void disable_interrupts() { ADCSRA &= ~(1 << ADIE); }
 
@@ -371,6 +818,59 @@ static void set_source(enum AutotriggerSource src) {
     ADCSRB |= static_cast<uint8_t>(src);
 }
 
+/**
+ * Clear the flag of the autotrigger source so its next event triggers a
+ * conversion. Free-running conversions trigger themselves off of `ADIF`.
+ */
+static void clear_trigger_flag() {
+    if (FRAME.source == AutotriggerSource::TimCnt1CmpB ||
+        FRAME.source == AutotriggerSource::TimCnt1Cap) {
+        TIFR1 = UINT8_MAX;
+    } else if (FRAME.source == AutotriggerSource::AnalogComparator) {
+        ACSR |= (1 << ACI);
+    } else if (FRAME.source == AutotriggerSource::ExternalIrq0) {
+        EIFR = (1 << INTF0);
+    }
+}
+
+/**
+ * Let the ADC convert for some time without delivering samples. Polls the
+ * conversion flag to keep the trigger rearmed since the ISR is off.
+ */
+static void warmup(uint32_t ms) {
+    uint32_t begin = millis();
+    while (millis() - begin < ms) {
+        if (ADCSRA & (1 << ADIF)) {
+            ADCSRA |= (1 << ADIF);
+            clear_trigger_flag();
+        }
+    }
+}
+
+/**
+ * Fill the frame's table of final `ADMUX`/`ADCSRB` values for each channel
+ * so the ISR can switch channels with two plain stores. Must be called after
+ * the autotrigger source has been set.
+ */
+static void compute_channel_registers(BitResolution res) {
+    // 5V analog reference
+    uint8_t admux = (1 << REFS0);
+    // Left adjust result so we can just read from ADCH in ISR
+    if (res == BitResolution::Eight) {
+        admux |= (1 << ADLAR);
+    }
+    uint8_t adcsrb = ADCSRB & ~(1 << MUX5);
+    for (size_t i = 0; i < INSTANCE.nchannels; ++i) {
+        uint8_t mask = INSTANCE.mux[i];
+        FRAME.admux[i] = admux | (mask & LOW_CHANNEL_MASK);
+        // If the mask comes from a higher channel (>7) set MUX5
+        FRAME.adcsrb[i] = adcsrb;
+        if (mask & HIGH_CHANNEL_MASK) {
+            FRAME.adcsrb[i] |= (1 << MUX5);
+        }
+    }
+}
+
 static void configure_channels(size_t nchannels, Channel* channels) {
     for (size_t i = 0; i < nchannels; ++i) {
         if (channels[i].power >= 0) {
@@ -382,7 +882,7 @@ static void configure_channels(size_t nchannels, Channel* channels) {
     }
 }
 
-static TimerRc set_frequency(uint32_t sample_rate) {
+static TimerRc set_frequency(uint32_t sample_rate, bool pipelined) {
     // For each channel
     sample_rate *= INSTANCE.nchannels;
 
@@ -398,15 +898,18 @@ static TimerRc set_frequency(uint32_t sample_rate) {
     OCR1A = host_cfg.compare;
     OCR1B = host_cfg.compare;
     sei();
+    return set_adc_clock(sample_rate, pipelined);
+}
 
-    clk_t adc_rate = ADC_CYCLES_PER_SAMPLE * sample_rate;
-    // Account for the portion of the time spent switching to the next channel
-    if (INSTANCE.nchannels > 1) {
-        adc_rate += adc_rate;
-    }
-    TimerConfig adc_cfg(F_CPU, adc_rate, Skew::High);
-    memcpy(SCRATCH_PRESCALERS, PRESCALERS, sizeof(PRESCALERS));
-    rc = adc_cfg.compute(NPRESCALERS, SCRATCH_PRESCALERS, 1, 0.0);
+/**
+ * Choose the ADC clock prescaler for a rate of conversions.
+ *
+ * @param conversion_rate: Conversions per second across all channels.
+ * @param pipelined: Whether the mux is programmed one conversion ahead.
+ */
+static TimerRc set_adc_clock(uint32_t conversion_rate, bool pipelined) {
+    TimerConfig adc_cfg(F_CPU, 0, Skew::High);
+    TimerRc rc = compute_adc_clock(conversion_rate, pipelined, adc_cfg);
     if (rc != TimerRc::Okay && rc != TimerRc::ErrorRange) {
         return rc;
     }
@@ -416,30 +919,77 @@ static TimerRc set_frequency(uint32_t sample_rate) {
     return rc;
 }
 
-int8_t Channel::mux_mask() {
-    switch (pin) {
-        case A0:
-            return 0b000;
-        case A1:
-            return 0b001;
-        case A2:
-            return 0b010;
-        case A3:
-            return 0b011;
-        case A4:
-            return 0b100;
-        case A5:
-            return 0b101;
-        case A6:
-            return 0b110;
-        case A7:
-            return 0b111;
-        default:
-            return -1;
+/**
+ * Compute the ADC clock prescaler for a rate of conversions without applying
+ * it.
+ *
+ * @param conversion_rate: Conversions per second across all channels.
+ * @param pipelined: Whether the mux is programmed one conversion ahead.
+ * @param cfg: Configuration for the ADC clock from `F_CPU`, skewed high. Its
+ * desired rate and computed prescaler are filled in.
+ *
+ * @returns (TimerRc): Return code of the computation.
+ */
+static TimerRc compute_adc_clock(uint32_t conversion_rate, bool pipelined,
+                                 TimerConfig& cfg) {
+    clk_t adc_rate = ADC_CYCLES_PER_SAMPLE * conversion_rate;
+    // Account for the portion of the time spent switching to the next channel.
+    // Not needed when the mux is programmed a conversion ahead, in which case
+    // the slowest clock that fits a conversion into each period is best.
+    if (INSTANCE.nchannels > 1 && !pipelined) {
+        adc_rate += adc_rate;
     }
+    cfg.desired = adc_rate;
+    memcpy(SCRATCH_PRESCALERS, PRESCALERS, sizeof(PRESCALERS));
+    return cfg.compute(NPRESCALERS, SCRATCH_PRESCALERS, 1, 0.0);
 }
 
-static int8_t init_frame(BitResolution res, size_t ch_window_samples) {
+/**
+ * Work out how long the pipelined ISR waits on `ADSC` for timer 1 to trigger
+ * the next conversion, which is what is left of a conversion period once the
+ * conversion itself is done.
+ *
+ * @param conversion_rate: Conversions per second across all channels.
+ *
+ * @returns (uint32_t): CPU cycles from one conversion completing to the next
+ * one starting, or 0 if the ADC clock cannot be computed.
+ */
+static uint32_t pipeline_slack(uint32_t conversion_rate) {
+    TimerConfig adc_cfg(F_CPU, 0, Skew::High);
+    TimerRc rc = compute_adc_clock(conversion_rate, true, adc_cfg);
+    if (conversion_rate == 0 ||
+        (rc != TimerRc::Okay && rc != TimerRc::ErrorRange)) {
+        return 0;
+    }
+    uint32_t period = F_CPU / conversion_rate;
+    uint32_t busy = ADC_CYCLES_PER_SAMPLE * adc_cfg.prescaler;
+    return period > busy ? period - busy : 0;
+}
+
+/**
+ * Check whether timer 1 triggered sampling can be pipelined without the ISR
+ * waiting longer than `MAX_PIPELINE_SLACK_CYCLES` for the next conversion.
+ * Only called before `prepare`, so an uninitialized ADC passes and fails
+ * there instead.
+ *
+ * @param res: Bit resolution to use.
+ * @param sample_rate: Sample rate in Hz for each channel.
+ * @param pipelined: Whether pipelining was asked for.
+ *
+ * @returns (bool): True if sampling is not pipelined or the wait is short.
+ */
+static bool pipeline_fits(BitResolution res, uint32_t sample_rate,
+                          bool pipelined) {
+    if (!pipelined || INSTANCE.nchannels < 2) {
+        return true;
+    }
+    uint32_t conversion_rate =
+        sample_rate * oversample_factor(res) * INSTANCE.nchannels;
+    return pipeline_slack(conversion_rate) <= MAX_PIPELINE_SLACK_CYCLES;
+}
+
+static int8_t init_frame(BitResolution res, size_t ch_window_samples,
+                         bool pipelined) {
     if (INSTANCE.nchannels < 1) {
         return -1;
     } else if (ch_window_samples == 0) {
@@ -447,7 +997,7 @@ static int8_t init_frame(BitResolution res, size_t ch_window_samples) {
     } else if (INSTANCE.sz < MIN_BUF_SZ_PER_CHANNEL * INSTANCE.nchannels) {
         return -3;
     }
-    const size_t nbuffers = 2;
+    const size_t nbuffers = INSTANCE.nslots;
     size_t bps = bytes_per_sample(res);
     size_t ch_window_sz = ch_window_samples * bps;
     size_t ch_window_mask = ch_window_samples - 1;
@@ -455,6 +1005,13 @@ static int8_t init_frame(BitResolution res, size_t ch_window_samples) {
         // Channel window size needs to be a power of 2
         return -4;
     }
+    // The first two conversions after warmup both latch the first channel, so
+    // pipelined switching needs at least 2 conversions per window
+    const uint8_t oversample = oversample_factor(res);
+    pipelined = pipelined && INSTANCE.nchannels > 1;
+    if (pipelined && ch_window_samples * oversample < 2) {
+        return -6;
+    }
 
     size_t samples_per_buf = INSTANCE.sz / (nbuffers * bps);
     size_t samples_per_ch_buf = samples_per_buf / INSTANCE.nchannels;
@@ -464,43 +1021,54 @@ static int8_t init_frame(BitResolution res, size_t ch_window_samples) {
         return -5;
     }
     samples_per_ch_buf -= window_increment_delta;
+    // Packing works on whole groups, so channel buffers need to hold some
+    // number of them. Still a multiple of the window size after this.
+    if (res == BitResolution::TenPacked) {
+        samples_per_ch_buf -= samples_per_ch_buf % PACKED_GROUP_SAMPLES;
+        if (samples_per_ch_buf == 0) {
+            return -5;
+        }
+    }
 
     memset(&FRAME, 0, sizeof(FRAME));
 
     FRAME.res = res;
 
-    // Slice up the buffer into a double buffer
-    FRAME.buf1 = INSTANCE.buf;
-    FRAME.buf2 = INSTANCE.buf + samples_per_buf * bps;
+    // Slice up the buffer into a ring of slots
+    FRAME.slots = INSTANCE.buf;
+    FRAME.slot_sz = samples_per_buf * bps;
+    FRAME.nslots = nbuffers;
+    FRAME.head_base = FRAME.slots;
 
     FRAME.max_ch_index = INSTANCE.nchannels - 1;
     FRAME.ch_window_sz = ch_window_sz;
-    FRAME.ch_window_mask = ch_window_mask;
-    FRAME.ch_buffer = FRAME.buf1;
+    // Mask over bytes rather than samples since that is what the ISR indexes
+    FRAME.ch_window_mask = ch_window_sz - 1;
+    FRAME.ch_buffer = FRAME.slots;
     FRAME.ch_buf_sz = samples_per_ch_buf * bps;
 
-    FRAME.using_buf_1 = true;
+    FRAME.pipelined = pipelined;
+    // The mux works in conversions rather than samples
+    FRAME.mux_period = ch_window_samples * oversample;
+    FRAME.mux_countdown = FRAME.mux_period - 1;
+    FRAME.oversample = oversample;
+    FRAME.os_countdown = oversample;
+    FRAME.gap_end = UINT32_MAX;
+    FRAME.stamping = timebase::running();
     FRAME.active = true;
 
     CH_BUFFER_INDEX = 0;
+    SLOT_SEQ = 0;
+    memset(PACKED, 0, sizeof(PACKED));
 
     return 0;
 }
 
-static inline bool activate_adc_channel(Channel& ch) {
-    int8_t mask = ch.mux_mask();
-    if (mask < 0) {
-        return false;
-    }
-    ADMUX &= ~MUX_MASK;
-    ADMUX |= mask;
-    // If the mask comes from a higher channel (>7) set MUX5
-    if (mask & HIGH_CHANNEL_MASK) {
-        ADCSRB |= (1 << MUX5);
-    } else {
-        ADCSRB &= ~(1 << MUX5);
-    }
-    return true;
+/**
+ * @returns (uint8_t*): Start of a slot in the ring.
+ */
+static inline uint8_t* slot_base(uint8_t slot) {
+    return FRAME.slots + slot * FRAME.slot_sz;
 }
 
 /**
@@ -539,14 +1107,79 @@ static uint8_t prescaler_mask(pre_t val) {
     }
 }
 
+/**
+ * Pack 16-bit samples from the ISR into 10-bit samples in place, 4 samples to
+ * 5 bytes. Writes never overtake reads since each group shrinks.
+ *
+ * @param buf: Buffer of 16-bit samples.
+ * @param sz: Size of `buf` in bytes. Trailing samples which do not fill a
+ * whole group are dropped.
+ *
+ * @returns (size_t): Packed size in bytes.
+ */
+static size_t pack_ten_bit(uint8_t* buf, size_t sz) {
+    const size_t ngroups = sz / (PACKED_GROUP_SAMPLES * sizeof(uint16_t));
+    const uint8_t* src = buf;
+    uint8_t* dst = buf;
+    for (size_t i = 0; i < ngroups; ++i) {
+        // Top 10 bits of each sample (little-endian)
+        uint16_t s0 = (src[0] >> 6) | (src[1] << 2);
+        uint16_t s1 = (src[2] >> 6) | (src[3] << 2);
+        uint16_t s2 = (src[4] >> 6) | (src[5] << 2);
+        uint16_t s3 = (src[6] >> 6) | (src[7] << 2);
+        dst[0] = s0;
+        dst[1] = (s0 >> 8) | (s1 << 2);
+        dst[2] = (s1 >> 6) | (s2 << 4);
+        dst[3] = (s2 >> 4) | (s3 << 6);
+        dst[4] = s3 >> 2;
+        src += PACKED_GROUP_SAMPLES * sizeof(uint16_t);
+        dst += PACKED_GROUP_SZ;
+    }
+    return ngroups * PACKED_GROUP_SZ;
+}
+
+/**
+ * Pack a channel buffer in place before it is handed out, unless it already
+ * was. `swap_buffer` hands out the same buffer for as long as it is called
+ * with a nullptr, and packing it again would garble it.
+ *
+ * @param slot: Slot the buffer belongs to.
+ * @param ch_index: Channel the buffer is from.
+ * @param buf: Buffer of 16-bit samples, or of packed ones if it already was.
+ * @param sz: Size of `buf` in bytes before packing.
+ *
+ * @returns (size_t): Packed size in bytes.
+ */
+static size_t pack_once(uint8_t slot, size_t ch_index, uint8_t* buf,
+                        size_t sz) {
+    uint16_t bit = 1u << ch_index;
+    if (PACKED[slot] & bit) {
+        return sz / (PACKED_GROUP_SAMPLES * sizeof(uint16_t)) *
+               PACKED_GROUP_SZ;
+    }
+    PACKED[slot] |= bit;
+    return pack_ten_bit(buf, sz);
+}
+
 size_t bytes_per_sample(BitResolution res) {
     switch (res) {
         case BitResolution::Eight:
             return 1;
         case BitResolution::Ten:
+        case BitResolution::TenPacked:
+        case BitResolution::Eleven:
+        case BitResolution::Twelve:
             return 2;
         default:
             return 0;
     }
 }
+
+size_t buffer_samples(BitResolution res, size_t sz) {
+    if (res == BitResolution::TenPacked) {
+        return sz / PACKED_GROUP_SZ * PACKED_GROUP_SAMPLES;
+    }
+    size_t sample_sz = bytes_per_sample(res);
+    return sample_sz == 0 ? 0 : sz / sample_sz;
+}
 }  // namespace adc
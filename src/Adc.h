@@ -13,14 +13,143 @@ namespace adc {
 enum struct BitResolution : uint8_t {
     Eight = 8,
     Ten = 10,
+    /**
+     * 10-bit samples packed 4 samples to 5 bytes. The ISR collects samples
+     * exactly like `Ten`, and each buffer is packed in place when it is handed
+     * out by `swap_buffer`/`drain_buffer`. Samples are the same signed values
+     * as `Ten` shifted right by 6 bits, stored as a little-endian bitstream.
+     */
+    TenPacked = 0x8A,
+    /**
+     * 11-bit samples from summing 4 10-bit conversions (oversampling). The
+     * ADC runs 4x faster than the requested sample rate.
+     */
+    Eleven = 11,
+    /**
+     * 12-bit samples from summing 16 10-bit conversions (oversampling). The
+     * ADC runs 16x faster than the requested sample rate.
+     */
+    Twelve = 12,
 };
 
+/**
+ * Number of conversions summed into each sample at a bit resolution. Every
+ * extra bit of resolution takes 4x as many conversions.
+ */
+constexpr uint8_t oversample_factor(BitResolution res) {
+    return res == BitResolution::Eleven   ? 4
+           : res == BitResolution::Twelve ? 16
+                                          : 1;
+}
+
+/**
+ * @returns (size_t): Number of bytes a sample takes up in the ADC's buffer.
+ * For `TenPacked` this is the size before packing.
+ */
 size_t bytes_per_sample(BitResolution res);
 
+/**
+ * Number of samples packed together into `PACKED_GROUP_SZ` bytes with
+ * `BitResolution::TenPacked`.
+ */
+const size_t PACKED_GROUP_SAMPLES = 4;
+
+/**
+ * Number of bytes a group of `PACKED_GROUP_SAMPLES` samples packs into.
+ */
+const size_t PACKED_GROUP_SZ = 5;
+
+/**
+ * @returns (size_t): Number of samples in `sz` bytes of a buffer handed out by
+ * `swap_buffer` or `drain_buffer` (packed with `TenPacked`).
+ */
+size_t buffer_samples(BitResolution res, size_t sz);
+
 /**
  * Number of channels supported by the ADC (0 - 15).
  */
-extern const size_t MAX_CHANNEL_COUNT;
+const size_t MAX_CHANNEL_COUNT = 16;
+
+/**
+ * Maximum number of slots the sample buffer can be split into.
+ */
+const uint8_t MAX_SLOT_COUNT = 16;
+
+/**
+ * Maximum number of gaps kept in the gap log for a sampling session.
+ */
+const uint8_t MAX_GAP_COUNT = 16;
+
+/**
+ * Number of shared clock edges `log_sync` holds on to until they are drained
+ * with `syncs`.
+ */
+const uint8_t MAX_SYNC_COUNT = 16;
+
+/**
+ * Run of consecutive samples dropped because every slot was full.
+ *
+ * Both fields count samples across all channels. Since the ISR only
+ * stalls once a slot is complete, a gap always starts on a slot boundary, so
+ * `index / nchannels` is the per-channel sample index the gap starts at and
+ * `length / nchannels` is (roughly) the number of samples lost per channel.
+ */
+struct Gap {
+    /**
+     * Number of samples (stored and dropped) before the gap started.
+     */
+    uint32_t index;
+    /**
+     * Number of samples dropped.
+     */
+    uint32_t length;
+};
+
+/**
+ * Point in time a number of samples had completed by, taken with the
+ * `timebase` clock.
+ */
+struct Stamp {
+    /**
+     * Number of samples (stored and dropped) across all channels.
+     */
+    uint32_t index;
+    /**
+     * `timebase` ticks when the ISR handled sample `index - 1`.
+     */
+    uint64_t ticks;
+};
+
+/**
+ * Edge of a clock shared between boards and the number of samples a
+ * board had completed by it (see `log_sync`).
+ */
+struct SyncMark {
+    /**
+     * Number of the edge, counting from 0 at the first edge after logging
+     * started. A skip means marks were lost because `syncs` fell behind.
+     */
+    uint32_t edge;
+    /**
+     * Number of samples (stored and dropped) across all channels when the
+     * edge was handled, like `Gap::index`.
+     */
+    uint32_t index;
+};
+
+/**
+ * Timing of a round of sampling measured from its stamps.
+ */
+struct Timing {
+    /**
+     * Per-channel sample rate in millihertz.
+     */
+    uint32_t rate_mhz;
+    /**
+     * `timebase` ticks when the first sample was handled.
+     */
+    uint64_t start_ticks;
+};
 
 /**
  * Single ADC channel (pin + metadata).
@@ -51,12 +180,52 @@ struct Channel {
         : pin(_pin), power(_power), active_high(_active_high) {}
 
     /**
-     * Gets bit pattern for mux mask to use with ADC for channel.
+     * Gets bit pattern for mux mask to use with ADC for channel. Bits 0-2
+     * go in the `MUX2:0` bits of `ADMUX` and bit 3 is `MUX5` in `ADCSRB`.
      *
      * @returns (int8_t): Bit-mask or ADC mask if successful (>0), negative
      * otherwise.
      */
-    inline int8_t mux_mask();
+    inline int8_t mux_mask() {
+        switch (pin) {
+            case A0:
+                return 0b000;
+            case A1:
+                return 0b001;
+            case A2:
+                return 0b010;
+            case A3:
+                return 0b011;
+            case A4:
+                return 0b100;
+            case A5:
+                return 0b101;
+            case A6:
+                return 0b110;
+            case A7:
+                return 0b111;
+#if defined(A15)
+            case A8:
+                return 0b1000;
+            case A9:
+                return 0b1001;
+            case A10:
+                return 0b1010;
+            case A11:
+                return 0b1011;
+            case A12:
+                return 0b1100;
+            case A13:
+                return 0b1101;
+            case A14:
+                return 0b1110;
+            case A15:
+                return 0b1111;
+#endif
+            default:
+                return -1;
+        }
+    }
 };
 
 /**
@@ -76,8 +245,24 @@ enum struct AutotriggerSource : uint8_t {
 
 /**
  * Initialize ADC module with these parameters for sampling.
+ *
+ * Fails if any channel's pin cannot be mapped to an ADC mux mask.
+ *
+ * @param _nchannels: Number of channels in `_channels`.
+ * @param _channels: Channels to sample from.
+ * @param _buf: Buffer the ISR writes samples to.
+ * @param _sz: Size of `_buf` in bytes.
+ * @param _nslots: Number of slots `_buf` is split into and used as a ring.
+ * More (smaller) slots absorb longer stalls in the consumer with the same
+ * total memory. Must be within [2, MAX_SLOT_COUNT].
+ */
+bool init(uint8_t _nchannels, Channel* _channels, uint8_t* _buf, size_t _sz,
+          uint8_t _nslots = 2);
+
+/**
+ * @returns (uint8_t): Number of channels the module was initialized with.
  */
-bool init(uint8_t _nchannels, Channel* _channels, uint8_t* _buf, size_t _sz);
+uint8_t nchannels();
 
 /**
  * Start ADC sampling at a certain rate with a given bit resolution.
@@ -89,11 +274,152 @@ bool init(uint8_t _nchannels, Channel* _channels, uint8_t* _buf, size_t _sz);
  * @param warmup_ms: Milliseconds to delay after starting ADC before
  * ingesting samples. A small warmup helps prevent poor signal from
  * channel switching noise.
+ * @param pipelined: Program the mux for the next channel one conversion
+ * ahead instead of doubling the ADC clock to leave room for switching
+ * channels within a sample period. Only affects multi-channel sampling, where
+ * it requires a `ch_window_sz` of at least 2. Once per window the ISR waits
+ * with interrupts off for timer 1 to start the next conversion, so this is
+ * refused when a conversion leaves more than 128 CPU cycles of its period
+ * idle, which mostly happens at low aggregate rates where switching has time
+ * anyway.
  *
- * @returns (int8_t): Return code. 0 if all is good, negative otherwise.
+ * @returns (int8_t): Return code. 0 if all is good, negative otherwise. -4
+ * indicates pipelining was refused for leaving the ISR waiting too long.
  */
 int8_t start(BitResolution res, uint32_t sample_rate, size_t ch_window_sz = 1,
-             uint32_t warmup_ms = 100);
+             uint32_t warmup_ms = 100, bool pipelined = false);
+
+/**
+ * Start ADC sampling in free-running mode, where every conversion starts as
+ * soon as the previous one finishes. This runs the ADC at its native rate of
+ * `F_CPU / prescaler / 13` conversions per second (shared between channels)
+ * and does not occupy timer 1. Since there is no time between conversions,
+ * multi-channel sampling always programs the mux one conversion ahead (see
+ * `pipelined` in `start`).
+ *
+ * The rate which was actually achieved can be read with `measured_rate`.
+ *
+ * @param res: Bit resolution to use.
+ * @param prescaler: ADC clock prescaler (2 - 128). The ADC is specified for
+ * full 10-bit accuracy with a clock between 50kHz and 200kHz, but can run
+ * faster at lower resolution.
+ * @param ch_window_sz: Size of each channel's window. Must be at least 2 when
+ * there are multiple channels being recorded from.
+ * @param warmup_ms: Milliseconds to delay after starting ADC before
+ * ingesting samples.
+ *
+ * @returns (int8_t): Return code. 0 if all is good, negative otherwise.
+ */
+int8_t start_free_running(BitResolution res, pre_t prescaler,
+                          size_t ch_window_sz = 2, uint32_t warmup_ms = 100);
+
+/**
+ * Edge of a hardware event which starts sampling armed with `arm`.
+ */
+enum struct Edge : uint8_t {
+    Any,     /*!< Either edge */
+    Falling, /*!< Falling edge */
+    Rising,  /*!< Rising edge */
+};
+
+/**
+ * Arm the ADC to start sampling on an edge of the analog comparator's output
+ * (AIN0 against AIN1) or of INT0 (pin 21), e.g. from a front-end detector,
+ * instead of right away.
+ *
+ * Everything is set up as for `start`, except timer 1 is held and the edge
+ * itself autotriggers the first conversion in hardware, so it starts within
+ * an ADC clock of the edge without the CPU doing anything. The edge's
+ * interrupt then hands every following conversion to timer 1, counting
+ * from the edge. Meanwhile the CPU can sleep with `await_edge`.
+ *
+ * Uses the default ISR, so it cannot be combined with `ADC_STATIC_ISR`.
+ * INT0 is claimed with `attachInterrupt` until `stop` is called.
+ *
+ * @param res: Bit resolution to use.
+ * @param sample_rate: Sample rate in Hz to record at once triggered.
+ * @param src: `AutotriggerSource::AnalogComparator` or
+ * `AutotriggerSource::ExternalIrq0`.
+ * @param edge: Edge to start on.
+ * @param ch_window_sz: Size of each channel's window (see `start`).
+ * @param pipelined: Program the mux one conversion ahead (see `start`). The
+ * edge only triggers the first conversion, and timer 1 every one after it,
+ * so the ISR never waits longer for the next conversion than with `start`.
+ *
+ * @returns (int8_t): Return code. 0 if all is good, negative otherwise. -3
+ * indicates `src` cannot arm sampling and -4 that pipelining was refused
+ * (see `start`).
+ */
+int8_t arm(BitResolution res, uint32_t sample_rate, AutotriggerSource src,
+           Edge edge = Edge::Rising, size_t ch_window_sz = 1,
+           bool pipelined = false);
+
+/**
+ * @returns (bool): True if sampling armed with `arm` has been started by its
+ * edge.
+ */
+bool triggered();
+
+/**
+ * Sleep (in idle mode, which keeps the ADC, comparator and timers running)
+ * until the edge sampling was armed for. Timer 0 still wakes the CPU every
+ * millisecond to keep `millis()` going, and it goes straight back to sleep.
+ *
+ * @param timeout_ms: Milliseconds to give up after, or 0 to wait forever.
+ *
+ * @returns (int8_t): 0 once triggered, -1 if sampling is not armed and -2
+ * on timeout.
+ */
+int8_t await_edge(uint32_t timeout_ms = 0);
+
+/**
+ * Time from the edge which started sampling armed with `arm` to the ISR
+ * storing the first sample. The edge is timed as its interrupt is handled,
+ * a few cycles after the edge itself. Only measured if the `timebase` was
+ * running when sampling was armed.
+ *
+ * @param ticks: Out-parameter for the latency in `timebase` ticks.
+ *
+ * @returns (bool): True if the latency was measured.
+ */
+bool edge_latency(uint32_t& ticks);
+
+/**
+ * Start ADC sampling with every conversion triggered by an edge of an
+ * external clock instead of timer 1, so boards fed the same clock convert
+ * in lockstep rather than each drifting with its own crystal.
+ *
+ * The clock goes to ICP1 (`AutotriggerSource::TimCnt1Cap`, PD4, which the
+ * Mega does not break out to a header) or INT0
+ * (`AutotriggerSource::ExternalIrq0`, pin 21). It has to run at
+ * `sample_rate * nchannels * oversample_factor(res)` edges per second, and
+ * conversions stop whenever it does. Timer 1 is only occupied with
+ * `TimCnt1Cap`, for its input capture unit. INT0 only sets its flag, so its
+ * interrupt stays free.
+ *
+ * The mux is never programmed ahead (see `pipelined` in `start`), since that
+ * has the ISR wait for the next conversion to start, and the next edge may
+ * never come. The mux is switched between conversions instead, with the ADC
+ * clock doubled to leave room for it, so the clock cannot run faster than
+ * the ADC converts at half its period.
+ *
+ * @param res: Bit resolution to use.
+ * @param sample_rate: Per-channel sample rate in Hz the clock works out to.
+ * Only used to choose the ADC clock.
+ * @param src: `AutotriggerSource::TimCnt1Cap` or
+ * `AutotriggerSource::ExternalIrq0`.
+ * @param edge: Edge of the clock to convert on. ICP1 only captures one edge,
+ * so `Edge::Any` only works with INT0.
+ * @param ch_window_sz: Size of each channel's window (see `start`).
+ * @param warmup_ms: Milliseconds to delay after starting ADC before
+ * ingesting samples.
+ *
+ * @returns (int8_t): Return code. 0 if all is good, negative otherwise. -3
+ * indicates `src` cannot clock conversions on `edge`.
+ */
+int8_t start_external(BitResolution res, uint32_t sample_rate,
+                      AutotriggerSource src, Edge edge = Edge::Rising,
+                      size_t ch_window_sz = 1, uint32_t warmup_ms = 100);
 
 /**
  * Stops ADC sampling and performs cleanup on registers.
@@ -107,6 +433,120 @@ uint32_t stop();
  */
 uint32_t collected();
 
+/**
+ * Per-channel sample rate which was actually achieved in the current/previous
+ * round of sampling, measured against `micros()` from when samples started
+ * being delivered until now (or until `stop` was called). Counts dropped
+ * samples as well since they were still taken on time.
+ *
+ * @returns (uint32_t): Measured sample rate in Hz, or 0 if no time has
+ * passed.
+ */
+uint32_t measured_rate();
+
+/**
+ * @returns (uint32_t): Number of samples dropped in the current/previous
+ * round of sampling because the ring of slots was full.
+ */
+uint32_t dropped();
+
+/**
+ * @returns (uint16_t): Number of separate overrun events (gaps) in the
+ * current/previous round of sampling. May exceed the number of logged gaps.
+ */
+uint16_t overruns();
+
+/**
+ * Copy the first and last stamps of the current/previous round of sampling.
+ *
+ * The ISR stamps every slot it completes if the `timebase` was running when
+ * sampling started, which costs nothing for the rest of the samples.
+ *
+ * @param first: Out-parameter for the stamp of the first completed slot.
+ * @param last: Out-parameter for the stamp of the most recently completed
+ * slot.
+ *
+ * @returns (bool): True if at least two slots were stamped.
+ */
+bool stamps(Stamp& first, Stamp& last);
+
+/**
+ * Measure the true sample rate and start time of the current/previous round
+ * of sampling from its stamps. Unlike the nominal rate, this includes the
+ * error of the timer configuration and of the board's clock against the
+ * timebase.
+ *
+ * @param out: Out-parameter for the measured timing.
+ *
+ * @returns (bool): True if there were enough stamps to measure with.
+ */
+bool timing(Timing& out);
+
+/**
+ * @returns (uint8_t): Number of slots which are full and waiting on the
+ * consumer, including the one currently lent out by `swap_buffer`. Once this
+ * reaches the number of slots the ISR starts dropping samples.
+ */
+uint8_t backlog();
+
+/**
+ * @returns (uint8_t): Most slots which have been full and waiting on the
+ * consumer at once since the ADC was started. Reaching the number of slots
+ * means the ISR had to drop samples.
+ */
+uint8_t high_water();
+
+/**
+ * Copy the gap log for the current/previous round of sampling. Only the
+ * first `MAX_GAP_COUNT` gaps are logged.
+ *
+ * @param out: Array to copy gaps into.
+ * @param n: Capacity of `out`.
+ *
+ * @returns (size_t): Number of gaps copied into `out`.
+ */
+size_t gaps(Gap* out, size_t n);
+
+/**
+ * Log the edges of a clock shared between boards (e.g. a GPS PPS output)
+ * along with how many samples had completed by each one, until `stop`
+ * is called. Recordings from several boards line up by the samples they
+ * logged for the same edge, without cross-correlating them afterwards.
+ *
+ * Edges are numbered from the first one after this is called, so every
+ * board has to start logging between the same two edges for the numbers to
+ * match, e.g. by arming them all on a shared edge with `arm` and logging
+ * right after. A mark is taken as the edge's interrupt is handled, so it can
+ * be off by the one sample which completes meanwhile.
+ *
+ * @param pin: Pin with an external interrupt the clock is on (2, 3 or
+ * 18 - 21). Claimed with `attachInterrupt`.
+ * @param edge: Edge of the clock to log.
+ *
+ * @returns (int8_t): Return code. 0 if all is good, negative otherwise. -1
+ * indicates `pin` has no interrupt, -2 that the ADC is already using it and
+ * -3 that sampling has not been started.
+ */
+int8_t log_sync(uint8_t pin, Edge edge = Edge::Rising);
+
+/**
+ * Move the oldest marks logged since `log_sync` out of the log. Only the
+ * `MAX_SYNC_COUNT` oldest marks which have not been drained are kept, so
+ * call this regularly.
+ *
+ * @param out: Array to move marks into.
+ * @param n: Capacity of `out`.
+ *
+ * @returns (size_t): Number of marks moved into `out`.
+ */
+size_t syncs(SyncMark* out, size_t n);
+
+/**
+ * @returns (uint32_t): Number of shared clock edges seen since `log_sync`,
+ * including any whose marks were lost.
+ */
+uint32_t sync_edges();
+
 /**
  * Activate internal board's ADC. Wake up from sleep mode.
  */
@@ -130,23 +570,53 @@ void sleep();
  * out to the appropriate channel as it comes in.
  *
  * @param buf: Pointer to buffer being swapped. If it is a null-pointer,
- * will try to swap it with a currently full buffer without marking it as
- * usable by the ISR. If it is one of the double buffers, will free the
- * buffer for use again and try to exchange it for the other buffer if
- * possible.
+ * will try to swap it with the oldest full buffer without marking it as
+ * usable by the ISR. If it is the last channel buffer of a slot, will free
+ * the slot for use again and try to exchange it for the next full slot in
+ * the ring if possible.
  * @param sz: Out-parameter for the number of bytes in the buffer.
  * @param ch_index: Out-paramter for the channel index this data is from.
+ * @param seq: Optional out-parameter for the sequence number of the slot the
+ * buffer belongs to. Slots are numbered from 0 in the order the ISR filled
+ * them, so combined with the gap log this places every buffer in time.
+ *
+ * With `BitResolution::TenPacked`, buffers are packed in place before being
+ * handed out and `sz` is the packed size. Each buffer is only packed the
+ * first time it is handed out, so calling this with a nullptr again returns
+ * the same packed buffer.
  *
  * @returns (int8_t): 0 if a new buffer is returned. Nonzero otherwise.
  */
-int8_t swap_buffer(uint8_t** buf, size_t& sz, size_t& ch_index);
+int8_t swap_buffer(uint8_t** buf, size_t& sz, size_t& ch_index,
+                   uint32_t* seq = nullptr);
+
+/**
+ * Look at the slot the ISR filled most recently without taking it out of the
+ * ring, e.g. to watch for an event while older slots are still waiting.
+ *
+ * @param slot: Out-parameter for the start of the slot. Its channel buffers
+ * follow each other `ch_buf_sz` bytes apart and hold samples as the ISR
+ * stored them (never packed).
+ * @param ch_buf_sz: Out-parameter for the size of each channel buffer.
+ * @param seq: Out-parameter for the sequence number of the slot (see
+ * `swap_buffer`).
+ *
+ * @returns (int8_t): 0 if there is a full slot to look at. -1 indicates
+ * `slot` is null, -2 that no slot is full and -3 that the newest slot is the
+ * one `swap_buffer` is handing out with `BitResolution::TenPacked`, which
+ * has been packed in place.
+ */
+int8_t newest_slot(const uint8_t** slot, size_t& ch_buf_sz, uint32_t& seq);
 
 /**
  * NOT SAFE TO USE WHEN THE ADC IS ENABLED!
  *
  * Identical API as `swap_buffer` but this will also give the active buffer.
- * Used to drain any remaining samples from the buffer.
+ * Used to drain any remaining samples from the buffer. With
+ * `BitResolution::TenPacked`, up to `PACKED_GROUP_SAMPLES - 1` trailing
+ * samples which do not fill a whole group are dropped.
  */
-int8_t drain_buffer(uint8_t** buf, size_t& sz, size_t& ch_index);
+int8_t drain_buffer(uint8_t** buf, size_t& sz, size_t& ch_index,
+                    uint32_t* seq = nullptr);
 
 }  // namespace adc
@@ -0,0 +1,566 @@
+#pragma once
+#include <Arduino.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Adc.h"
+#include "Profiler.h"
+#include "Timebase.h"
+
+/**
+ * ADC interrupt internals.
+ *
+ * The body of `ISR(ADC_vect)` is written once as a template over a
+ * configuration type. The library defines a weak ISR using `RuntimeConfig`,
+ * which reads every parameter out of the frame at runtime. Applications that
+ * know their configuration at compile time can replace it with a dedicated
+ * ISR using `ADC_STATIC_ISR(adc::StaticConfig<...>)`, in which case every
+ * branch on resolution, channel count and window size is folded away by the
+ * compiler.
+ */
+
+#define TEN_BIT_BIAS 0x1FF
+#define TEN_TO_SIXTEEN_BIT(x) (((x) - TEN_BIT_BIAS) << 6)
+#define ELEVEN_BIT_BIAS 0x3FF
+#define TWELVE_BIT_BIAS 0x7FF
+
+#define LOW_CHANNEL_MASK 0b111
+#define HIGH_CHANNEL_MASK ~LOW_CHANNEL_MASK
+
+namespace adc {
+
+/**
+ * Stores the configuration state passed in via public module functions
+ * and metadata used by the ISR.
+ */
+struct AdcFrame {
+    /* !< Currently active channel */
+    volatile size_t ch_index;
+    /* !< Current sample index within the channel sub-buffer */
+    volatile size_t sample_index;
+    /* !< Channel `ch_index` sub-buffer */
+    volatile uint8_t* ch_buffer;
+
+    // Ring of slots, each holding one sub-buffer per channel
+
+    /* !< Slot currently being written to by the ISR. */
+    volatile uint8_t head;
+    /* !< Oldest slot which has not been handed back by the consumer. Only
+     * written outside of the ISR. */
+    volatile uint8_t tail;
+    /* !< Flags indicating which slots are full. Set by the ISR and cleared
+     * by the consumer, so each flag only ever has one writer at a time. */
+    volatile bool full[MAX_SLOT_COUNT];
+    /* !< Start of slot `head`. Cached so the ISR never multiplies. */
+    uint8_t* head_base;
+
+    /* !< Start of the first slot. */
+    uint8_t* slots;
+    /* !< Number of bytes between the start of consecutive slots. */
+    size_t slot_sz;
+    /* !< Number of slots in the ring. */
+    uint8_t nslots;
+
+    /* !< Final `ADMUX` value for each channel, indexed by `ch_index`. */
+    uint8_t admux[MAX_CHANNEL_COUNT];
+    /* !< Final `ADCSRB` value for each channel, indexed by `ch_index`. */
+    uint8_t adcsrb[MAX_CHANNEL_COUNT];
+
+    // Pipelined mux switching. The mux is programmed one conversion ahead of
+    // the conversion being stored, so it keeps its own cursor.
+
+    /* !< Flag for whether the mux is programmed one conversion ahead */
+    bool pipelined;
+    /* !< Channel the mux is currently programmed for */
+    uint8_t mux_ch_index;
+    /* !< Conversions left until the mux needs to be programmed again */
+    size_t mux_countdown;
+    /* !< Conversions per channel window */
+    size_t mux_period;
+    // Oversampling. Conversions are summed (integrate and dump) into each
+    // sample.
+
+    /* !< Number of conversions summed into each sample */
+    uint8_t oversample;
+    /* !< Conversions left until the current sample is complete */
+    uint8_t os_countdown;
+    /* !< Sum of the conversions so far for the current sample */
+    uint16_t acc;
+    /* !< Flag for whether the current sample is going to be dropped */
+    bool os_drop;
+
+    /* !< Number of channels in the `channels` array - 1 (save subtractions). */
+    size_t max_ch_index;
+    /* !< Number of bytes to collect for a channel before swapping to the
+     * next.
+     */
+    size_t ch_window_sz;
+    /* !< `ch_window_sz` - 1. Cached result to save subtractions in ISR. This
+     * is a valid mask because we ensure the window size is a power of 2.*/
+    size_t ch_window_mask;
+    /* !< Number of bytes per channel buffer */
+    size_t ch_buf_sz;
+
+    /* !< Number of samples collected */
+    volatile uint32_t collected;
+    /* !< Number of samples dropped because the ring was full */
+    volatile uint32_t dropped;
+    /* !< Number of separate overrun events */
+    volatile uint16_t overruns;
+    /* !< Most slots which have been full at once */
+    volatile uint8_t high_water;
+    /* !< Stream index (`collected` + `dropped`) just past the last dropped
+     * sample. Used to tell if a drop extends the previous gap. */
+    uint32_t gap_end;
+    /* !< Log of the first `MAX_GAP_COUNT` gaps */
+    Gap gaps[MAX_GAP_COUNT];
+    /* !< Flag for whether completed slots are stamped */
+    bool stamping;
+    /* !< Number of stamps taken */
+    uint32_t nstamps;
+    /* !< Stamp of the first completed slot */
+    Stamp first_stamp;
+    /* !< Stamp of the last completed slot */
+    Stamp last_stamp;
+    /* !< Flag for whether the next sample stored is stamped. Set by the edge
+     * which starts sampling armed with `arm`. */
+    volatile bool stamp_first;
+    /* !< `timebase` ticks when the first sample was stored, see
+     * `stamp_first` */
+    uint64_t first_ticks;
+    /* !< Source conversions are triggered by */
+    AutotriggerSource source;
+    /* !< `micros()` when samples started being delivered to the ISR */
+    uint32_t start_us;
+    /* !< `micros()` when sampling was stopped */
+    uint32_t stop_us;
+    /* !< Flag for whether the frame is currently in use */
+    bool active;
+    /* !< Bit resolution for samples */
+    BitResolution res;
+};
+
+/**
+ * Private data member for use by the ISR. Only modified by the `adc` module.
+ */
+extern AdcFrame FRAME;
+
+/**
+ * ISR configuration which reads every parameter from `FRAME`. Used by the
+ * library's default ISR so any combination passed to `start` works.
+ */
+struct RuntimeConfig {
+    /* !< Whether the ISR needs to check the frame is active. */
+    static const bool checked = true;
+    /* !< Whether sampling can be armed to start on an edge (see `arm`). */
+    static const bool armable = true;
+
+    static inline AutotriggerSource source() { return FRAME.source; }
+    static inline bool pipelined() { return FRAME.pipelined; }
+    static inline BitResolution res() { return FRAME.res; }
+    static inline uint8_t oversample() { return FRAME.oversample; }
+    static inline size_t max_ch_index() { return FRAME.max_ch_index; }
+    static inline size_t window_sz() { return FRAME.ch_window_sz; }
+    static inline size_t window_mask() { return FRAME.ch_window_mask; }
+};
+
+/**
+ * ISR configuration fixed at compile time.
+ *
+ * @tparam Res: Bit resolution samples are collected at.
+ * @tparam NChannels: Number of channels passed to `init`.
+ * @tparam WindowSamples: Samples per channel before switching. Must be a
+ * power of 2.
+ * @tparam Pipelined: Whether the mux is programmed one conversion ahead.
+ * @tparam Source: Source conversions are triggered by. Either `TimCnt1CmpB`
+ * (timed sampling with `start`), `FreeRunning` (`start_free_running`) or
+ * `TimCnt1Cap`/`ExternalIrq0` (an external clock with `start_external`).
+ */
+template <BitResolution Res, uint8_t NChannels, size_t WindowSamples = 1,
+          bool Pipelined = false,
+          AutotriggerSource Source = AutotriggerSource::TimCnt1CmpB>
+struct StaticConfig {
+    static_assert(NChannels > 0 && NChannels <= MAX_CHANNEL_COUNT,
+                  "Channel count must be within [1, MAX_CHANNEL_COUNT]");
+    static_assert(WindowSamples > 0 &&
+                      (WindowSamples & (WindowSamples - 1)) == 0,
+                  "Window size must be a power of 2");
+    static_assert(!Pipelined || NChannels == 1 ||
+                      WindowSamples * oversample_factor(Res) > 1,
+                  "Pipelined switching needs a window of at least 2 samples");
+    static_assert(Source == AutotriggerSource::TimCnt1CmpB ||
+                      Source == AutotriggerSource::FreeRunning ||
+                      Source == AutotriggerSource::TimCnt1Cap ||
+                      Source == AutotriggerSource::ExternalIrq0,
+                  "Only timer 1, free-running and external clock triggers "
+                  "are supported");
+    static_assert(Source != AutotriggerSource::FreeRunning || Pipelined ||
+                      NChannels == 1,
+                  "Free-running multi-channel sampling must be pipelined");
+    static_assert(!Pipelined || (Source != AutotriggerSource::TimCnt1Cap &&
+                                 Source != AutotriggerSource::ExternalIrq0),
+                  "External clocks cannot be pipelined");
+
+    static const bool checked = false;
+    static const bool armable = false;
+    static const uint8_t nchannels = NChannels;
+    static const size_t window_samples = WindowSamples;
+    static const bool is_pipelined = Pipelined;
+
+    static constexpr AutotriggerSource source() { return Source; }
+    static constexpr bool pipelined() { return Pipelined; }
+    static constexpr BitResolution res() { return Res; }
+    static constexpr uint8_t oversample() { return oversample_factor(Res); }
+    static constexpr size_t max_ch_index() { return NChannels - 1; }
+    static constexpr size_t window_sz() {
+        return WindowSamples * (Res == BitResolution::Eight ? 1 : 2);
+    }
+    static constexpr size_t window_mask() { return window_sz() - 1; }
+};
+
+/**
+ * Point the ADC mux at a channel. Register values are precomputed in
+ * `start`, so this is just two stores.
+ */
+static inline void activate_adc_channel(size_t ch_index) {
+    ADMUX = FRAME.admux[ch_index];
+    ADCSRB = FRAME.adcsrb[ch_index];
+}
+
+/**
+ * Advance the pipelined mux cursor by one conversion.
+ *
+ * The mux is latched when a conversion starts, and by the time the ISR for
+ * conversion `k` runs conversion `k + 1` has already started (or is about to
+ * be triggered). The mux is therefore programmed for conversion `k + 2`
+ * once `k + 1` has started, which is the last conversion of the current
+ * window. The stored sample always belongs to the channel the store cursor
+ * (`ch_index`) points at since the switching schedule is deterministic.
+ */
+static inline void advance_mux_pipeline() {
+    size_t countdown = FRAME.mux_countdown - 1;
+    if (countdown == 0) {
+        countdown = FRAME.mux_period;
+        uint8_t ch_index = FRAME.mux_ch_index;
+        if (ch_index == FRAME.max_ch_index) {
+            ch_index = 0;
+        } else {
+            ++ch_index;
+        }
+        FRAME.mux_ch_index = ch_index;
+        // Make sure conversion `k + 1` latched the current channel. This is
+        // immediate in free-running mode. With timer 1 it takes the slack
+        // between a conversion and the next trigger, which `start` and `arm`
+        // keep within `MAX_PIPELINE_SLACK_CYCLES`. External clocks are never
+        // pipelined since their next edge may not come.
+        while (!(ADCSRA & (1 << ADSC))) {
+        }
+        activate_adc_channel(ch_index);
+    }
+    FRAME.mux_countdown = countdown;
+}
+
+/**
+ * Reset the pipelined mux cursor to the start of a slot. Called while
+ * dropping conversions so that the first conversion stored once a slot frees
+ * up (and the one after it) have latched the first channel.
+ */
+static inline void reset_mux_pipeline() {
+    FRAME.mux_ch_index = 0;
+    FRAME.mux_countdown = FRAME.mux_period - 1;
+    activate_adc_channel(0);
+}
+
+/**
+ * Account for a sample dropped because every slot is full. Only runs
+ * while the consumer is behind so it is kept out of the ISR's fast path.
+ */
+static inline void drop_sample() {
+    uint32_t dropped = FRAME.dropped;
+    uint32_t index = FRAME.collected + dropped;
+    uint16_t overruns = FRAME.overruns;
+    if (index != FRAME.gap_end) {
+        // New gap, log it if there is room
+        ++overruns;
+        FRAME.overruns = overruns;
+        if (overruns <= MAX_GAP_COUNT) {
+            FRAME.gaps[overruns - 1].index = index;
+            FRAME.gaps[overruns - 1].length = 0;
+        }
+    }
+    if (overruns <= MAX_GAP_COUNT) {
+        ++FRAME.gaps[overruns - 1].length;
+    }
+    FRAME.gap_end = index + 1;
+    FRAME.dropped = dropped + 1;
+}
+
+/**
+ * Stamp the completion of a slot. Only runs once per slot so it is kept out
+ * of the ISR's fast path.
+ */
+static inline void stamp_slot() {
+    Stamp stamp;
+    stamp.ticks = timebase::now_unlocked();
+    stamp.index = FRAME.collected + FRAME.dropped;
+    if (FRAME.nstamps++ == 0) {
+        FRAME.first_stamp = stamp;
+    }
+    FRAME.last_stamp = stamp;
+}
+
+/**
+ * Stamp the first sample stored after an armed edge. Only runs once so it is
+ * kept out of the ISR's fast path.
+ */
+static inline void stamp_first_sample() {
+    FRAME.first_ticks = timebase::now_unlocked();
+    FRAME.stamp_first = false;
+}
+
+/**
+ * Turn the sum of an oversampled sample's conversions into a signed 16-bit
+ * sample. Every 4x oversampling adds a bit of resolution, so the sum is
+ * shifted down by half the number of extra bits it has.
+ */
+static inline uint16_t decimate(uint16_t acc, BitResolution res) {
+    if (res == BitResolution::Eleven) {
+        return ((acc >> 1) - ELEVEN_BIT_BIAS) << 5;
+    }
+    // 12-bit is assumed here
+    return ((acc >> 2) - TWELVE_BIT_BIAS) << 4;
+}
+
+/**
+ * Body of the ADC interrupt service routine, responsible for reading samples
+ * from the ADC into the frame's buffers.
+ *
+ * Volatile frame members are loaded into locals once since nothing else can
+ * modify them while the ISR runs.
+ */
+template <typename Cfg>
+inline void isr_body() {
+    // 1) Immediately reenable the trigger so we don't miss a beat.
+    // Free-running conversions retrigger themselves and leave timer 1 alone.
+    if (Cfg::source() == AutotriggerSource::TimCnt1CmpB ||
+        Cfg::source() == AutotriggerSource::TimCnt1Cap) {
+        TIFR1 = UINT8_MAX;
+    } else if (Cfg::source() == AutotriggerSource::ExternalIrq0) {
+        EIFR = (1 << INTF0);
+    }
+
+    // 2) Check that we can actually perform work
+    if (Cfg::checked && !FRAME.active) {
+        return;
+    }
+
+    // 3) When oversampling, sum conversions until a sample is complete. Drops
+    // are counted in samples, so whether a sample is dropped is decided on its
+    // first conversion. The mux schedule is held while it is collected so the
+    // conversions after it still latch the first channel.
+    uint16_t oversampled = 0;
+    bool drop;
+    if (Cfg::oversample() > 1) {
+        uint8_t low = ADCL;
+        uint8_t high = ADCH;
+        uint16_t acc = FRAME.acc + ((high << CHAR_BIT) | low);
+        uint8_t countdown = FRAME.os_countdown;
+        drop = FRAME.os_drop;
+        if (countdown == Cfg::oversample()) {
+            // Slots are only ever freed by the consumer, so if there is room
+            // now there still will be once the sample is complete
+            drop = FRAME.full[FRAME.head];
+            FRAME.os_drop = drop;
+        }
+        if (--countdown != 0) {
+            FRAME.acc = acc;
+            FRAME.os_countdown = countdown;
+            if (Cfg::pipelined() && Cfg::max_ch_index() > 0 && !drop) {
+                advance_mux_pipeline();
+            }
+            return;
+        }
+        FRAME.acc = 0;
+        FRAME.os_countdown = Cfg::oversample();
+        oversampled = decimate(acc, Cfg::res());
+    } else {
+        drop = FRAME.full[FRAME.head];
+    }
+
+    if (drop) {
+        // Ring is full, consumer has not handed back the next slot yet
+        drop_sample();
+        if (Cfg::pipelined() && Cfg::max_ch_index() > 0) {
+            reset_mux_pipeline();
+        }
+        return;
+    }
+
+    // 4) Read the sample
+    size_t sample_index = FRAME.sample_index;
+    volatile uint8_t* ch_buffer = FRAME.ch_buffer;
+    if (Cfg::res() == BitResolution::Eight) {
+        ch_buffer[sample_index++] = ADCH;
+    } else {
+        uint16_t new_sample = oversampled;
+        if (Cfg::oversample() == 1) {
+            // 10-bit is assumed here
+            uint8_t low = ADCL;
+            uint8_t high = ADCH;
+            new_sample = TEN_TO_SIXTEEN_BIT((high << CHAR_BIT) | low);
+        }
+        ch_buffer[sample_index++] = new_sample & UINT8_MAX;
+        ch_buffer[sample_index++] = new_sample >> CHAR_BIT;
+    }
+    ++FRAME.collected;
+    if (Cfg::armable && FRAME.stamp_first) {
+        stamp_first_sample();
+    }
+
+    // 5) Program the mux ahead of time when pipelined. Otherwise the mux is
+    // switched below for the very next conversion.
+    const bool switch_now = Cfg::max_ch_index() > 0 && !Cfg::pipelined();
+    if (Cfg::pipelined() && Cfg::max_ch_index() > 0) {
+        advance_mux_pipeline();
+    }
+
+    // 6) Move to the next slot if we just filled the current one up
+    size_t ch_index = FRAME.ch_index;
+    if (sample_index == FRAME.ch_buf_sz && ch_index == Cfg::max_ch_index()) {
+        if (FRAME.stamping) {
+            stamp_slot();
+        }
+        uint8_t head = FRAME.head;
+        PROFILE_SLOT_FILLED(head, FRAME.collected + FRAME.dropped);
+        FRAME.full[head] = true;
+        // Every slot from the tail up to this one is full now
+        int8_t nfull = head - FRAME.tail;
+        if (nfull < 0) {
+            nfull += FRAME.nslots;
+        }
+        if (static_cast<uint8_t>(nfull) >= FRAME.high_water) {
+            FRAME.high_water = nfull + 1;
+        }
+        uint8_t* head_base;
+        if (++head == FRAME.nslots) {
+            head = 0;
+            head_base = FRAME.slots;
+        } else {
+            head_base = FRAME.head_base + FRAME.slot_sz;
+        }
+        FRAME.head = head;
+        FRAME.head_base = head_base;
+        FRAME.sample_index = 0;
+        FRAME.ch_index = 0;
+        FRAME.ch_buffer = head_base;
+        if (switch_now) {
+            activate_adc_channel(0);
+        }
+        return;
+    }
+
+    // 7) Swap channels if it is time to
+    if (Cfg::max_ch_index() > 0 && (sample_index & Cfg::window_mask()) == 0) {
+        if (ch_index == Cfg::max_ch_index()) {
+            ch_index = 0;
+        } else {
+            ++ch_index;
+            sample_index -= Cfg::window_sz();
+        }
+        if (switch_now) {
+            activate_adc_channel(ch_index);
+        }
+        FRAME.ch_buffer = FRAME.head_base + ch_index * FRAME.ch_buf_sz;
+        FRAME.ch_index = ch_index;
+    }
+    FRAME.sample_index = sample_index;
+}
+
+/**
+ * Start ADC sampling with a configuration known at compile time. Must be
+ * used instead of the runtime `start` when the application installs a
+ * dedicated ISR with `ADC_STATIC_ISR(Cfg)`.
+ *
+ * @param sample_rate: Sample rate in Hz to try and record at.
+ * @param warmup_ms: Milliseconds to delay after starting ADC before
+ * ingesting samples.
+ *
+ * @returns (int8_t): Return code. 0 if all is good, negative otherwise.
+ * -4 indicates the configuration's channel count does not match `init`.
+ */
+template <typename Cfg>
+int8_t start(uint32_t sample_rate, uint32_t warmup_ms = 100) {
+    static_assert(Cfg::source() == AutotriggerSource::TimCnt1CmpB,
+                  "Use start_free_running or start_external for other "
+                  "triggers");
+    if (nchannels() != Cfg::nchannels) {
+        return -4;
+    }
+    return start(Cfg::res(), sample_rate, Cfg::window_samples, warmup_ms,
+                 Cfg::is_pipelined);
+}
+
+/**
+ * Start free-running ADC sampling with a configuration known at compile
+ * time. Must be used instead of the runtime `start_free_running` when the
+ * application installs a dedicated ISR with `ADC_STATIC_ISR(Cfg)`.
+ *
+ * @param prescaler: ADC clock prescaler (2 - 128).
+ * @param warmup_ms: Milliseconds to delay after starting ADC before
+ * ingesting samples.
+ *
+ * @returns (int8_t): Return code. 0 if all is good, negative otherwise.
+ * -4 indicates the configuration's channel count does not match `init`.
+ */
+template <typename Cfg>
+int8_t start_free_running(pre_t prescaler, uint32_t warmup_ms = 100) {
+    static_assert(Cfg::source() == AutotriggerSource::FreeRunning,
+                  "Use start for timer triggered configurations");
+    if (nchannels() != Cfg::nchannels) {
+        return -4;
+    }
+    return start_free_running(Cfg::res(), prescaler, Cfg::window_samples,
+                              warmup_ms);
+}
+
+/**
+ * Start ADC sampling clocked by an external clock with a configuration
+ * known at compile time. Must be used instead of the runtime
+ * `start_external` when the application installs a dedicated ISR with
+ * `ADC_STATIC_ISR(Cfg)`.
+ *
+ * @param sample_rate: Per-channel sample rate in Hz the clock works out to.
+ * @param edge: Edge of the clock to convert on.
+ * @param warmup_ms: Milliseconds to delay after starting ADC before
+ * ingesting samples.
+ *
+ * @returns (int8_t): Return code. 0 if all is good, negative otherwise.
+ * -4 indicates the configuration's channel count does not match `init`.
+ */
+template <typename Cfg>
+int8_t start_external(uint32_t sample_rate, Edge edge = Edge::Rising,
+                      uint32_t warmup_ms = 100) {
+    static_assert(Cfg::source() == AutotriggerSource::TimCnt1Cap ||
+                      Cfg::source() == AutotriggerSource::ExternalIrq0,
+                  "Use start or start_free_running for internal triggers");
+    if (nchannels() != Cfg::nchannels) {
+        return -4;
+    }
+    return start_external(Cfg::res(), sample_rate, Cfg::source(), edge,
+                          Cfg::window_samples, warmup_ms);
+}
+
+}  // namespace adc
+
+/**
+ * Define the ADC interrupt vector with a body dedicated to a compile-time
+ * configuration (`adc::StaticConfig`). Overrides the library's weak runtime
+ * ISR. Use at file scope in exactly one translation unit.
+ */
+#define ADC_STATIC_ISR(...)           \
+    ISR(ADC_vect) {                   \
+        PROFILE_ISR_ENTER();          \
+        adc::isr_body<__VA_ARGS__>(); \
+        PROFILE_ISR_EXIT();           \
+    }
@@ -0,0 +1,151 @@
+#include "Adpcm.h"
+
+#include <Arduino.h>
+#include <avr/pgmspace.h>
+#include <limits.h>
+
+namespace adpcm {
+
+// Samples copied aside before output starts overwriting the input buffer
+#define LOOKAHEAD_SAMPLES 8
+
+#define MAX_STEP_INDEX 88
+#define SIGN_BIT 0b1000
+#define MAGNITUDE_MASK 0b0111
+#define NIBBLE_BITS 4
+
+static const int16_t STEP_TABLE[MAX_STEP_INDEX + 1] PROGMEM = {
+    7,     8,     9,     10,    11,    12,    13,    14,    16,    17,
+    19,    21,    23,    25,    28,    31,    34,    37,    41,    45,
+    50,    55,    60,    66,    73,    80,    88,    97,    107,   118,
+    130,   143,   157,   173,   190,   209,   230,   253,   279,   307,
+    337,   371,   408,   449,   494,   544,   598,   658,   724,   796,
+    876,   963,   1060,  1166,  1282,  1411,  1552,  1707,  1878,  2066,
+    2272,  2499,  2749,  3024,  3327,  3660,  4026,  4428,  4871,  5358,
+    5894,  6484,  7132,  7845,  8630,  9493,  10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767};
+
+static const int8_t INDEX_TABLE[MAGNITUDE_MASK + 1] = {-1, -1, -1, -1,
+                                                        2,  4,  6,  8};
+
+/**
+ * Read sample `i` from an ADC buffer as a signed 16-bit value.
+ */
+static inline int16_t read_sample(const uint8_t* buf, size_t i,
+                                  BitResolution res) {
+    if (res == BitResolution::Eight) {
+        // Multiplied rather than shifted, since shifting a negative value
+        // left is undefined
+        return static_cast<int16_t>((buf[i] - 0x80) * 256);
+    }
+    // The ISR already centres `Ten` samples on 0 and scales them to 16 bits
+    // (`TEN_TO_SIXTEEN_BIT`), as `decimate` does oversampled ones, so
+    // centring them again here would offset every sample by half the range.
+    // Widened first, since the high byte shifted as an `int` may overflow it
+    return static_cast<int16_t>(
+        buf[2 * i] | (static_cast<uint16_t>(buf[2 * i + 1]) << CHAR_BIT));
+}
+
+void Encoder::reset() {
+    predictor = 0;
+    index = 0;
+    pending = 0;
+    has_pending = false;
+    block_pos = 0;
+    nsamples = 0;
+}
+
+uint8_t Encoder::encode_sample(int16_t sample) {
+    int16_t step = pgm_read_word(&STEP_TABLE[index]);
+    int32_t diff = static_cast<int32_t>(sample) - predictor;
+    uint8_t code = 0;
+    if (diff < 0) {
+        code = SIGN_BIT;
+        diff = -diff;
+    }
+    // Successive approximation of diff / step in 3 bits, accumulating the
+    // value the decoder will reconstruct as it goes
+    int32_t delta = step >> 3;
+    if (diff >= step) {
+        code |= 0b100;
+        diff -= step;
+        delta += step;
+    }
+    step >>= 1;
+    if (diff >= step) {
+        code |= 0b010;
+        diff -= step;
+        delta += step;
+    }
+    step >>= 1;
+    if (diff >= step) {
+        code |= 0b001;
+        delta += step;
+    }
+
+    int32_t predicted = predictor;
+    predicted += (code & SIGN_BIT) ? -delta : delta;
+    if (predicted > INT16_MAX) {
+        predicted = INT16_MAX;
+    } else if (predicted < INT16_MIN) {
+        predicted = INT16_MIN;
+    }
+    predictor = predicted;
+
+    int8_t next_index = index + INDEX_TABLE[code & MAGNITUDE_MASK];
+    if (next_index < 0) {
+        next_index = 0;
+    } else if (next_index > MAX_STEP_INDEX) {
+        next_index = MAX_STEP_INDEX;
+    }
+    index = next_index;
+    return code;
+}
+
+size_t Encoder::encode(uint8_t* buf, size_t sz, BitResolution res) {
+    const size_t nsamples_in = sz / adc::bytes_per_sample(res);
+    int16_t lookahead[LOOKAHEAD_SAMPLES];
+    const size_t nlookahead = min(nsamples_in, (size_t)LOOKAHEAD_SAMPLES);
+    for (size_t i = 0; i < nlookahead; ++i) {
+        lookahead[i] = read_sample(buf, i, res);
+    }
+
+    uint8_t* out = buf;
+    for (size_t i = 0; i < nsamples_in; ++i) {
+        int16_t sample =
+            i < nlookahead ? lookahead[i] : read_sample(buf, i, res);
+        if (block_pos == 0) {
+            // Block header: first sample verbatim and the current step index
+            predictor = sample;
+            *out++ = static_cast<uint16_t>(sample) & UINT8_MAX;
+            *out++ = static_cast<uint16_t>(sample) >> CHAR_BIT;
+            *out++ = index;
+            *out++ = 0;
+        } else {
+            uint8_t code = encode_sample(sample);
+            if (has_pending) {
+                *out++ = pending | (code << NIBBLE_BITS);
+                has_pending = false;
+            } else {
+                pending = code;
+                has_pending = true;
+            }
+        }
+        if (++block_pos == SAMPLES_PER_BLOCK) {
+            block_pos = 0;
+        }
+    }
+    nsamples += nsamples_in;
+    return out - buf;
+}
+
+size_t Encoder::flush(uint8_t* out) {
+    if (!has_pending) {
+        return 0;
+    }
+    *out = pending;
+    has_pending = false;
+    return 1;
+}
+
+}  // namespace adpcm
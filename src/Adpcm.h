@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Adc.h"
+
+using adc::BitResolution;
+
+namespace adpcm {
+
+/**
+ * Size in bytes of each IMA ADPCM block (mono). Each block starts with a
+ * 4-byte header holding the first sample verbatim followed by 4-bit codes.
+ */
+const size_t BLOCK_SZ = 512;
+
+/**
+ * Size in bytes of the header at the start of each block.
+ */
+const size_t BLOCK_HEADER_SZ = 4;
+
+/**
+ * Number of samples in each (full) block. The header sample plus 2 samples
+ * for every remaining byte.
+ */
+const uint16_t SAMPLES_PER_BLOCK = 2 * (BLOCK_SZ - BLOCK_HEADER_SZ) + 1;
+
+/**
+ * Streaming IMA ADPCM encoder for a single channel.
+ *
+ * Produces the Microsoft (`WAVE_FORMAT_IMA_ADPCM`) block layout, where codes
+ * are packed low nibble first. Blocks are independent of the buffers passed
+ * to `encode`, so one encoder must be used per channel for a whole
+ * recording.
+ */
+struct Encoder {
+    /* !< Predicted value of the last sample */
+    int16_t predictor;
+    /* !< Index into the step size table */
+    uint8_t index;
+    /* !< Code waiting for a second one to fill a byte */
+    uint8_t pending;
+    /* !< Flag for whether `pending` holds a code */
+    bool has_pending;
+    /* !< Number of samples encoded into the current block */
+    uint16_t block_pos;
+    /* !< Number of samples encoded so far */
+    uint32_t nsamples;
+
+    Encoder() { reset(); }
+
+    /**
+     * Reset the encoder to start a new stream.
+     */
+    void reset();
+
+    /**
+     * Encode a buffer of samples from the ADC in place.
+     *
+     * The first few samples are copied aside before any output is written,
+     * after which output never catches up to the samples still being read.
+     *
+     * @param buf: Buffer of samples as handed out by `adc::swap_buffer`.
+     * @param sz: Size of `buf` in bytes.
+     * @param res: Bit resolution samples were collected at. Anything but
+     * `TenPacked`. 8-bit samples are centred on 0 and scaled to 16 bits
+     * before they are encoded, which the ISR has already done for the rest.
+     *
+     * @returns (size_t): Number of encoded bytes written to the start of
+     * `buf`.
+     */
+    size_t encode(uint8_t* buf, size_t sz, BitResolution res);
+
+    /**
+     * Write out a code left over from the last call to `encode`, padding the
+     * byte it goes in. Used when the stream ends.
+     *
+     * @param out: Destination for at most one byte.
+     *
+     * @returns (size_t): Number of bytes written to `out`.
+     */
+    size_t flush(uint8_t* out);
+
+   private:
+    uint8_t encode_sample(int16_t sample);
+};
+
+}  // namespace adpcm
@@ -0,0 +1,70 @@
+#include "Frame.h"
+
+#include <Arduino.h>
+
+namespace frame {
+
+#define CRC_SZ 2
+
+static struct {
+    uint32_t session = 0;
+    /* !< Sequence number of the next block */
+    uint32_t seq = 0;
+} STREAM;
+
+size_t payload_capacity(BitResolution res) {
+    size_t capacity = uart::MAX_FRAME_SZ - CRC_SZ - sizeof(BlockHeader);
+    if (res == BitResolution::TenPacked) {
+        return capacity - capacity % adc::PACKED_GROUP_SZ;
+    }
+    return capacity - capacity % adc::bytes_per_sample(res);
+}
+
+int8_t begin(uint8_t nchannels, BitResolution res, uint32_t sample_rate) {
+    STREAM.session = micros();
+    STREAM.seq = 0;
+    SessionHeader hdr;
+    hdr.num_channels = nchannels;
+    hdr.resolution = static_cast<uint8_t>(res);
+    hdr.session = STREAM.session;
+    hdr.sample_rate = sample_rate;
+    return uart::send(&hdr, sizeof(hdr), nullptr, 0) == 0 ? 0 : -1;
+}
+
+int8_t send(uint8_t ch_index, uint32_t sample_index, BitResolution res,
+            const uint8_t* buf, size_t sz) {
+    size_t capacity = payload_capacity(res);
+    BlockHeader hdr;
+    hdr.ch_index = ch_index;
+    hdr.sample_index = sample_index;
+    while (sz > 0) {
+        size_t n = min(sz, capacity);
+        hdr.seq = STREAM.seq++;
+        if (uart::send(&hdr, sizeof(hdr), buf, n) != 0) {
+            return -1;
+        }
+        hdr.sample_index += adc::buffer_samples(res, n);
+        buf += n;
+        sz -= n;
+    }
+    return 0;
+}
+
+int8_t end(uint32_t sample_rate) {
+    Trailer trailer;
+    trailer.session = STREAM.session;
+    trailer.nblocks = STREAM.seq;
+    trailer.sample_rate = sample_rate;
+    trailer.collected = adc::collected();
+    trailer.dropped = adc::dropped();
+    trailer.overruns = adc::overruns();
+    trailer.ngaps = adc::gaps(trailer.gaps, adc::MAX_GAP_COUNT);
+    size_t unused = (adc::MAX_GAP_COUNT - trailer.ngaps) * sizeof(adc::Gap);
+    if (uart::send(&trailer, sizeof(trailer) - unused, nullptr, 0) != 0) {
+        return -1;
+    }
+    uart::flush();
+    return 0;
+}
+
+}  // namespace frame
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Adc.h"
+#include "Uart.h"
+
+using adc::BitResolution;
+
+/**
+ * Layout of recordings streamed over a serial link by `recording::FrameSink`,
+ * one `uart` frame at a time.
+ *
+ * A recording starts with a `SessionHeader` frame, followed by `BlockHeader`
+ * frames carrying up to `payload_capacity` bytes of one channel's samples
+ * each, and ends with a `Trailer` frame. Every frame starts with its `Type`.
+ * See `scripts/recordings/receive_stream.py` for turning a stream back into
+ * WAV files.
+ */
+namespace frame {
+
+/**
+ * Format version.
+ */
+const uint8_t VERSION = 1;
+
+/**
+ * What a frame holds.
+ */
+enum struct Type : uint8_t {
+    Session = 'S', /* !< `SessionHeader` */
+    Block = 'B',   /* !< `BlockHeader` followed by samples */
+    End = 'E',     /* !< `Trailer` */
+};
+
+/**
+ * First frame of a recording.
+ */
+struct SessionHeader {
+    /**
+     * Frame type.
+     */
+    const Type type = Type::Session;
+    /**
+     * Format version.
+     */
+    const uint8_t version = VERSION;
+    /**
+     * Number of channels.
+     */
+    uint8_t num_channels = 0;
+    /**
+     * `BitResolution` samples were recorded at.
+     */
+    uint8_t resolution = 0;
+    /**
+     * Identifier of the recording, repeated in its trailer.
+     */
+    uint32_t session = 0;
+    /**
+     * Requested sample rate for each channel in hertz.
+     */
+    uint32_t sample_rate = 0;
+};
+
+/**
+ * Start of every frame holding samples.
+ */
+struct BlockHeader {
+    /**
+     * Frame type.
+     */
+    const Type type = Type::Block;
+    /**
+     * Channel the samples are from.
+     */
+    uint8_t ch_index = 0;
+    /**
+     * Unused.
+     */
+    uint16_t reserved = 0;
+    /**
+     * Number of the frame within the recording, counting from 0 across all
+     * channels. Frames are sent in order, so any skip means frames were lost.
+     */
+    uint32_t seq = 0;
+    /**
+     * Index of the frame's first sample among the samples stored for its
+     * channel. Samples dropped by the ADC are not counted, see
+     * `Trailer::gaps` for where they were.
+     */
+    uint32_t sample_index = 0;
+};
+
+/**
+ * Last frame of a recording, sent once it is over. Only the first `ngaps`
+ * entries of `gaps` are sent.
+ */
+struct Trailer {
+    /**
+     * Frame type.
+     */
+    const Type type = Type::End;
+    /**
+     * Number of entries used in `gaps`.
+     */
+    uint8_t ngaps = 0;
+    /**
+     * Number of separate overrun events.
+     */
+    uint16_t overruns = 0;
+    /**
+     * Identifier of the recording (see `SessionHeader::session`).
+     */
+    uint32_t session = 0;
+    /**
+     * Number of frames holding samples.
+     */
+    uint32_t nblocks = 0;
+    /**
+     * Per-channel sample rate which was achieved in hertz, or 0 if the
+     * recording failed.
+     */
+    uint32_t sample_rate = 0;
+    /**
+     * Samples stored across all channels.
+     */
+    uint32_t collected = 0;
+    /**
+     * Samples dropped across all channels.
+     */
+    uint32_t dropped = 0;
+    /**
+     * Gap log of the ADC (see `adc::gaps`).
+     */
+    adc::Gap gaps[adc::MAX_GAP_COUNT];
+};
+
+/**
+ * @returns (size_t): Most sample bytes a frame can hold at a bit resolution.
+ * Always a whole number of samples (or groups of packed samples).
+ */
+size_t payload_capacity(BitResolution res);
+
+/**
+ * Start a recording by sending its `SessionHeader`. `uart` must be running.
+ *
+ * @param nchannels: Number of channels.
+ * @param res: Bit resolution samples are recorded at.
+ * @param sample_rate: Requested sample rate for each channel.
+ *
+ * @returns (int8_t): 0 if the header was queued. -1 indicates the
+ * transmitter is not running.
+ */
+int8_t begin(uint8_t nchannels, BitResolution res, uint32_t sample_rate);
+
+/**
+ * Send a buffer of one channel's samples, split into as many frames as it
+ * takes.
+ *
+ * @param ch_index: Channel the samples are from.
+ * @param sample_index: Index of the buffer's first sample among the samples
+ * sent for the channel.
+ * @param res: Bit resolution of samples.
+ * @param buf: Samples as the ADC handed them out.
+ * @param sz: Size of `buf`.
+ *
+ * @returns (int8_t): 0 if every frame was queued. -1 indicates the
+ * transmitter is not running.
+ */
+int8_t send(uint8_t ch_index, uint32_t sample_index, BitResolution res,
+            const uint8_t* buf, size_t sz);
+
+/**
+ * End the recording by sending its `Trailer`, with the ADC's counters and
+ * gap log, and wait for it to go out.
+ *
+ * @param sample_rate: Per-channel sample rate which was achieved, or 0 if it
+ * is not known.
+ *
+ * @returns (int8_t): 0 if the trailer was sent. -1 indicates the transmitter
+ * is not running.
+ */
+int8_t end(uint32_t sample_rate);
+
+}  // namespace frame
@@ -0,0 +1,112 @@
+#include "Level.h"
+
+#include <Arduino.h>
+
+namespace level {
+
+// 8-bit samples are unsigned, centered on this
+#define EIGHT_BIT_BIAS 0x80
+
+/**
+ * Integer square root, rounded down.
+ */
+static uint16_t isqrt(uint32_t x) {
+    uint32_t root = 0;
+    for (uint32_t bit = 1ul << 30; bit != 0; bit >>= 2) {
+        if (x >= root + bit) {
+            x -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+    }
+    return root;
+}
+
+/**
+ * Square of an 8-bit value, without overflowing a 16-bit `int`.
+ */
+static inline uint16_t square(uint8_t x) {
+    return static_cast<uint16_t>(x) * x;
+}
+
+/**
+ * Distance of a sample from the midpoint in 8-bit steps.
+ */
+static inline uint8_t distance_eight(uint8_t sample) {
+    return sample >= EIGHT_BIT_BIAS ? sample - EIGHT_BIT_BIAS
+                                    : EIGHT_BIT_BIAS - sample;
+}
+
+/**
+ * Distance of a sample from the midpoint in 16-bit units.
+ */
+static inline uint16_t distance_sixteen(const uint8_t* p) {
+    int16_t sample = static_cast<int16_t>(p[0] | (p[1] << 8));
+    return sample < 0 ? -static_cast<int32_t>(sample) : sample;
+}
+
+void analyze(const uint8_t* buf, size_t sz, BitResolution res, Level& out) {
+    uint16_t peak = 0;
+    uint16_t clipped = 0;
+    uint32_t sum_sq = 0;
+    size_t nsamples;
+    if (res == BitResolution::Eight) {
+        nsamples = sz;
+        uint8_t top = 0;
+        size_t i = 0;
+        // Unrolled by 4, the distances are the top 8 bits already
+        for (; i + 4 <= sz; i += 4) {
+            uint8_t d0 = distance_eight(buf[i]);
+            uint8_t d1 = distance_eight(buf[i + 1]);
+            uint8_t d2 = distance_eight(buf[i + 2]);
+            uint8_t d3 = distance_eight(buf[i + 3]);
+            sum_sq += square(d0);
+            sum_sq += square(d1);
+            sum_sq += square(d2);
+            sum_sq += square(d3);
+            top = max(top, max(max(d0, d1), max(d2, d3)));
+            clipped += (d0 >= (CLIP_LEVEL >> 8)) + (d1 >= (CLIP_LEVEL >> 8)) +
+                       (d2 >= (CLIP_LEVEL >> 8)) + (d3 >= (CLIP_LEVEL >> 8));
+        }
+        for (; i < sz; ++i) {
+            uint8_t d = distance_eight(buf[i]);
+            sum_sq += square(d);
+            top = max(top, d);
+            clipped += d >= (CLIP_LEVEL >> 8);
+        }
+        peak = top << 8;
+    } else {
+        nsamples = sz / 2;
+        size_t i = 0;
+        for (; i + 8 <= sz; i += 8) {
+            uint16_t d0 = distance_sixteen(buf + i);
+            uint16_t d1 = distance_sixteen(buf + i + 2);
+            uint16_t d2 = distance_sixteen(buf + i + 4);
+            uint16_t d3 = distance_sixteen(buf + i + 6);
+            uint8_t h0 = d0 >> 8;
+            uint8_t h1 = d1 >> 8;
+            uint8_t h2 = d2 >> 8;
+            uint8_t h3 = d3 >> 8;
+            sum_sq += square(h0);
+            sum_sq += square(h1);
+            sum_sq += square(h2);
+            sum_sq += square(h3);
+            peak = max(peak, max(max(d0, d1), max(d2, d3)));
+            clipped += (d0 >= CLIP_LEVEL) + (d1 >= CLIP_LEVEL) +
+                       (d2 >= CLIP_LEVEL) + (d3 >= CLIP_LEVEL);
+        }
+        for (; i + 2 <= sz; i += 2) {
+            uint16_t d = distance_sixteen(buf + i);
+            uint8_t h = d >> 8;
+            sum_sq += square(h);
+            peak = max(peak, d);
+            clipped += d >= CLIP_LEVEL;
+        }
+    }
+    out.peak = peak;
+    out.rms = nsamples == 0 ? 0 : isqrt(sum_sq / nsamples) << 8;
+    out.clipped = clipped;
+}
+
+}  // namespace level
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Adc.h"
+
+using adc::BitResolution;
+
+/**
+ * Cheap level analysis of ADC buffers, for gating silent blocks out of
+ * recordings.
+ *
+ * Levels are measured in 16-bit units as distances from the midpoint, so
+ * 8-bit samples count 256 per step. Only the top 8 bits of each sample are
+ * squared for the RMS, which keeps the sums in 32 bits and the multiplies to
+ * a single hardware multiply on AVR.
+ *
+ * Blocks gated out of a recording are listed in a sidecar file: a
+ * `SilenceHeader` followed by a `SilenceRun` for every run of silent blocks.
+ * See `scripts/recordings/expand_silence.py`.
+ */
+namespace level {
+
+/**
+ * Distance from the midpoint a sample is counted as clipped at. Any sample
+ * within one 8-bit step of either rail.
+ */
+const uint16_t CLIP_LEVEL = 0x7F00;
+
+/**
+ * Level of a block of samples.
+ */
+struct Level {
+    /* !< Largest distance of a sample from the midpoint */
+    uint16_t peak;
+    /* !< Root mean square distance from the midpoint */
+    uint16_t rms;
+    /* !< Number of samples at `CLIP_LEVEL` or beyond */
+    uint16_t clipped;
+};
+
+/**
+ * Measure the level of a buffer from the ADC.
+ *
+ * @param buf: Buffer handed out by the ADC.
+ * @param sz: Size of `buf` in bytes.
+ * @param res: Bit resolution samples were recorded at. Not `TenPacked`.
+ * @param out: Out-parameter for the level.
+ */
+void analyze(const uint8_t* buf, size_t sz, BitResolution res, Level& out);
+
+/**
+ * Header at the start of every silence sidecar file.
+ */
+struct SilenceHeader {
+    /**
+     * File identifier ("CHRS").
+     */
+    const char magic[4] = {'C', 'H', 'R', 'S'};
+    /**
+     * Format version.
+     */
+    const uint8_t version = 1;
+    /**
+     * Unused.
+     */
+    const uint8_t reserved[3] = {0, 0, 0};
+};
+
+/**
+ * Run of samples left out of a recording because they were silent.
+ */
+struct SilenceRun {
+    /**
+     * Index of the first sample left out, counting every sample of the
+     * channel including the ones left out before it.
+     */
+    uint32_t start;
+    /**
+     * Number of samples left out.
+     */
+    uint32_t length;
+};
+
+}  // namespace level
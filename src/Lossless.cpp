@@ -0,0 +1,262 @@
+#include "Lossless.h"
+
+#include <Arduino.h>
+#include <limits.h>
+#include <string.h>
+
+namespace lossless {
+
+// Samples collected at more than 8 bits are shifted up to 16 bits by the ISR,
+// so the bottom bits are always 0
+#define SIXTEEN_BITS 16
+#define EIGHT_BIT_BIAS 0x80
+
+#define MAX_PARAM ((1 << PARAM_BITS) - 1)
+#define ESCAPE_BITS 16
+
+/**
+ * Writes a bitstream most significant bit first.
+ */
+struct BitWriter {
+    uint8_t* pos;
+    uint8_t* end;
+    uint8_t acc;
+    uint8_t nbits;
+    bool overflow;
+
+    BitWriter(uint8_t* out, uint8_t* out_end)
+        : pos(out), end(out_end), acc(0), nbits(0), overflow(false) {}
+
+    inline void emit() {
+        // Keep going after overflowing so the caller only checks once in a
+        // while, the output is thrown away anyways
+        if (pos == end) {
+            overflow = true;
+        } else {
+            *pos++ = acc;
+        }
+        acc = 0;
+        nbits = 0;
+    }
+
+    /**
+     * Write the low `n` (<= 16) bits of `value`.
+     */
+    inline void put(uint16_t value, uint8_t n) {
+        while (n > 0) {
+            uint8_t take = CHAR_BIT - nbits;
+            if (take > n) {
+                take = n;
+            }
+            n -= take;
+            uint8_t bits = (value >> n) & ((1 << take) - 1);
+            acc = (acc << take) | bits;
+            nbits += take;
+            if (nbits == CHAR_BIT) {
+                emit();
+            }
+        }
+    }
+
+    inline void put_zeros(uint8_t n) {
+        while (n > 0) {
+            uint8_t take = CHAR_BIT - nbits;
+            if (take > n) {
+                take = n;
+            }
+            n -= take;
+            acc <<= take;
+            nbits += take;
+            if (nbits == CHAR_BIT) {
+                emit();
+            }
+        }
+    }
+
+    /**
+     * Pad the last partial byte with zeros and write it out.
+     */
+    inline void flush() {
+        if (nbits > 0) {
+            acc <<= CHAR_BIT - nbits;
+            emit();
+        }
+    }
+};
+
+/**
+ * @returns (uint8_t): Number of significant bits in each sample.
+ */
+static inline uint8_t significant_bits(BitResolution res) {
+    switch (res) {
+        case BitResolution::Eight:
+            return 8;
+        case BitResolution::Eleven:
+            return 11;
+        case BitResolution::Twelve:
+            return 12;
+        default:
+            return 10;
+    }
+}
+
+/**
+ * Read sample `i` from an ADC buffer with only its significant bits.
+ */
+static inline int16_t read_sample(const uint8_t* buf, size_t i,
+                                  BitResolution res) {
+    if (res == BitResolution::Eight) {
+        return static_cast<int16_t>(buf[i]) - EIGHT_BIT_BIAS;
+    }
+    // Widened first, since the high byte shifted as an `int` may overflow it
+    int16_t sample = static_cast<int16_t>(
+        buf[2 * i] | (static_cast<uint16_t>(buf[2 * i + 1]) << CHAR_BIT));
+    return sample >> (SIXTEEN_BITS - significant_bits(res));
+}
+
+/**
+ * Prediction residual of sample `i` (`i` >= `order`) for a fixed predictor.
+ */
+static inline int16_t residual(const uint8_t* buf, size_t i, uint8_t order,
+                               BitResolution res) {
+    int16_t sample = read_sample(buf, i, res);
+    switch (order) {
+        case 0:
+            return sample;
+        case 1:
+            return sample - read_sample(buf, i - 1, res);
+        default:
+            return sample - 2 * read_sample(buf, i - 1, res) +
+                   read_sample(buf, i - 2, res);
+    }
+}
+
+/**
+ * Map signed residuals to unsigned values (0, -1, 1, -2, ...).
+ */
+static inline uint16_t zigzag(int16_t value) {
+    return (static_cast<uint16_t>(value) << 1) ^
+           static_cast<uint16_t>(value >> 15);
+}
+
+/**
+ * Pick the fixed predictor order with the smallest total absolute residual.
+ */
+static uint8_t best_order(const uint8_t* buf, size_t nsamples,
+                          BitResolution res) {
+    if (nsamples <= MAX_ORDER) {
+        return 0;
+    }
+    uint32_t totals[MAX_ORDER + 1] = {0};
+    int16_t prev2 = read_sample(buf, 0, res);
+    int16_t prev1 = read_sample(buf, 1, res);
+    for (size_t i = MAX_ORDER; i < nsamples; ++i) {
+        int16_t sample = read_sample(buf, i, res);
+        int16_t e0 = sample;
+        int16_t e1 = sample - prev1;
+        int16_t e2 = e1 - (prev1 - prev2);
+        totals[0] += abs(e0);
+        totals[1] += abs(e1);
+        totals[2] += abs(e2);
+        prev2 = prev1;
+        prev1 = sample;
+    }
+    uint8_t order = 0;
+    for (uint8_t i = 1; i <= MAX_ORDER; ++i) {
+        if (totals[i] < totals[order]) {
+            order = i;
+        }
+    }
+    return order;
+}
+
+void FileHeader::fill(BitResolution res, uint32_t sample_rate,
+                      uint32_t nsamples) {
+    this->bits_per_sample = significant_bits(res);
+    this->sample_rate = sample_rate;
+    this->sample_length = nsamples;
+}
+
+void raw_header(BlockHeader& hdr, size_t sz, BitResolution res) {
+    hdr.method = static_cast<uint8_t>(Method::Raw);
+    hdr.order = 0;
+    hdr.nsamples = sz / adc::bytes_per_sample(res);
+    hdr.size = sz;
+}
+
+size_t encode(const uint8_t* in, size_t sz, BitResolution res, uint8_t* out,
+              size_t out_sz, uint32_t budget_us) {
+    const uint32_t begin = micros();
+    const size_t nsamples = sz / adc::bytes_per_sample(res);
+    // Anything at least as big as the raw block is not worth keeping
+    size_t limit = sizeof(BlockHeader) + sz - 1;
+    if (out_sz < limit) {
+        limit = out_sz;
+    }
+    if (nsamples == 0 || limit <= sizeof(BlockHeader)) {
+        return 0;
+    }
+
+    BlockHeader hdr;
+    hdr.method = static_cast<uint8_t>(Method::Rice);
+    hdr.order = best_order(in, nsamples, res);
+    hdr.nsamples = nsamples;
+    BitWriter bits(out + sizeof(BlockHeader), out + limit);
+
+    // Warmup samples are stored verbatim
+    for (size_t i = 0; i < hdr.order; ++i) {
+        bits.put(static_cast<uint16_t>(read_sample(in, i, res)), ESCAPE_BITS);
+    }
+
+    for (size_t start = 0; start < nsamples; start += PARTITION_SAMPLES) {
+        if (budget_us != 0 && micros() - begin > budget_us) {
+            return 0;
+        }
+        size_t first = start < hdr.order ? hdr.order : start;
+        size_t last = start + PARTITION_SAMPLES;
+        if (last > nsamples) {
+            last = nsamples;
+        }
+        if (first >= last) {
+            continue;
+        }
+
+        // Rice parameter close to log2 of the mean residual
+        uint32_t total = 0;
+        for (size_t i = first; i < last; ++i) {
+            total += zigzag(residual(in, i, hdr.order, res));
+        }
+        const uint32_t count = last - first;
+        uint8_t k = 0;
+        while (k < MAX_PARAM && (count << (k + 1)) <= total) {
+            ++k;
+        }
+        bits.put(k, PARAM_BITS);
+
+        for (size_t i = first; i < last; ++i) {
+            uint16_t value = zigzag(residual(in, i, hdr.order, res));
+            uint16_t quotient = value >> k;
+            if (quotient >= ESCAPE_QUOTIENT) {
+                bits.put_zeros(ESCAPE_QUOTIENT);
+                bits.put(value, ESCAPE_BITS);
+            } else {
+                bits.put_zeros(quotient);
+                bits.put(1, 1);
+                bits.put(value & ((1 << k) - 1), k);
+            }
+        }
+        if (bits.overflow) {
+            return 0;
+        }
+    }
+    bits.flush();
+    if (bits.overflow) {
+        return 0;
+    }
+
+    hdr.size = bits.pos - (out + sizeof(BlockHeader));
+    memcpy(out, &hdr, sizeof(hdr));
+    return sizeof(hdr) + hdr.size;
+}
+
+}  // namespace lossless
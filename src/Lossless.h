@@ -0,0 +1,141 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Adc.h"
+
+using adc::BitResolution;
+
+/**
+ * Lossless block codec for ADC buffers, in the spirit of FLAC.
+ *
+ * Each block (one channel buffer) is predicted with the best of the fixed
+ * polynomial predictors of order 0 - 2 and the residuals are Rice coded, with
+ * the Rice parameter chosen separately for every partition of the block.
+ * Blocks which would not shrink, or which could not be encoded within a time
+ * budget, are stored raw instead so the main loop never falls behind.
+ *
+ * File layout: a `FileHeader`, then for every block a `BlockHeader` followed
+ * by `size` bytes of payload. See `scripts/recordings/decode_lossless.py`.
+ */
+namespace lossless {
+
+/**
+ * Number of samples sharing a Rice parameter.
+ */
+const size_t PARTITION_SAMPLES = 64;
+
+/**
+ * Highest fixed predictor order tried.
+ */
+const uint8_t MAX_ORDER = 2;
+
+/**
+ * Quotients at or above this are escaped, storing the value verbatim.
+ */
+const uint8_t ESCAPE_QUOTIENT = 24;
+
+/**
+ * Number of bits used to store each partition's Rice parameter.
+ */
+const uint8_t PARAM_BITS = 4;
+
+/**
+ * How a block's payload is stored.
+ */
+enum struct Method : uint8_t {
+    Raw = 0,  /* !< Samples exactly as they came from the ADC. */
+    Rice = 1, /* !< Fixed prediction with Rice coded residuals. */
+};
+
+/**
+ * Header at the start of every file.
+ */
+struct FileHeader {
+    /**
+     * File identifier ("CHRL").
+     */
+    const char magic[4] = {'C', 'H', 'R', 'L'};
+    /**
+     * Format version.
+     */
+    const uint8_t version = 1;
+    /**
+     * Significant bits per sample (8 - 12).
+     */
+    uint8_t bits_per_sample = 0;
+    /**
+     * Number of channels. Each recording gets its own file.
+     */
+    const uint16_t num_channels = 1;
+    /**
+     * Sampling rate in hertz. Filled in later.
+     */
+    uint32_t sample_rate = 0;
+    /**
+     * Number of samples to decode. Filled in later.
+     */
+    uint32_t sample_length = 0;
+
+    /**
+     * Fill in header fields once all details are known.
+     *
+     * @param res: Bit resolution of samples.
+     * @param sample_rate: Sample rate in hertz of the recording.
+     * @param nsamples: Number of samples to decode from the file.
+     */
+    void fill(BitResolution res, uint32_t sample_rate, uint32_t nsamples);
+};
+
+/**
+ * Header at the start of every block.
+ */
+struct BlockHeader {
+    /**
+     * `Method` the payload is stored with.
+     */
+    uint8_t method;
+    /**
+     * Fixed predictor order. Only meaningful for `Method::Rice`.
+     */
+    uint8_t order;
+    /**
+     * Number of samples in the block.
+     */
+    uint16_t nsamples;
+    /**
+     * Number of payload bytes following the header.
+     */
+    uint16_t size;
+};
+
+/**
+ * Fill in the header for a block stored raw.
+ *
+ * @param hdr: Header to fill.
+ * @param sz: Size of the block's samples in bytes.
+ * @param res: Bit resolution samples were collected at.
+ */
+void raw_header(BlockHeader& hdr, size_t sz, BitResolution res);
+
+/**
+ * Encode a buffer of samples from the ADC as a single block.
+ *
+ * @param in: Buffer of samples as handed out by `adc::swap_buffer`.
+ * @param sz: Size of `in` in bytes.
+ * @param res: Bit resolution samples were collected at. Anything but
+ * `TenPacked`.
+ * @param out: Destination for the block header and payload.
+ * @param out_sz: Capacity of `out`.
+ * @param budget_us: Microseconds encoding may take before giving up. 0 for
+ * no limit.
+ *
+ * @returns (size_t): Number of bytes written to `out`. 0 if the block did not
+ * fit, would not have been smaller than storing it raw, or ran out of time,
+ * in which case it should be written raw (see `raw_header`).
+ */
+size_t encode(const uint8_t* in, size_t sz, BitResolution res, uint8_t* out,
+              size_t out_sz, uint32_t budget_us);
+
+}  // namespace lossless
@@ -0,0 +1,185 @@
+#include "Profiler.h"
+
+#ifdef CHRISPY_PROFILE
+
+#include <string.h>
+
+namespace profiler {
+
+#define CS_DIV_1 (1 << CS40)
+
+Profile PROFILE;
+
+static struct {
+    uint8_t tccr4a;
+    uint8_t tccr4b;
+    uint8_t timsk4;
+} SAVED;
+
+static void print_linear(Print& out, const char* name,
+                         const LinearHistogram& h);
+static void print_log2(Print& out, const char* name, const Log2Histogram& h);
+
+void LinearHistogram::reset(int16_t origin, uint8_t shift) {
+    memset(bins, 0, sizeof(bins));
+    this->origin = origin;
+    this->shift = shift;
+    count = 0;
+    min = INT16_MAX;
+    max = INT16_MIN;
+}
+
+void Log2Histogram::reset() {
+    memset(bins, 0, sizeof(bins));
+    count = 0;
+    min = UINT32_MAX;
+    max = 0;
+}
+
+void Log2Histogram::add(uint32_t value) {
+    if (value < min) {
+        min = value;
+    }
+    if (value > max) {
+        max = value;
+    }
+    ++count;
+    uint8_t bits = 0;
+    while (value != 0) {
+        ++bits;
+        value >>= 1;
+    }
+    ++bins[bits];
+}
+
+void start(uint16_t period_cycles, uint8_t jitter_shift,
+           uint8_t duration_shift) {
+    if (PROFILE.active) {
+        stop();
+    }
+    PROFILE.period = period_cycles;
+    PROFILE.has_entry = false;
+    // Jitter is centered on 0, duration starts at 0
+    PROFILE.jitter.reset(-static_cast<int16_t>((NBINS / 2) << jitter_shift),
+                         jitter_shift);
+    PROFILE.duration.reset(0, duration_shift);
+    PROFILE.latency.reset();
+
+    cli();
+    SAVED.tccr4a = TCCR4A;
+    SAVED.tccr4b = TCCR4B;
+    SAVED.timsk4 = TIMSK4;
+
+    // Normal mode counting every CPU cycle, no interrupts
+    TCCR4A = 0;
+    TCCR4B = 0;
+    TIMSK4 = 0;
+    TCNT4 = 0;
+    TCCR4B = CS_DIV_1;
+    PROFILE.active = true;
+    sei();
+}
+
+void stop() {
+    if (!PROFILE.active) {
+        return;
+    }
+    cli();
+    PROFILE.active = false;
+    TCCR4A = SAVED.tccr4a;
+    TCCR4B = SAVED.tccr4b;
+    TIMSK4 = SAVED.timsk4;
+    sei();
+}
+
+bool running() { return PROFILE.active; }
+
+void slot_freed(uint8_t slot, uint32_t index) {
+    if (PROFILE.active) {
+        PROFILE.latency.add(index - PROFILE.filled_at[slot]);
+    }
+}
+
+void dump(Print& out) {
+    out.print(F("Nominal ISR period (cycles): "));
+    out.println(PROFILE.period);
+    print_linear(out, "ISR entry jitter (cycles)", PROFILE.jitter);
+    print_linear(out, "ISR duration (cycles)", PROFILE.duration);
+    if (PROFILE.duration.count > 0) {
+        out.print(F("Worst-case ISR headroom (cycles): "));
+        out.println(static_cast<int32_t>(PROFILE.period) -
+                    PROFILE.duration.max);
+    }
+    print_log2(out, "Consumer latency (samples)", PROFILE.latency);
+}
+
+/**
+ * Print the summary and every non-empty bin of a linear histogram.
+ */
+static void print_linear(Print& out, const char* name,
+                         const LinearHistogram& h) {
+    out.println(name);
+    out.print(F("  count: "));
+    out.println(h.count);
+    if (h.count == 0) {
+        return;
+    }
+    out.print(F("  min: "));
+    out.println(h.min);
+    out.print(F("  max: "));
+    out.println(h.max);
+    for (uint8_t i = 0; i < NBINS; ++i) {
+        if (h.bins[i] == 0) {
+            continue;
+        }
+        int32_t lo = h.origin + (static_cast<int32_t>(i) << h.shift);
+        int32_t hi = lo + (1 << h.shift) - 1;
+        out.print(F("  "));
+        if (i == 0) {
+            out.print(F("..."));
+        } else {
+            out.print(lo);
+        }
+        out.print(F(" to "));
+        if (i == NBINS - 1) {
+            out.print(F("..."));
+        } else {
+            out.print(hi);
+        }
+        out.print(F(": "));
+        out.println(h.bins[i]);
+    }
+}
+
+/**
+ * Print the summary and every non-empty bin of a log2 histogram.
+ */
+static void print_log2(Print& out, const char* name, const Log2Histogram& h) {
+    out.println(name);
+    out.print(F("  count: "));
+    out.println(h.count);
+    if (h.count == 0) {
+        return;
+    }
+    out.print(F("  min: "));
+    out.println(h.min);
+    out.print(F("  max: "));
+    out.println(h.max);
+    for (uint8_t i = 0; i <= NBINS; ++i) {
+        if (h.bins[i] == 0) {
+            continue;
+        }
+        uint32_t lo = i == 0 ? 0 : 1ul << (i - 1);
+        uint32_t hi = i == 0 ? 0 : (lo << 1) - 1;
+        out.print(F("  "));
+        out.print(lo);
+        out.print(F(" to "));
+        out.print(hi);
+        out.print(F(": "));
+        out.println(h.bins[i]);
+    }
+}
+
+}  // namespace profiler
+
+#endif
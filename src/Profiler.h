@@ -0,0 +1,244 @@
+#pragma once
+
+#include <Arduino.h>
+#include <stdint.h>
+
+#include "Adc.h"
+
+/**
+ * Opt-in profiler for the ADC ISR and the loop consuming its buffers.
+ *
+ * Only compiled in when `CHRISPY_PROFILE` is defined (e.g. with
+ * `-DCHRISPY_PROFILE` in the build flags). Otherwise every hook expands to
+ * nothing and the library behaves exactly as it does without the profiler.
+ *
+ * While running, the profiler reserves the 16-bit timer 4 counting at `F_CPU`
+ * and records into fixed-size histograms in RAM:
+ *
+ * - ISR entry jitter: Cycles between consecutive ISR entries minus the
+ *   nominal conversion period.
+ * - ISR duration: Cycles from entering to leaving the ISR body. Does not
+ *   include the compiler's register save/restore around it.
+ * - Consumer latency: Samples (across all channels, stored or dropped)
+ *   taken between the ISR filling a slot and the consumer handing it back.
+ *   Counting in samples keeps the ISR side to a single store, and compares
+ *   directly against the ring: slots must come back within `nslots - 1`
+ *   slots' worth of samples or samples get dropped.
+ *
+ * The histograms can be printed with `dump` once a session is over.
+ */
+namespace profiler {
+
+/**
+ * Number of bins in every histogram.
+ */
+const uint8_t NBINS = 32;
+
+/**
+ * Default log2 of the bin width for ISR entry jitter (cycles).
+ */
+const uint8_t JITTER_SHIFT = 2;
+
+/**
+ * Default log2 of the bin width for ISR duration (cycles).
+ */
+const uint8_t DURATION_SHIFT = 4;
+
+/**
+ * Histogram with equally sized bins. Values below the first bin or above the
+ * last bin are counted in them.
+ */
+struct LinearHistogram {
+    /* !< Lower bound of the first bin */
+    int16_t origin;
+    /* !< log2 of the width of each bin */
+    uint8_t shift;
+    /* !< Number of values in each bin */
+    uint32_t bins[NBINS];
+    /* !< Number of values recorded */
+    uint32_t count;
+    /* !< Smallest value recorded */
+    int16_t min;
+    /* !< Largest value recorded */
+    int16_t max;
+
+    /**
+     * Clear the histogram.
+     *
+     * @param origin: Lower bound of the first bin.
+     * @param shift: log2 of the width of each bin.
+     */
+    void reset(int16_t origin, uint8_t shift);
+
+    /**
+     * Record a value.
+     *
+     * @param value: Value to record.
+     */
+    inline void add(int16_t value) {
+        if (value < min) {
+            min = value;
+        }
+        if (value > max) {
+            max = value;
+        }
+        ++count;
+        int16_t offset = value - origin;
+        uint8_t bin;
+        if (offset < 0) {
+            bin = 0;
+        } else if ((offset >> shift) >= NBINS) {
+            bin = NBINS - 1;
+        } else {
+            bin = offset >> shift;
+        }
+        ++bins[bin];
+    }
+};
+
+/**
+ * Histogram with power-of-2 bins, where bin `i` holds values needing `i` bits
+ * (bin 0 holds 0, bin 1 holds 1, bin 2 holds 2-3, and so on).
+ */
+struct Log2Histogram {
+    /* !< Number of values in each bin */
+    uint32_t bins[NBINS + 1];
+    /* !< Number of values recorded */
+    uint32_t count;
+    /* !< Smallest value recorded */
+    uint32_t min;
+    /* !< Largest value recorded */
+    uint32_t max;
+
+    /**
+     * Clear the histogram.
+     */
+    void reset();
+
+    /**
+     * Record a value.
+     *
+     * @param value: Value to record.
+     */
+    void add(uint32_t value);
+};
+
+/**
+ * All profiling state.
+ */
+struct Profile {
+    /* !< Flag for whether the profiler is running */
+    bool active;
+    /* !< Nominal cycles between ISR entries */
+    uint16_t period;
+    /* !< Timer 4 count on the last ISR entry */
+    uint16_t last_entry;
+    /* !< Flag for whether `last_entry` is valid yet */
+    bool has_entry;
+    /* !< Sample index when each slot was filled */
+    uint32_t filled_at[adc::MAX_SLOT_COUNT];
+    /* !< ISR entry jitter (cycles) */
+    LinearHistogram jitter;
+    /* !< ISR duration (cycles) */
+    LinearHistogram duration;
+    /* !< Samples taken while slots were held by the consumer */
+    Log2Histogram latency;
+};
+
+/**
+ * Profiling state. Histograms are only written by the hooks, so they are
+ * consistent whenever the profiler is stopped.
+ */
+extern Profile PROFILE;
+
+/**
+ * Clear all histograms and start the profiler, saving timer 4's state.
+ *
+ * @param period_cycles: Nominal CPU cycles between ADC interrupts, e.g.
+ * `F_CPU / (sample_rate * nchannels)` for timer-triggered conversions or
+ * `13 * prescaler` for free-running ones.
+ * @param jitter_shift: log2 of the jitter histogram's bin width.
+ * @param duration_shift: log2 of the duration histogram's bin width.
+ */
+void start(uint16_t period_cycles, uint8_t jitter_shift = JITTER_SHIFT,
+           uint8_t duration_shift = DURATION_SHIFT);
+
+/**
+ * Stop the profiler and restore timer 4's state. Histograms are kept until
+ * the next `start`.
+ */
+void stop();
+
+/**
+ * @returns (bool): True if the profiler is running.
+ */
+bool running();
+
+/**
+ * Print every histogram in a human-readable format.
+ *
+ * @param out: Where to print to (e.g. `Serial`).
+ */
+void dump(Print& out);
+
+/**
+ * Hook for the start of the ADC ISR.
+ *
+ * @returns (uint16_t): Timer count to pass to `isr_exit`.
+ */
+static inline uint16_t isr_enter() {
+    uint16_t now = TCNT4;
+    if (!PROFILE.active) {
+        return now;
+    }
+    if (PROFILE.has_entry) {
+        uint16_t interval = now - PROFILE.last_entry;
+        PROFILE.jitter.add(static_cast<int16_t>(interval - PROFILE.period));
+    }
+    PROFILE.has_entry = true;
+    PROFILE.last_entry = now;
+    return now;
+}
+
+/**
+ * Hook for the end of the ADC ISR.
+ *
+ * @param entry: Timer count returned by `isr_enter`.
+ */
+static inline void isr_exit(uint16_t entry) {
+    if (PROFILE.active) {
+        PROFILE.duration.add(static_cast<int16_t>(TCNT4 - entry));
+    }
+}
+
+/**
+ * Hook for when the ISR fills a slot.
+ *
+ * @param slot: Index of the slot.
+ * @param index: Number of samples taken so far.
+ */
+static inline void slot_filled(uint8_t slot, uint32_t index) {
+    PROFILE.filled_at[slot] = index;
+}
+
+/**
+ * Hook for when the consumer hands a slot back.
+ *
+ * @param slot: Index of the slot.
+ * @param index: Number of samples taken so far.
+ */
+void slot_freed(uint8_t slot, uint32_t index);
+
+}  // namespace profiler
+
+#ifdef CHRISPY_PROFILE
+#define PROFILE_ISR_ENTER() const uint16_t profile_entry = profiler::isr_enter()
+#define PROFILE_ISR_EXIT() profiler::isr_exit(profile_entry)
+#define PROFILE_SLOT_FILLED(slot, index) profiler::slot_filled(slot, index)
+#define PROFILE_SLOT_FREED(slot, index) profiler::slot_freed(slot, index)
+#else
+#define PROFILE_ISR_ENTER()
+#define PROFILE_ISR_EXIT()
+#define PROFILE_SLOT_FILLED(slot, index)
+#define PROFILE_SLOT_FREED(slot, index)
+#endif
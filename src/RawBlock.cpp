@@ -0,0 +1,13 @@
+#include "RawBlock.h"
+
+namespace raw {
+
+size_t payload_capacity(BitResolution res) {
+    size_t capacity = SECTOR_SZ - sizeof(BlockHeader);
+    if (res == BitResolution::TenPacked) {
+        return capacity - capacity % adc::PACKED_GROUP_SZ;
+    }
+    return capacity - capacity % adc::bytes_per_sample(res);
+}
+
+}  // namespace raw
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Adc.h"
+
+using adc::BitResolution;
+
+/**
+ * Layout of recordings streamed straight to a range of SD card sectors by
+ * `recording::record_raw`, bypassing the filesystem.
+ *
+ * Every sector of a recording is self-describing: the first holds a
+ * `SessionHeader`, every following one a `BlockHeader` and up to
+ * `payload_capacity` bytes of one channel's samples, and the last a
+ * `Trailer`. See `scripts/recordings/demux_raw.py` for turning a card image
+ * back into WAV files.
+ */
+namespace raw {
+
+/**
+ * Size of every block (one SD card sector).
+ */
+const size_t SECTOR_SZ = 512;
+
+/**
+ * Format version.
+ */
+const uint8_t VERSION = 1;
+
+/**
+ * First sector of a recording.
+ */
+struct SessionHeader {
+    /**
+     * Sector identifier ("CHRH").
+     */
+    const char magic[4] = {'C', 'H', 'R', 'H'};
+    /**
+     * Format version.
+     */
+    const uint8_t version = VERSION;
+    /**
+     * Number of channels.
+     */
+    uint8_t num_channels = 0;
+    /**
+     * `BitResolution` samples were recorded at.
+     */
+    uint8_t resolution = 0;
+    /**
+     * Unused.
+     */
+    uint8_t reserved = 0;
+    /**
+     * Identifier of the recording, repeated in every sector. Tells its
+     * sectors apart from stale ones left in the range by an earlier
+     * recording.
+     */
+    uint32_t session = 0;
+    /**
+     * Requested sample rate for each channel in hertz.
+     */
+    uint32_t sample_rate = 0;
+};
+
+/**
+ * Header at the start of every sector holding samples.
+ */
+struct BlockHeader {
+    /**
+     * Sector identifier ("CHRB").
+     */
+    const char magic[4] = {'C', 'H', 'R', 'B'};
+    /**
+     * Identifier of the recording (see `SessionHeader::session`).
+     */
+    uint32_t session = 0;
+    /**
+     * Number of the block within the recording, counting from 0. Blocks are
+     * written in order, so any skip means blocks were lost.
+     */
+    uint32_t seq = 0;
+    /**
+     * Sequence number of the ADC slot the samples came from.
+     */
+    uint32_t slot = 0;
+    /**
+     * Index of the block's first sample among the samples stored for its
+     * channel. Samples dropped by the ADC are not counted, see
+     * `Trailer::gaps` for where they were.
+     */
+    uint32_t sample_index = 0;
+    /**
+     * Number of payload bytes following the header.
+     */
+    uint16_t size = 0;
+    /**
+     * Channel the samples are from.
+     */
+    uint8_t ch_index = 0;
+    /**
+     * Unused.
+     */
+    uint8_t reserved = 0;
+};
+
+/**
+ * Last sector of a recording, written once it is over.
+ */
+struct Trailer {
+    /**
+     * Sector identifier ("CHRT").
+     */
+    const char magic[4] = {'C', 'H', 'R', 'T'};
+    /**
+     * Identifier of the recording (see `SessionHeader::session`).
+     */
+    uint32_t session = 0;
+    /**
+     * `timebase` ticks when the first sample was taken.
+     */
+    uint64_t start_ticks = 0;
+    /**
+     * Number of blocks holding samples.
+     */
+    uint32_t nblocks = 0;
+    /**
+     * Measured per-channel sample rate in millihertz, or 0 if it was not
+     * measured.
+     */
+    uint32_t rate_mhz = 0;
+    /**
+     * Number of `start_ticks` per second.
+     */
+    uint32_t ticks_per_sec = 0;
+    /**
+     * Samples stored across all channels.
+     */
+    uint32_t collected = 0;
+    /**
+     * Samples dropped across all channels.
+     */
+    uint32_t dropped = 0;
+    /**
+     * Number of separate overrun events.
+     */
+    uint16_t overruns = 0;
+    /**
+     * Number of entries used in `gaps`.
+     */
+    uint8_t ngaps = 0;
+    /**
+     * Unused.
+     */
+    uint8_t reserved = 0;
+    /**
+     * Gap log of the ADC (see `adc::gaps`).
+     */
+    adc::Gap gaps[adc::MAX_GAP_COUNT];
+};
+
+/**
+ * @returns (size_t): Most payload bytes a block can hold at a bit resolution.
+ * Always a whole number of samples (or groups of packed samples).
+ */
+size_t payload_capacity(BitResolution res);
+
+}  // namespace raw
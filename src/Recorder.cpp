@@ -3,9 +3,17 @@
 #include <Arduino.h>
 #include <SdFat.h>
 
+#include "Adpcm.h"
+#include "Level.h"
+#include "Lossless.h"
+#include "Profiler.h"
+#include "RawBlock.h"
 #include "SdFunctions.cpp"
+#include "Timebase.h"
 #include "WavHeader.h"
 
+#define SD_SECTOR_SZ 512
+
 namespace recording {
 
 static struct {
@@ -19,89 +27,1554 @@ bool init(uint8_t nchannels, adc::Channel *channels, SdFat *sd) {
     if (sd == nullptr) {
         return false;
     }
+    init(nchannels, channels);
+    INSTANCE.sd = sd;
+    return true;
+}
+
+bool init(uint8_t nchannels, adc::Channel *channels) {
     INSTANCE.nchannels = nchannels;
     INSTANCE.channels = channels;
-    INSTANCE.sd = sd;
+    INSTANCE.sd = nullptr;
     INSTANCE.initialized = true;
     return true;
 }
 
-int64_t record(const char *filenames[], BitResolution res, uint32_t sample_rate,
-               uint32_t duration_ms, uint8_t *buf, size_t sz) {
+/**
+ * State for the stage between swapping a buffer out of the ADC and writing it
+ * to its channel's file.
+ */
+struct EncodeStage {
+    Encoding encoding;
+    BitResolution res;
+    uint32_t sample_rate;
+    uint8_t nslots;
+    /* !< One encoder per channel (`ImaAdpcm`) */
+    adpcm::Encoder *encoders;
+    /* !< Samples written per channel (`Lossless`), or seen per channel when
+     * gating */
+    uint32_t *nsamples;
+    /* !< Space to encode blocks (`Lossless`) or interleave frames into */
+    uint8_t *scratch;
+    size_t scratch_sz;
+    /* !< Flag for whether channels are interleaved into one file */
+    bool interleave;
+    /* !< Each channel's buffer from the slot being interleaved */
+    uint8_t **ch_bufs;
+    /* !< Microseconds each block may take to encode (`Lossless`) */
+    uint32_t budget_us;
+    /* !< Level silent buffers stay under, or 0 to write every buffer */
+    uint16_t gate_threshold;
+    /* !< Run of silent buffers each channel is in (when gating) */
+    level::SilenceRun *runs;
+    /* !< Sidecar file listing each channel's silent runs (when gating) */
+    SdFile *sidecars;
+    /* !< Where to record write latencies (optional) */
+    Stats *stats;
+};
+
+void Stats::add_write(uint32_t us) {
+    ++nwrites;
+    write_total_us += us;
+    write_max_us = max(write_max_us, us);
+    uint8_t bin = 0;
+    for (uint32_t bound = 1ul << WRITE_HISTOGRAM_SHIFT;
+         us >= bound && bin < WRITE_HISTOGRAM_BINS - 1; bound <<= 1) {
+        ++bin;
+    }
+    ++write_histogram[bin];
+}
+
+uint32_t Stats::write_mean_us() const {
+    return nwrites == 0 ? 0 : write_total_us / nwrites;
+}
+
+/**
+ * Fill in everything the ADC knows about a recording which just stopped.
+ *
+ * @param stats: Statistics to fill in (optional).
+ * @param ncollected: Samples collected across all channels.
+ */
+static void collect_adc_stats(Stats *stats, uint32_t ncollected) {
+    if (stats == nullptr) {
+        return;
+    }
+    adc::Timing measured;
+    if (adc::timing(measured)) {
+        stats->rate_mhz = measured.rate_mhz;
+    } else {
+        stats->rate_mhz = adc::measured_rate() * 1000;
+    }
+    stats->samples = ncollected / INSTANCE.nchannels;
+    stats->dropped = adc::dropped();
+    stats->overruns = adc::overruns();
+    stats->high_water = adc::high_water();
+    uint32_t latency;
+    if (adc::edge_latency(latency)) {
+        stats->edge_latency_ticks = latency;
+    }
+}
+
+/**
+ * Start the ADC on timer 1, or on the external clock set in the options.
+ *
+ * @param res: Bit resolution to record at.
+ * @param sample_rate: Requested sample rate for each channel.
+ * @param opts: Recording settings.
+ *
+ * @returns (int8_t): Return code of `adc::start` or `adc::start_external`.
+ */
+static int8_t start_adc(BitResolution res, uint32_t sample_rate,
+                        const Options &opts) {
+    if (opts.clock != AutotriggerSource::TimCnt1CmpB) {
+        return adc::start_external(res, sample_rate, opts.clock,
+                                   opts.clock_edge);
+    }
+    return adc::start(res, sample_rate);
+}
+
+bool initialized() { return INSTANCE.initialized; }
+
+uint8_t nchannels() { return INSTANCE.nchannels; }
+
+int8_t begin_capture(BitResolution res, uint32_t sample_rate, uint8_t *buf,
+                     size_t sz, const Options &opts, bool &own_timebase,
+                     bool armed) {
+    own_timebase = false;
     if (!INSTANCE.initialized) {
         return -1;
+    } else if (!adc::init(INSTANCE.nchannels, INSTANCE.channels, buf, sz,
+                          opts.nslots)) {
+        return -4;
+    }
+    // Leave the timebase alone if the application is already running it
+    own_timebase = opts.timing && !timebase::running();
+    if (own_timebase) {
+        timebase::start();
+    }
+    int8_t started =
+        armed ? adc::arm(res, sample_rate, opts.start_on, opts.start_edge)
+              : start_adc(res, sample_rate, opts);
+    if (started != 0) {
+        if (own_timebase) {
+            timebase::stop();
+        }
+        return -5;
+    }
+#ifdef CHRISPY_PROFILE
+    uint32_t period = F_CPU / (static_cast<uint32_t>(sample_rate) *
+                               INSTANCE.nchannels * adc::oversample_factor(res));
+    profiler::start(period > UINT16_MAX ? UINT16_MAX : period);
+#endif
+    return 0;
+}
+
+uint32_t end_capture(uint32_t duration_ms, bool own_timebase, Stats *stats) {
+    uint32_t ncollected = adc::stop();
+    collect_adc_stats(stats, ncollected);
+#ifdef CHRISPY_PROFILE
+    profiler::stop();
+#endif
+    if (own_timebase) {
+        timebase::stop();
+    }
+    // Stamps are only taken while the timebase is running
+    adc::Timing measured;
+    if (adc::timing(measured)) {
+        return (measured.rate_mhz + 500) / 1000;
+    } else if (duration_ms == 0) {
+        return 0;
+    }
+    return static_cast<uint64_t>(ncollected) * 1000 /
+           (static_cast<uint64_t>(INSTANCE.nchannels) * duration_ms);
+}
+
+void ClockWatch::begin(const Options &opts, uint32_t sample_rate) {
+    timeout_us = 0;
+    if (opts.clock != AutotriggerSource::TimCnt1CmpB && sample_rate != 0) {
+        uint64_t us = static_cast<uint64_t>(opts.clock_timeout_periods) *
+                      1000000ull / sample_rate;
+        timeout_us = us > UINT32_MAX ? UINT32_MAX : us;
+    }
+    progress = adc::collected() + adc::dropped();
+    since_us = micros();
+}
+
+bool ClockWatch::stalled() {
+    if (timeout_us == 0) {
+        return false;
+    }
+    uint32_t now = adc::collected() + adc::dropped();
+    uint32_t now_us = micros();
+    if (now != progress) {
+        progress = now;
+        since_us = now_us;
+        return false;
+    }
+    return now_us - since_us >= timeout_us;
+}
+
+/**
+ * Interleave frames (one sample from each channel) from channel buffers.
+ *
+ * @param out: Where to write frames to.
+ * @param ch_bufs: Buffer of each channel.
+ * @param nchannels: Number of channels.
+ * @param first: Index of the first sample to interleave.
+ * @param nframes: Number of frames to interleave.
+ * @param sample_sz: Size of each sample in bytes.
+ */
+static void interleave(uint8_t *out, uint8_t *const *ch_bufs,
+                       uint8_t nchannels, size_t first, size_t nframes,
+                       size_t sample_sz) {
+    if (sample_sz == 1) {
+        for (size_t i = first; i < first + nframes; ++i) {
+            for (uint8_t ch = 0; ch < nchannels; ++ch) {
+                *out++ = ch_bufs[ch][i];
+            }
+        }
+        return;
+    }
+    for (size_t i = first * sample_sz; i < (first + nframes) * sample_sz;
+         i += sample_sz) {
+        for (uint8_t ch = 0; ch < nchannels; ++ch) {
+            for (size_t j = 0; j < sample_sz; ++j) {
+                *out++ = ch_bufs[ch][i + j];
+            }
+        }
+    }
+}
+
+/**
+ * Hold on to a channel buffer until every channel buffer of its slot has
+ * been handed out, then write the slot out as interleaved frames. Channel
+ * buffers handed out earlier stay valid until the last one of the slot is
+ * swapped back, so nothing is copied until then.
+ *
+ * @param stage: Encoding state for the recording.
+ * @param file: File every channel is written to.
+ * @param ch_index: Channel the buffer is from.
+ * @param buf: Buffer handed out by the ADC.
+ * @param sz: Size of `buf` in bytes. The same for every channel of a slot.
+ *
+ * @returns (bool): True if everything was written.
+ */
+static bool write_interleaved(EncodeStage &stage, SdFile &file,
+                              size_t ch_index, uint8_t *buf, size_t sz) {
+    const uint8_t nchannels = adc::nchannels();
+    stage.ch_bufs[ch_index] = buf;
+    if (ch_index != nchannels - 1u) {
+        return true;
+    }
+    const size_t sample_sz = adc::bytes_per_sample(stage.res);
+    const size_t frame_sz = nchannels * sample_sz;
+    const size_t block_frames = stage.scratch_sz / frame_sz;
+    const size_t nframes = sz / sample_sz;
+    uint32_t start_us = micros();
+    bool ok = true;
+    for (size_t i = 0; ok && i < nframes; i += block_frames) {
+        size_t n = min(block_frames, nframes - i);
+        interleave(stage.scratch, stage.ch_bufs, nchannels, i, n, sample_sz);
+        ok = file.write(stage.scratch, n * frame_sz) == n * frame_sz;
+    }
+    if (stage.stats != nullptr) {
+        stage.stats->add_write(micros() - start_us);
+    }
+    return ok;
+}
+
+/**
+ * Write out a channel's run of silent buffers, if it is in one.
+ *
+ * @param sidecar: Sidecar file listing the channel's silent runs.
+ * @param run: Run the channel is in. Ended once written.
+ *
+ * @returns (bool): True if there was no run or it was written.
+ */
+static bool end_run(SdFile &sidecar, level::SilenceRun &run) {
+    if (run.length == 0) {
+        return true;
+    }
+    bool written = sidecar.write(&run, sizeof(run)) == sizeof(run);
+    run.length = 0;
+    return written;
+}
+
+/**
+ * Move the marks the ADC logged for the shared clock into the sync sidecar.
+ *
+ * @param sidecar: Sync sidecar of the recording.
+ *
+ * @returns (bool): True if every mark was written.
+ */
+static bool drain_syncs(SdFile &sidecar) {
+    adc::SyncMark marks[adc::MAX_SYNC_COUNT];
+    size_t nmarks = adc::syncs(marks, adc::MAX_SYNC_COUNT);
+    size_t marks_sz = nmarks * sizeof(adc::SyncMark);
+    return nmarks == 0 || sidecar.write(marks, marks_sz) == marks_sz;
+}
+
+/**
+ * Measure the level of a buffer and keep track of runs of silent buffers.
+ *
+ * @param stage: Encoding state for the recording.
+ * @param ch_index: Channel the buffer is from.
+ * @param buf: Buffer handed out by the ADC.
+ * @param sz: Size of `buf` in bytes.
+ * @param silent: Out-parameter for whether the buffer is silent and should
+ * be left out.
+ *
+ * @returns (bool): True if the sidecar file could be written.
+ */
+static bool gate_buffer(EncodeStage &stage, size_t ch_index,
+                        const uint8_t *buf, size_t sz, bool &silent) {
+    level::Level lvl;
+    level::analyze(buf, sz, stage.res, lvl);
+    uint32_t nsamples = sz / adc::bytes_per_sample(stage.res);
+    uint32_t position = stage.nsamples[ch_index];
+    stage.nsamples[ch_index] += nsamples;
+    silent = lvl.peak < stage.gate_threshold;
+    if (stage.stats != nullptr) {
+        stage.stats->clipped += lvl.clipped;
+        stage.stats->rms_max = max(stage.stats->rms_max, lvl.rms);
+        stage.stats->silent_blocks += silent;
+    }
+    level::SilenceRun &run = stage.runs[ch_index];
+    if (!silent) {
+        return end_run(stage.sidecars[ch_index], run);
+    }
+    if (run.length == 0) {
+        run.start = position;
+    }
+    run.length += nsamples;
+    return true;
+}
+
+/**
+ * Encode a buffer (if needed) and write it out.
+ *
+ * @param stage: Encoding state for the recording.
+ * @param file: File for the buffer's channel, or the only file when
+ * interleaving.
+ * @param ch_index: Channel the buffer is from.
+ * @param buf: Buffer handed out by the ADC. May be encoded in place.
+ * @param sz: Size of `buf` in bytes.
+ * @param draining: Whether the ADC has already been stopped, in which case
+ * there is no rush.
+ *
+ * @returns (bool): True if everything was written.
+ */
+static bool write_buffer(EncodeStage &stage, SdFile &file, size_t ch_index,
+                         uint8_t *buf, size_t sz, bool draining) {
+    if (stage.interleave) {
+        return write_interleaved(stage, file, ch_index, buf, sz);
+    } else if (stage.gate_threshold != 0) {
+        bool silent;
+        if (!gate_buffer(stage, ch_index, buf, sz, silent)) {
+            return false;
+        } else if (silent) {
+            return true;
+        }
+    }
+    lossless::BlockHeader hdr;
+    bool raw_block = false;
+    switch (stage.encoding) {
+        case Encoding::ImaAdpcm:
+            sz = stage.encoders[ch_index].encode(buf, sz, stage.res);
+            break;
+        case Encoding::Lossless: {
+            size_t nsamples = sz / adc::bytes_per_sample(stage.res);
+            stage.nsamples[ch_index] += nsamples;
+            size_t n = 0;
+            // Don't bother encoding once the ISR has started dropping
+            // conversions, catching up matters more
+            if (draining || adc::backlog() < stage.nslots) {
+                uint32_t budget_us = stage.budget_us;
+                if (draining) {
+                    budget_us = 0;
+                } else if (budget_us == 0) {
+                    // Half the time it takes the ADC to fill this block
+                    budget_us = static_cast<uint64_t>(nsamples) * 1000000 /
+                                (2ull * stage.sample_rate * adc::nchannels());
+                    budget_us = max(budget_us, 1ul);
+                }
+                n = lossless::encode(buf, sz, stage.res, stage.scratch,
+                                     stage.scratch_sz, budget_us);
+            }
+            if (n > 0) {
+                buf = stage.scratch;
+                sz = n;
+            } else {
+                lossless::raw_header(hdr, sz, stage.res);
+                raw_block = true;
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    uint32_t start_us = micros();
+    bool ok = (!raw_block || file.write(&hdr, sizeof(hdr)) == sizeof(hdr)) &&
+              file.write(buf, sz) == sz;
+    if (stage.stats != nullptr) {
+        stage.stats->add_write(micros() - start_us);
+    }
+    return ok;
+}
+
+/**
+ * Append a chunk to the end of a file.
+ *
+ * @param file: File to append to.
+ * @param chunk: Chunk to append.
+ * @param chunk_sz: Size of `chunk` in bytes.
+ * @param riff: Whether the file is a RIFF file, in which case the chunk is
+ * padded to start on an even offset.
+ *
+ * @returns (bool): True if everything was written.
+ */
+static bool append_chunk(SdFile &file, const void *chunk, size_t chunk_sz,
+                         bool riff) {
+    uint64_t size = file.fileSize();
+    if (!file.seekSet(size)) {
+        return false;
+    }
+    if (riff && (size & 1)) {
+        uint8_t pad = 0;
+        if (file.write(&pad, sizeof(pad)) != sizeof(pad)) {
+            return false;
+        }
+    }
+    return file.write(chunk, chunk_sz) == chunk_sz;
+}
+
+/**
+ * Upper bound on the size of each file for preallocating it. Raw samples are
+ * never smaller than encoded ones, and besides the samples due for the
+ * requested duration, at most a whole sample buffer's worth more can be
+ * collected before the ADC stops and the buffer is drained.
+ *
+ * @param res: Bit resolution samples are recorded at.
+ * @param sample_rate: Requested sample rate for each channel.
+ * @param duration_ms: Length in milliseconds to record for.
+ * @param sz: Size of the sample buffer in bytes.
+ * @param nfiles: Number of files channels are written to.
+ * @param data_offset: Offset in bytes where samples start in each file.
+ *
+ * @returns (uint32_t): Size in bytes, rounded up to whole sectors.
+ */
+static uint32_t max_file_size(BitResolution res, uint32_t sample_rate,
+                              uint32_t duration_ms, size_t sz, size_t nfiles,
+                              size_t data_offset) {
+    uint64_t samples = static_cast<uint64_t>(duration_ms) * sample_rate / 1000;
+    uint64_t data_sz =
+        (samples * adc::bytes_per_sample(res) + sz / INSTANCE.nchannels) *
+        (INSTANCE.nchannels / nfiles);
+    uint64_t size = data_offset + data_sz;
+    size = (size + SD_SECTOR_SZ - 1) & ~static_cast<uint64_t>(SD_SECTOR_SZ - 1);
+    return min(size, static_cast<uint64_t>(UINT32_MAX));
+}
+
+/**
+ * Write a header to the start of a file. If samples start past the end of the
+ * header, the header's final subchunk header (which comes right before the
+ * samples) is moved to just before them, and a `PadChunk` fills the gap.
+ *
+ * @param file: File to write to. Left positioned at `data_offset`.
+ * @param hdr: Header to write.
+ * @param hdr_sz: Size of `hdr` in bytes.
+ * @param data_offset: Offset in bytes where samples start. At least
+ * `hdr_sz + sizeof(PadChunk)` if it is not `hdr_sz`.
+ *
+ * @returns (bool): True if everything was written.
+ */
+static bool write_header(SdFile &file, const void *hdr, size_t hdr_sz,
+                         size_t data_offset) {
+    if (!file.seekSet(0)) {
+        return false;
+    } else if (data_offset == hdr_sz) {
+        return file.write(hdr, hdr_sz) == hdr_sz;
+    }
+    // The "data" subchunk ID and size
+    const size_t data_hdr_sz = 8;
+    const uint8_t *bytes = static_cast<const uint8_t *>(hdr);
+    size_t head_sz = hdr_sz - data_hdr_sz;
+    PadChunk pad;
+    pad.chunk_size = data_offset - hdr_sz - sizeof(pad);
+    if (!(file.write(bytes, head_sz) == head_sz &&
+          file.write(&pad, sizeof(pad)) == sizeof(pad))) {
+        return false;
+    }
+    const uint8_t zeros[16] = {0};
+    for (size_t left = pad.chunk_size; left > 0;) {
+        size_t n = min(left, sizeof(zeros));
+        if (file.write(zeros, n) != n) {
+            return false;
+        }
+        left -= n;
+    }
+    return file.write(bytes + head_sz, data_hdr_sz) == data_hdr_sz;
+}
+
+/**
+ * State for waiting on a trigger while the ring is kept as history.
+ */
+struct TriggerStage {
+    const Trigger *trigger;
+    BitResolution res;
+    uint8_t nslots;
+    /* !< `millis()` when the wait started */
+    uint32_t start_ms;
+    /* !< Sequence number of the next slot to look for `threshold` in */
+    uint32_t next_seq;
+    /* !< Slots thrown away from the front of the history */
+    uint32_t ndiscarded;
+    /* !< Samples in each channel buffer */
+    uint32_t slot_samples;
+    /* !< Per-channel index of the sample the trigger fired on, counting from
+     * the first sample of the first slot which was kept */
+    uint32_t trigger_sample;
+    /* !< Watch on an external clock */
+    ClockWatch *watch;
+};
+
+/**
+ * Find the first sample in a channel buffer which is at least `threshold`
+ * from the midpoint.
+ *
+ * @param buf: Channel buffer as the ISR stored it.
+ * @param sz: Size of `buf` in bytes.
+ * @param res: Bit resolution samples were recorded at. Not `TenPacked`.
+ * @param threshold: Distance from the midpoint in 16-bit units.
+ *
+ * @returns (int32_t): Index of the sample, or -1 if there is none.
+ */
+static int32_t find_threshold(const uint8_t *buf, size_t sz,
+                              BitResolution res, uint16_t threshold) {
+    if (res == BitResolution::Eight) {
+        // Unsigned samples centered on 0x80
+        for (size_t i = 0; i < sz; ++i) {
+            int16_t sample = buf[i] - 0x80;
+            uint16_t distance = (sample < 0 ? -sample : sample) << 8;
+            if (distance >= threshold) {
+                return i;
+            }
+        }
+        return -1;
+    }
+    for (size_t i = 0; i + 1 < sz; i += 2) {
+        int32_t sample = static_cast<int16_t>(buf[i] | (buf[i + 1] << 8));
+        if (static_cast<uint32_t>(sample < 0 ? -sample : sample) >= threshold) {
+            return i / 2;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Look for `threshold` in the slot the ISR filled most recently, unless it
+ * has already been looked at.
+ *
+ * @param stage: Trigger state for the recording.
+ *
+ * @returns (bool): True if the trigger fired, in which case
+ * `stage.trigger_sample` is set.
+ */
+static bool check_threshold(TriggerStage &stage) {
+    const uint8_t *slot;
+    size_t ch_buf_sz;
+    uint32_t seq;
+    if (adc::newest_slot(&slot, ch_buf_sz, seq) != 0 || seq < stage.next_seq) {
+        return false;
+    }
+    stage.next_seq = seq + 1;
+    for (uint8_t ch = 0; ch < adc::nchannels(); ++ch) {
+        int32_t i = find_threshold(slot + ch * ch_buf_sz, ch_buf_sz, stage.res,
+                                   stage.trigger->threshold);
+        if (i >= 0) {
+            uint32_t slot_samples =
+                ch_buf_sz / adc::bytes_per_sample(stage.res);
+            stage.trigger_sample = (seq - stage.ndiscarded) * slot_samples + i;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Throw away the oldest slot in the ring so the ISR always has room for new
+ * samples.
+ *
+ * @param stage: Trigger state for the recording.
+ * @param buf: Buffer currently lent out by the ADC, which is either nullptr
+ * or the first channel buffer of the oldest slot. Left the same way.
+ * @param sz: Size of `buf` in bytes.
+ * @param ch_index: Channel `buf` is from.
+ */
+static void discard_slot(TriggerStage &stage, uint8_t **buf, size_t &sz,
+                         size_t &ch_index) {
+    if (*buf == nullptr && adc::swap_buffer(buf, sz, ch_index) != 0) {
+        return;
+    }
+    stage.slot_samples = adc::buffer_samples(stage.res, sz);
+    while (ch_index != adc::nchannels() - 1u) {
+        adc::swap_buffer(buf, sz, ch_index);
+    }
+    // Frees the slot, and hands out the next one's first buffer if it is full
+    if (adc::swap_buffer(buf, sz, ch_index) != 0) {
+        *buf = nullptr;
+    }
+    ++stage.ndiscarded;
+}
+
+/**
+ * Keep the ring as a history of the most recent samples until the trigger
+ * fires.
+ *
+ * @param stage: Trigger state for the recording.
+ * @param buf: Out-parameter for a buffer lent out by the ADC which still has
+ * to be written (the first channel buffer of the oldest slot), or nullptr.
+ * @param sz: Size of `buf` in bytes.
+ * @param ch_index: Channel `buf` is from.
+ *
+ * @returns (int8_t): 0 once the trigger fires, -18 if it timed out or -22 if
+ * the external clock stalled.
+ */
+static int8_t wait_for_trigger(TriggerStage &stage, uint8_t **buf, size_t &sz,
+                               size_t &ch_index) {
+    const Trigger &trigger = *stage.trigger;
+    const uint8_t nchannels = adc::nchannels();
+    while (true) {
+        // Keep a slot free for the ISR to fill
+        if (adc::backlog() >= stage.nslots - 1) {
+            discard_slot(stage, buf, sz, ch_index);
+        }
+        if (trigger.threshold != 0 && check_threshold(stage)) {
+            return 0;
+        }
+        if ((trigger.poll != nullptr && trigger.poll()) ||
+            (trigger.pin >= 0 && digitalRead(trigger.pin) == trigger.pin_level)) {
+            stage.trigger_sample = adc::collected() / nchannels -
+                                   stage.ndiscarded * stage.slot_samples;
+            return 0;
+        }
+        if (trigger.timeout_ms != 0 &&
+            millis() - stage.start_ms >= trigger.timeout_ms) {
+            return -18;
+        } else if (stage.watch->stalled()) {
+            return -22;
+        }
+    }
+}
+
+/**
+ * Name a sidecar file after the recording it belongs to, swapping the
+ * recording's extension for its own.
+ *
+ * @param filename: Name of the recording.
+ * @param extension: Extension of the sidecar, including the dot.
+ * @param out: Where to write the sidecar's name to.
+ * @param out_sz: Size of `out` in bytes.
+ *
+ * @returns (bool): True if the name fit in `out`.
+ */
+static bool sidecar_name(const char *filename, const char *extension,
+                         char *out, size_t out_sz) {
+    const char *dot = strrchr(filename, '.');
+    size_t stem_sz = dot == nullptr ? strlen(filename) : dot - filename;
+    size_t extension_sz = strlen(extension) + 1;
+    if (stem_sz + extension_sz > out_sz) {
+        return false;
+    }
+    memcpy(out, filename, stem_sz);
+    memcpy(out + stem_sz, extension, extension_sz);
+    return true;
+}
+
+int64_t record(const char *filenames[], BitResolution res, uint32_t sample_rate,
+               uint32_t duration_ms, uint8_t *buf, size_t sz,
+               const Options &opts, Stats *stats) {
+    if (stats != nullptr) {
+        *stats = Stats();
+    }
+    if (!INSTANCE.initialized || INSTANCE.sd == nullptr) {
+        return -1;
     } else if (INSTANCE.nchannels > adc::MAX_CHANNEL_COUNT) {
         return -2;
+    } else if (opts.encoding != Encoding::Pcm &&
+               res == BitResolution::TenPacked) {
+        return -10;
+    } else if (opts.interleave &&
+               (opts.encoding != Encoding::Pcm ||
+                res == BitResolution::TenPacked || sz <= INTERLEAVE_BLOCK_SZ)) {
+        return -12;
+    } else if (opts.preallocate && opts.encoding == Encoding::Lossless) {
+        return -13;
+    } else if (opts.trigger != nullptr && opts.trigger->threshold != 0 &&
+               res == BitResolution::TenPacked) {
+        return -17;
+    } else if (opts.gate_threshold != 0 &&
+               (opts.encoding != Encoding::Pcm || opts.interleave ||
+                res == BitResolution::TenPacked)) {
+        return -19;
+    } else if (opts.start_on != AutotriggerSource::TimCnt1CmpB &&
+               opts.trigger != nullptr) {
+        return -20;
+    } else if (opts.start_on != AutotriggerSource::TimCnt1CmpB &&
+               opts.clock != AutotriggerSource::TimCnt1CmpB) {
+        return -21;
+    } else if (opts.sync_pin >= 0 &&
+               digitalPinToInterrupt(opts.sync_pin) < 0) {
+        return -23;
     }
+    const bool armed = opts.start_on != AutotriggerSource::TimCnt1CmpB;
+    const bool syncing = opts.sync_pin >= 0;
+    const bool use_adpcm = opts.encoding == Encoding::ImaAdpcm;
+    const bool use_lossless = opts.encoding == Encoding::Lossless;
+    const bool gating = opts.gate_threshold != 0;
+    const size_t nfiles = opts.interleave ? 1 : INSTANCE.nchannels;
+    // Sidecar files for silent runs follow the recordings, and the sync
+    // sidecar comes last
+    const size_t nopen = (gating ? 2 * nfiles : nfiles) + syncing;
 
     // This number is bounded by `MAX_CHANNEL_COUNT` so the VLA is alright
-    SdFile files[INSTANCE.nchannels];
+    SdFile files[nopen];
+    level::SilenceRun runs[INSTANCE.nchannels];
+    memset(runs, 0, sizeof(runs));
+    uint8_t *ch_bufs[INSTANCE.nchannels];
+    adpcm::Encoder encoders[INSTANCE.nchannels];
+    uint32_t nsamples[INSTANCE.nchannels];
+    memset(nsamples, 0, sizeof(nsamples));
+
+    EncodeStage stage;
+    stage.encoding = opts.encoding;
+    stage.res = res;
+    stage.sample_rate = sample_rate;
+    stage.nslots = opts.nslots;
+    stage.encoders = encoders;
+    stage.nsamples = nsamples;
+    stage.scratch = nullptr;
+    stage.scratch_sz = 0;
+    stage.budget_us = opts.budget_us;
+    stage.gate_threshold = opts.gate_threshold;
+    stage.runs = runs;
+    stage.sidecars = files + nfiles;
+    stage.stats = stats;
+    stage.interleave = opts.interleave;
+    stage.ch_bufs = ch_bufs;
+    if (use_lossless) {
+        // Carve out about one channel buffer's worth of space at the end of
+        // the buffer for encoded blocks
+        stage.scratch_sz = sz / (INSTANCE.nchannels * opts.nslots + 1);
+        sz -= stage.scratch_sz;
+        stage.scratch = buf + sz;
+    } else if (opts.interleave) {
+        stage.scratch_sz = INTERLEAVE_BLOCK_SZ;
+        sz -= stage.scratch_sz;
+        stage.scratch = buf + sz;
+    }
+
     // Create files and write blank headers
     WavHeader hdr;
-    for (size_t i = 0; i < INSTANCE.nchannels; ++i) {
-        if (!(files[i].open(filenames[i], O_TRUNC | O_WRITE | O_CREAT) &&
-              files[i].write(&hdr, sizeof(hdr)) == sizeof(hdr))) {
-            close_all(files, INSTANCE.nchannels);
+    ImaAdpcmWavHeader adpcm_hdr;
+    lossless::FileHeader lossless_hdr;
+    const void *hdr_ptr = &hdr;
+    size_t hdr_sz = sizeof(hdr);
+    if (use_adpcm) {
+        hdr_ptr = &adpcm_hdr;
+        hdr_sz = sizeof(adpcm_hdr);
+    } else if (use_lossless) {
+        hdr_ptr = &lossless_hdr;
+        hdr_sz = sizeof(lossless_hdr);
+    }
+    // Preallocated files start samples on a sector boundary
+    const size_t data_offset = opts.preallocate ? SD_SECTOR_SZ : hdr_sz;
+    const uint32_t prealloc_sz =
+        opts.preallocate ? max_file_size(res, sample_rate, duration_ms, sz,
+                                         nfiles, data_offset)
+                         : 0;
+    for (size_t i = 0; i < nfiles; ++i) {
+        if (!files[i].open(filenames[i], O_TRUNC | O_WRITE | O_CREAT)) {
+            remove_all(files, nopen);
+            return -3;
+        }
+        // Extents can only be allocated to empty files
+        if (opts.preallocate && !files[i].preAllocate(prealloc_sz)) {
+            remove_all(files, nopen);
+            return -14;
+        }
+        uint32_t first_sector;
+        uint32_t last_sector;
+        if (opts.preallocate && opts.pre_erase &&
+            !(files[i].contiguousRange(&first_sector, &last_sector) &&
+              INSTANCE.sd->card()->erase(first_sector, last_sector))) {
+            remove_all(files, nopen);
+            return -14;
+        }
+        if (!write_header(files[i], hdr_ptr, hdr_sz, data_offset)) {
+            remove_all(files, nopen);
+            return -3;
+        }
+    }
+    for (size_t i = 0; gating && i < nfiles; ++i) {
+        char filename[MAX_FILENAME_SZ];
+        level::SilenceHeader sil_hdr;
+        if (!(sidecar_name(filenames[i], ".sil", filename, sizeof(filename)) &&
+              stage.sidecars[i].open(filename, O_TRUNC | O_WRITE | O_CREAT) &&
+              stage.sidecars[i].write(&sil_hdr, sizeof(sil_hdr)) ==
+                  sizeof(sil_hdr))) {
+            remove_all(files, nopen);
+            return -3;
+        }
+    }
+    SdFile &sync_file = files[nopen - 1];
+    SyncHeader sync_hdr;
+    sync_hdr.num_channels = INSTANCE.nchannels;
+    sync_hdr.sample_rate = sample_rate;
+    if (syncing) {
+        char filename[MAX_FILENAME_SZ];
+        if (!(sidecar_name(filenames[0], ".syn", filename,
+                           sizeof(filename)) &&
+              sync_file.open(filename, O_TRUNC | O_WRITE | O_CREAT) &&
+              sync_file.write(&sync_hdr, sizeof(sync_hdr)) ==
+                  sizeof(sync_hdr))) {
+            remove_all(files, nopen);
             return -3;
         }
     }
 
-    if (!adc::init(INSTANCE.nchannels, INSTANCE.channels, buf, sz)) {
-        return -4;
+    bool own_timebase;
+    int8_t started =
+        begin_capture(res, sample_rate, buf, sz, opts, own_timebase, armed);
+    if (started != 0) {
+        remove_all(files, nopen);
+        return started;
     }
     uint8_t *tmp_buf = nullptr;
     size_t tmp_sz = 0;
     size_t ch_index = 0;
-    if (adc::start(res, sample_rate) != 0) {
-        return -5;
-    }
     uint32_t required_samples = (static_cast<uint64_t>(duration_ms) *
                                  sample_rate * INSTANCE.nchannels) /
                                 1000ull;
+    TriggerStage trigger;
+    trigger.trigger = opts.trigger;
+    trigger.res = res;
+    trigger.nslots = opts.nslots;
+    trigger.start_ms = millis();
+    trigger.next_seq = 0;
+    trigger.ndiscarded = 0;
+    trigger.slot_samples = 0;
+    trigger.trigger_sample = 0;
+    ClockWatch watch;
+    watch.begin(opts, sample_rate);
+    trigger.watch = &watch;
+    // Buffer handed out while waiting for the trigger which still has to be
+    // written
+    bool pending = false;
+    int8_t waited = 0;
+    if (armed) {
+        waited = adc::await_edge(opts.start_timeout_ms) == 0 ? 0 : -24;
+    } else if (opts.trigger != nullptr) {
+        waited = wait_for_trigger(trigger, &tmp_buf, tmp_sz, ch_index);
+    }
+    // Edges are numbered from here, after any edge sampling was armed for
+    if (waited == 0 && syncing) {
+        waited = adc::log_sync(opts.sync_pin, opts.sync_edge) == 0 ? 0 : -25;
+    }
+    if (waited != 0) {
+        end_capture(duration_ms, own_timebase, stats);
+        remove_all(files, nopen);
+        return waited;
+    }
+    if (opts.trigger != nullptr) {
+        pending = tmp_buf != nullptr;
+        // The duration counts from the trigger
+        required_samples += adc::collected();
+        if (stats != nullptr) {
+            stats->trigger_sample = trigger.trigger_sample;
+        }
+    }
+    bool stalled = false;
     while (adc::collected() < required_samples) {
-        if (adc::swap_buffer(&tmp_buf, tmp_sz, ch_index) == 0) {
+        bool written = true;
+        if (pending || adc::swap_buffer(&tmp_buf, tmp_sz, ch_index) == 0) {
+            pending = false;
             if (tmp_buf == nullptr) {
                 continue;
             }
-            size_t nwritten = files[ch_index].write(tmp_buf, tmp_sz);
-            if (nwritten != tmp_sz) {
-                adc::stop();
-                close_all(files, INSTANCE.nchannels);
-                return -6;
-            }
+            size_t file_index = opts.interleave ? 0 : ch_index;
+            written = write_buffer(stage, files[file_index], ch_index,
+                                   tmp_buf, tmp_sz, false);
+        } else if (watch.stalled()) {
+            stalled = true;
+            break;
+        } else if (syncing) {
+            // Only with no buffer waiting, so marks never hold up samples
+            written = drain_syncs(sync_file);
+        }
+        if (!written) {
+            end_capture(duration_ms, own_timebase, stats);
+            remove_all(files, nopen);
+            return -6;
         }
     }
-    uint32_t ncollected = adc::stop();
+    end_capture(duration_ms, own_timebase, stats);
+    const uint32_t ncollected = adc::collected();
+    if (syncing && stats != nullptr) {
+        stats->sync_edges = adc::sync_edges();
+    }
     while (adc::drain_buffer(&tmp_buf, tmp_sz, ch_index) == 0) {
         if (tmp_buf == nullptr) {
             continue;
         }
-        size_t nwritten = files[ch_index].write(tmp_buf, tmp_sz);
-        if (nwritten != tmp_sz) {
-            close_all(files, INSTANCE.nchannels);
+        size_t file_index = opts.interleave ? 0 : ch_index;
+        if (!write_buffer(stage, files[file_index], ch_index, tmp_buf, tmp_sz,
+                          true)) {
+            remove_all(files, nopen);
             return -7;
         }
     }
+    for (size_t i = 0; gating && i < nfiles; ++i) {
+        if (!end_run(stage.sidecars[i], runs[i])) {
+            remove_all(files, nopen);
+            return -7;
+        }
+    }
+    if (syncing && !drain_syncs(sync_file)) {
+        remove_all(files, nopen);
+        return -7;
+    }
+    // Write out any code left waiting on a second one to fill its byte
+    uint32_t nencoded = UINT32_MAX;
+    for (size_t i = 0; use_adpcm && i < INSTANCE.nchannels; ++i) {
+        uint8_t tail;
+        size_t ntail = encoders[i].flush(&tail);
+        if (files[i].write(&tail, ntail) != ntail) {
+            remove_all(files, nopen);
+            return -7;
+        }
+        nencoded = min(nencoded, encoders[i].nsamples);
+    }
+    for (size_t i = 0; use_lossless && i < INSTANCE.nchannels; ++i) {
+        nencoded = min(nencoded, nsamples[i]);
+    }
 
-    // Make all files the exact same size then write out WAV header
-    int64_t rc = truncate_to_smallest(files, INSTANCE.nchannels);
-    if (rc < 0) {
-        close_all(files, INSTANCE.nchannels);
-        return -8;
+    // Make all files the exact same size then write out WAV header. Blocks
+    // of lossless files vary in size, so they record how many samples to
+    // decode instead. Gated files each leave out different buffers, so they
+    // keep their own sizes.
+    uint32_t file_sizes[nfiles];
+    memset(file_sizes, 0, sizeof(file_sizes));
+    uint32_t start_us = micros();
+    // Preallocated files may already be as big as their extent. Cut them
+    // off where writing stopped, freeing the rest of the extent.
+    for (size_t i = 0; opts.preallocate && i < nfiles; ++i) {
+        if (!files[i].truncate()) {
+            remove_all(files, nopen);
+            return -8;
+        }
     }
-    uint32_t file_size = static_cast<uint32_t>(rc);
+    if (gating) {
+        for (size_t i = 0; i < nfiles; ++i) {
+            file_sizes[i] = files[i].fileSize();
+        }
+    } else if (!use_lossless) {
+        int64_t rc = truncate_to_smallest(files, nfiles);
+        if (rc < 0) {
+            remove_all(files, nopen);
+            return -8;
+        }
+        for (size_t i = 0; i < nfiles; ++i) {
+            file_sizes[i] = static_cast<uint32_t>(rc);
+        }
+    }
+    if (stats != nullptr) {
+        stats->truncate_us = micros() - start_us;
+    }
+    start_us = micros();
+    // With a trigger, the ADC ran for longer than the duration
     uint32_t per_ch_sample_rate =
-        ncollected / (INSTANCE.nchannels * duration_ms / 1000.0);
-    hdr.fill(res, file_size, per_ch_sample_rate);
-    for (size_t i = 0; i < INSTANCE.nchannels; ++i) {
-        if (!(files[i].seekSet(0) &&
-              files[i].write(&hdr, sizeof(hdr)) == sizeof(hdr))) {
-            close_all(files, INSTANCE.nchannels);
+        opts.trigger != nullptr
+            ? adc::measured_rate()
+            : ncollected / (INSTANCE.nchannels * duration_ms / 1000.0);
+    adc::Timing measured;
+    const bool timed = opts.timing && adc::timing(measured);
+    if (timed) {
+        per_ch_sample_rate = (measured.rate_mhz + 500) / 1000;
+        TimingChunk chunk;
+        chunk.rate_mhz = measured.rate_mhz;
+        chunk.ticks_per_sec = timebase::TICKS_PER_SEC;
+        // Files start after any history which was thrown away
+        uint64_t skipped = static_cast<uint64_t>(trigger.ndiscarded) *
+                           trigger.slot_samples;
+        chunk.start_ticks =
+            measured.start_ticks +
+            skipped * 1000 * timebase::TICKS_PER_SEC / measured.rate_mhz;
+        for (size_t i = 0; i < nfiles; ++i) {
+            if (!append_chunk(files[i], &chunk, sizeof(chunk),
+                              !use_lossless)) {
+                remove_all(files, nopen);
+                return -11;
+            }
+        }
+    }
+    if (opts.trigger != nullptr && !use_lossless) {
+        CueChunk cue;
+        cue.sample_offset = trigger.trigger_sample;
+        for (size_t i = 0; i < nfiles; ++i) {
+            if (!append_chunk(files[i], &cue, sizeof(cue), true)) {
+                remove_all(files, nopen);
+                return -11;
+            }
+        }
+    }
+    if (syncing) {
+        // Marks count from the first sample, before any history which was
+        // thrown away
+        sync_hdr.start_sample = trigger.ndiscarded * trigger.slot_samples;
+        if (!(sync_file.seekSet(0) &&
+              sync_file.write(&sync_hdr, sizeof(sync_hdr)) ==
+                  sizeof(sync_hdr))) {
+            remove_all(files, nopen);
             return -9;
         }
     }
+    // Fill headers as if samples came right after them, then count any
+    // padding in between as part of the RIFF chunk
+    const uint32_t pad_sz = data_offset - hdr_sz;
+    for (size_t i = 0; i < nfiles; ++i) {
+        if (use_adpcm) {
+            adpcm_hdr.fill(file_sizes[i] - pad_sz, per_ch_sample_rate,
+                           nencoded);
+        } else if (use_lossless) {
+            lossless_hdr.fill(res, per_ch_sample_rate, nencoded);
+        } else {
+            hdr.fill(res, file_sizes[i] - pad_sz, per_ch_sample_rate,
+                     opts.interleave ? INSTANCE.nchannels : 1);
+        }
+        // Chunks appended after the samples (and the padding which keeps
+        // them on even offsets) are part of the RIFF chunk too
+        uint32_t extra = pad_sz + (files[i].fileSize() - file_sizes[i]);
+        hdr.chunk_size += extra;
+        adpcm_hdr.chunk_size += extra;
+        if (!write_header(files[i], hdr_ptr, hdr_sz, data_offset)) {
+            remove_all(files, nopen);
+            return -9;
+        }
+    }
+
+    close_all(files, nopen);
+    if (stats != nullptr) {
+        stats->finalize_us = micros() - start_us;
+    }
+    return stalled ? -22 : 0;
+}
+
+/**
+ * Where a take of a continuous recording is up to. Everything but `Writing`
+ * is worked through one file at a time in the background.
+ */
+enum struct TakeState : uint8_t {
+    Empty,      /* !< No files open. */
+    Opening,    /* !< Creating and preallocating files. */
+    Erasing,    /* !< Erasing preallocated extents (`pre_erase`). */
+    Heading,    /* !< Writing placeholder headers. */
+    Ready,      /* !< Waiting to be written. */
+    Writing,    /* !< Being written. */
+    Truncating, /* !< Cutting files off where writing stopped. */
+    Finalizing, /* !< Writing timing chunks and headers. */
+    Closing,    /* !< Closing files. */
+};
+
+/**
+ * One set of files of a continuous recording.
+ */
+struct Take {
+    SdFile *files;
+    TakeState state;
+    /* !< Next file to work on in `state` */
+    size_t cursor;
+    /* !< Number of the take, counting from 0 */
+    uint32_t index;
+    /* !< Samples written for each channel */
+    uint32_t nsamples;
+    /* !< Per-channel index of the take's first sample, counting dropped ones */
+    uint64_t start_sample;
+};
 
-    close_all(files, INSTANCE.nchannels);
+/**
+ * Settings shared by every take of a continuous recording.
+ */
+struct TakeStage {
+    TakeNamer name;
+    BitResolution res;
+    uint32_t sample_rate;
+    size_t nfiles;
+    /* !< Channels in each file */
+    uint16_t file_nchannels;
+    uint32_t prealloc_sz;
+    bool pre_erase;
+    bool timing;
+    /* !< Where to record background work (optional) */
+    Stats *stats;
+};
+
+/**
+ * Write the timing chunk and final header of a take's file.
+ *
+ * @param stage: Settings for the recording.
+ * @param take: Take the file belongs to.
+ * @param file: File to finalize, already truncated.
+ *
+ * @returns (int8_t): 0 if successful, or the error code for `record_continuous`.
+ */
+static int8_t finalize_take_file(const TakeStage &stage, const Take &take,
+                                 SdFile &file) {
+    uint32_t file_size = file.fileSize();
+    uint32_t rate = stage.sample_rate;
+    adc::Timing measured;
+    const bool timed = stage.timing && adc::timing(measured);
+    if (timed) {
+        rate = (measured.rate_mhz + 500) / 1000;
+        TimingChunk chunk;
+        chunk.rate_mhz = measured.rate_mhz;
+        chunk.ticks_per_sec = timebase::TICKS_PER_SEC;
+        // Work forward from the start of the recording to the take's first
+        // sample at the measured rate
+        chunk.start_ticks =
+            measured.start_ticks + take.start_sample * 1000ull *
+                                       timebase::TICKS_PER_SEC /
+                                       measured.rate_mhz;
+        if (!append_chunk(file, &chunk, sizeof(chunk), true)) {
+            return -11;
+        }
+    }
+    WavHeader hdr;
+    const uint32_t pad_sz = SD_SECTOR_SZ - sizeof(hdr);
+    hdr.fill(stage.res, file_size - pad_sz, rate, stage.file_nchannels);
+    hdr.chunk_size += pad_sz;
+    if (timed) {
+        hdr.chunk_size += (file_size & 1) + sizeof(TimingChunk);
+    }
+    return write_header(file, &hdr, sizeof(hdr), SD_SECTOR_SZ) ? 0 : -9;
+}
+
+/**
+ * Do the next file's worth of work on a take which is not being written, and
+ * move it on to its next state once every file is done.
+ *
+ * @param stage: Settings for the recording.
+ * @param take: Take to work on.
+ *
+ * @returns (int8_t): 0 if successful, or the error code for `record_continuous`.
+ */
+static int8_t step_take(const TakeStage &stage, Take &take) {
+    SdFile &file = take.files[take.cursor];
+    uint32_t start_us = micros();
+    int8_t rc = 0;
+    TakeState next;
+    switch (take.state) {
+        case TakeState::Opening: {
+            char filename[MAX_FILENAME_SZ];
+            stage.name(take.index, take.cursor, filename, sizeof(filename));
+            if (!file.open(filename, O_TRUNC | O_WRITE | O_CREAT)) {
+                rc = -3;
+            } else if (!file.preAllocate(stage.prealloc_sz)) {
+                rc = -14;
+            }
+            next = stage.pre_erase ? TakeState::Erasing : TakeState::Heading;
+            break;
+        }
+        case TakeState::Erasing: {
+            uint32_t first_sector;
+            uint32_t last_sector;
+            if (!(file.contiguousRange(&first_sector, &last_sector) &&
+                  INSTANCE.sd->card()->erase(first_sector, last_sector))) {
+                rc = -14;
+            }
+            next = TakeState::Heading;
+            break;
+        }
+        case TakeState::Heading: {
+            WavHeader hdr;
+            if (!write_header(file, &hdr, sizeof(hdr), SD_SECTOR_SZ)) {
+                rc = -3;
+            }
+            next = TakeState::Ready;
+            break;
+        }
+        case TakeState::Truncating:
+            if (!file.truncate()) {
+                rc = -8;
+            }
+            next = TakeState::Finalizing;
+            break;
+        case TakeState::Finalizing:
+            rc = finalize_take_file(stage, take, file);
+            next = TakeState::Closing;
+            break;
+        case TakeState::Closing:
+            if (!file.close()) {
+                rc = -9;
+            }
+            next = TakeState::Empty;
+            break;
+        default:
+            return 0;
+    }
+    if (stage.stats != nullptr) {
+        uint32_t elapsed = micros() - start_us;
+        if (take.state == TakeState::Truncating) {
+            stage.stats->truncate_us += elapsed;
+        } else {
+            stage.stats->finalize_us += elapsed;
+        }
+    }
+    if (++take.cursor == stage.nfiles) {
+        take.cursor = 0;
+        take.state = next;
+    }
+    return rc;
+}
+
+/**
+ * Work through a take until it is ready to be written or fully closed.
+ *
+ * @param stage: Settings for the recording.
+ * @param take: Take to work on.
+ *
+ * @returns (int8_t): 0 if successful, or the error code for `record_continuous`.
+ */
+static int8_t finish_take(const TakeStage &stage, Take &take) {
+    while (take.state != TakeState::Empty && take.state != TakeState::Ready &&
+           take.state != TakeState::Writing) {
+        int8_t rc = step_take(stage, take);
+        if (rc < 0) {
+            return rc;
+        }
+    }
     return 0;
 }
+
+int64_t record_continuous(TakeNamer name, BitResolution res,
+                          uint32_t sample_rate, uint32_t take_ms,
+                          uint32_t ntakes, uint8_t *buf, size_t sz,
+                          const Options &opts, Stats *stats) {
+    if (stats != nullptr) {
+        *stats = Stats();
+    }
+    if (!INSTANCE.initialized || INSTANCE.sd == nullptr) {
+        return -1;
+    } else if (INSTANCE.nchannels > adc::MAX_CHANNEL_COUNT) {
+        return -2;
+    } else if (opts.interleave &&
+               (res == BitResolution::TenPacked || sz <= INTERLEAVE_BLOCK_SZ)) {
+        return -12;
+    } else if (name == nullptr || take_ms == 0 ||
+               opts.encoding != Encoding::Pcm) {
+        return -16;
+    }
+    const size_t nfiles = opts.interleave ? 1 : INSTANCE.nchannels;
+
+    // One take is written while the other is finalized or opened ahead
+    SdFile files[2 * nfiles];
+    uint8_t *ch_bufs[INSTANCE.nchannels];
+
+    EncodeStage stage;
+    stage.encoding = Encoding::Pcm;
+    stage.res = res;
+    stage.sample_rate = sample_rate;
+    stage.nslots = opts.nslots;
+    stage.encoders = nullptr;
+    stage.nsamples = nullptr;
+    stage.scratch = nullptr;
+    stage.scratch_sz = 0;
+    stage.budget_us = 0;
+    stage.gate_threshold = 0;
+    stage.runs = nullptr;
+    stage.sidecars = nullptr;
+    stage.stats = stats;
+    stage.interleave = opts.interleave;
+    stage.ch_bufs = ch_bufs;
+    if (opts.interleave) {
+        stage.scratch_sz = INTERLEAVE_BLOCK_SZ;
+        sz -= stage.scratch_sz;
+        stage.scratch = buf + sz;
+    }
+
+    TakeStage take_stage;
+    take_stage.name = name;
+    take_stage.res = res;
+    take_stage.sample_rate = sample_rate;
+    take_stage.nfiles = nfiles;
+    take_stage.file_nchannels = opts.interleave ? INSTANCE.nchannels : 1;
+    take_stage.prealloc_sz = max_file_size(res, sample_rate, take_ms, sz,
+                                           nfiles, SD_SECTOR_SZ);
+    take_stage.pre_erase = opts.pre_erase;
+    take_stage.timing = opts.timing;
+    take_stage.stats = stats;
+
+    Take takes[2];
+    for (size_t i = 0; i < 2; ++i) {
+        takes[i].files = files + i * nfiles;
+        takes[i].state = TakeState::Empty;
+        takes[i].cursor = 0;
+        takes[i].index = i;
+        takes[i].nsamples = 0;
+        takes[i].start_sample = 0;
+    }
+    Take *current = &takes[0];
+    Take *other = &takes[1];
+    // Only the first take is opened up front, the next is opened once
+    // sampling is underway
+    current->state = TakeState::Opening;
+    int64_t rc = finish_take(take_stage, *current);
+    if (rc < 0) {
+        close_all(files, 2 * nfiles);
+        return rc;
+    }
+    current->state = TakeState::Writing;
+    if (ntakes != 1) {
+        other->state = TakeState::Opening;
+    }
+
+    bool own_timebase;
+    rc = begin_capture(res, sample_rate, buf, sz, opts, own_timebase);
+    if (rc != 0) {
+        close_all(files, 2 * nfiles);
+        return rc;
+    }
+    uint8_t *tmp_buf = nullptr;
+    size_t tmp_sz = 0;
+    size_t ch_index = 0;
+    const uint32_t take_samples =
+        static_cast<uint64_t>(take_ms) * sample_rate / 1000;
+    // Samples written for each channel before the current take
+    uint64_t nwritten = 0;
+    ClockWatch watch;
+    watch.begin(opts, sample_rate);
+    bool stalled = false;
+    while (rc == 0) {
+        if (adc::swap_buffer(&tmp_buf, tmp_sz, ch_index) != 0 ||
+            tmp_buf == nullptr) {
+            if (watch.stalled()) {
+                stalled = true;
+                break;
+            }
+            // Nothing waiting to be written, get on with the other take
+            if (other->state == TakeState::Empty &&
+                (ntakes == 0 || current->index + 1 < ntakes)) {
+                other->index = current->index + 1;
+                other->state = TakeState::Opening;
+            }
+            rc = step_take(take_stage, *other);
+            continue;
+        }
+        size_t file_index = opts.interleave ? 0 : ch_index;
+        if (!write_buffer(stage, current->files[file_index], ch_index,
+                          tmp_buf, tmp_sz, false)) {
+            rc = -6;
+            break;
+        }
+        // Rotate between slots so every file of a take has the same samples
+        if (ch_index != INSTANCE.nchannels - 1u) {
+            continue;
+        }
+        current->nsamples += adc::buffer_samples(res, tmp_sz);
+        if (current->nsamples < take_samples) {
+            continue;
+        } else if (ntakes != 0 && current->index + 1 == ntakes) {
+            break;
+        } else if (other->state != TakeState::Ready) {
+            // Late, keep writing this take until the next one is ready
+            continue;
+        }
+        nwritten += current->nsamples;
+        other->state = TakeState::Writing;
+        other->nsamples = 0;
+        other->start_sample = nwritten + adc::dropped() / INSTANCE.nchannels;
+        current->state = TakeState::Truncating;
+        Take *written = current;
+        current = other;
+        other = written;
+    }
+    end_capture(0, own_timebase, stats);
+    if (rc == 0) {
+        rc = finish_take(take_stage, *other);
+    }
+    if (rc == 0) {
+        current->state = TakeState::Truncating;
+        rc = finish_take(take_stage, *current);
+    }
+    if (rc < 0) {
+        close_all(files, 2 * nfiles);
+        return rc;
+    }
+    return stalled ? -22 : static_cast<int64_t>(current->index) + 1;
+}
+
+/**
+ * State for streaming blocks straight to the card's sectors.
+ */
+struct RawStage {
+    SdCard *card;
+    BitResolution res;
+    /* !< Space to assemble each sector in */
+    uint8_t *sector;
+    /* !< Identifier of the recording */
+    uint32_t session;
+    /* !< Blocks written so far */
+    uint32_t nblocks;
+    /* !< Most blocks which fit in the sector range */
+    uint32_t capacity;
+    /* !< Samples written for each channel */
+    uint32_t *nsamples;
+    /* !< Where to record write latencies (optional) */
+    Stats *stats;
+};
+
+/**
+ * Split a buffer into blocks and stream them to the card, stopping early if
+ * the sector range fills up.
+ *
+ * @param stage: Streaming state for the recording.
+ * @param ch_index: Channel the buffer is from.
+ * @param slot: Sequence number of the slot the buffer is from.
+ * @param buf: Buffer handed out by the ADC.
+ * @param sz: Size of `buf` in bytes.
+ *
+ * @returns (bool): True if the card accepted every block.
+ */
+static bool write_raw(RawStage &stage, size_t ch_index, uint32_t slot,
+                      const uint8_t *buf, size_t sz) {
+    const size_t capacity = raw::payload_capacity(stage.res);
+    raw::BlockHeader hdr;
+    hdr.session = stage.session;
+    hdr.slot = slot;
+    hdr.ch_index = ch_index;
+    uint32_t start_us = micros();
+    bool ok = true;
+    for (size_t offset = 0;
+         ok && offset < sz && stage.nblocks < stage.capacity;) {
+        size_t n = min(capacity, sz - offset);
+        hdr.seq = stage.nblocks++;
+        hdr.sample_index = stage.nsamples[ch_index];
+        hdr.size = n;
+        memcpy(stage.sector, &hdr, sizeof(hdr));
+        memcpy(stage.sector + sizeof(hdr), buf + offset, n);
+        ok = stage.card->writeData(stage.sector);
+        stage.nsamples[ch_index] += adc::buffer_samples(stage.res, n);
+        offset += n;
+    }
+    if (stage.stats != nullptr) {
+        stage.stats->add_write(micros() - start_us);
+    }
+    return ok;
+}
+
+int64_t record_raw(uint32_t first_sector, uint32_t nsectors, BitResolution res,
+                   uint32_t sample_rate, uint32_t duration_ms, uint8_t *buf,
+                   size_t sz, const Options &opts, Stats *stats) {
+    if (stats != nullptr) {
+        *stats = Stats();
+    }
+    if (!INSTANCE.initialized || INSTANCE.sd == nullptr) {
+        return -1;
+    } else if (INSTANCE.nchannels > adc::MAX_CHANNEL_COUNT) {
+        return -2;
+    } else if (nsectors < 3 || sz <= raw::SECTOR_SZ) {
+        return -15;
+    }
+
+    uint32_t nsamples[INSTANCE.nchannels];
+    memset(nsamples, 0, sizeof(nsamples));
+    RawStage stage;
+    stage.card = INSTANCE.sd->card();
+    stage.res = res;
+    stage.session = micros();
+    stage.nblocks = 0;
+    // Leave room for the session header and trailer
+    stage.capacity = nsectors - 2;
+    stage.nsamples = nsamples;
+    stage.stats = stats;
+    sz -= raw::SECTOR_SZ;
+    stage.sector = buf + sz;
+
+    raw::SessionHeader session;
+    session.num_channels = INSTANCE.nchannels;
+    session.resolution = static_cast<uint8_t>(res);
+    session.session = stage.session;
+    session.sample_rate = sample_rate;
+    memset(stage.sector, 0, raw::SECTOR_SZ);
+    memcpy(stage.sector, &session, sizeof(session));
+    if (!(stage.card->writeStart(first_sector) &&
+          stage.card->writeData(stage.sector))) {
+        return -3;
+    }
+
+    uint8_t *tmp_buf = nullptr;
+    size_t tmp_sz = 0;
+    size_t ch_index = 0;
+    uint32_t slot = 0;
+    bool own_timebase;
+    int8_t started = begin_capture(res, sample_rate, buf, sz, opts,
+                                   own_timebase);
+    if (started != 0) {
+        stage.card->writeStop();
+        return started;
+    }
+    uint32_t required_samples = (static_cast<uint64_t>(duration_ms) *
+                                 sample_rate * INSTANCE.nchannels) /
+                                1000ull;
+    ClockWatch watch;
+    watch.begin(opts, sample_rate);
+    bool stalled = false;
+    bool ok = true;
+    while (ok && adc::collected() < required_samples &&
+           stage.nblocks < stage.capacity) {
+        if (adc::swap_buffer(&tmp_buf, tmp_sz, ch_index, &slot) == 0 &&
+            tmp_buf != nullptr) {
+            ok = write_raw(stage, ch_index, slot, tmp_buf, tmp_sz);
+        } else if (watch.stalled()) {
+            stalled = true;
+            break;
+        }
+    }
+    end_capture(duration_ms, own_timebase, stats);
+    if (!ok) {
+        stage.card->writeStop();
+        return -6;
+    }
+    while (adc::drain_buffer(&tmp_buf, tmp_sz, ch_index, &slot) == 0) {
+        if (tmp_buf != nullptr &&
+            !write_raw(stage, ch_index, slot, tmp_buf, tmp_sz)) {
+            stage.card->writeStop();
+            return -7;
+        }
+    }
+
+    uint32_t start_us = micros();
+    raw::Trailer trailer;
+    trailer.session = stage.session;
+    trailer.nblocks = stage.nblocks;
+    adc::Timing measured;
+    if (opts.timing && adc::timing(measured)) {
+        trailer.rate_mhz = measured.rate_mhz;
+        trailer.ticks_per_sec = timebase::TICKS_PER_SEC;
+        trailer.start_ticks = measured.start_ticks;
+    }
+    trailer.collected = adc::collected();
+    trailer.dropped = adc::dropped();
+    trailer.overruns = adc::overruns();
+    trailer.ngaps = adc::gaps(trailer.gaps, adc::MAX_GAP_COUNT);
+    memset(stage.sector, 0, raw::SECTOR_SZ);
+    memcpy(stage.sector, &trailer, sizeof(trailer));
+    if (!(stage.card->writeData(stage.sector) && stage.card->writeStop())) {
+        return -9;
+    }
+    if (stats != nullptr) {
+        stats->finalize_us = micros() - start_us;
+    }
+    return stalled ? -22 : static_cast<int64_t>(stage.nblocks) + 2;
+}
 }  // namespace recording
@@ -5,10 +5,354 @@
 
 #include "Adc.h"
 #include "SdFat.h"
+#include "Sink.h"
 
+using adc::AutotriggerSource;
 using adc::BitResolution;
 
 namespace recording {
+
+/**
+ * How samples are encoded before being written to each file.
+ */
+enum struct Encoding : uint8_t {
+    Pcm,      /* !< Samples are written as they come from the ADC. */
+    ImaAdpcm, /* !< 4-bit IMA ADPCM (lossy, 4:1 over 16-bit samples). */
+    Lossless, /* !< Fixed prediction + Rice coding (see `Lossless.h`). */
+};
+
+/**
+ * Number of bytes of the sample buffer set aside to interleave channels into
+ * with `Options::interleave`. Samples are interleaved and written out this
+ * many bytes (rounded down to whole frames) at a time.
+ */
+const size_t INTERLEAVE_BLOCK_SZ = 512;
+
+/**
+ * Longest filename (including the terminator) `record_continuous` asks a
+ * `TakeNamer` for.
+ */
+const size_t MAX_FILENAME_SZ = 32;
+
+/**
+ * Names the files of each take of a continuous recording.
+ *
+ * @param take: Number of the take, counting from 0.
+ * @param file_index: Channel the file is for, or 0 with `Options::interleave`.
+ * @param out: Where to write the filename to.
+ * @param out_sz: Size of `out` in bytes.
+ */
+typedef void (*TakeNamer)(uint32_t take, size_t file_index, char *out,
+                          size_t out_sz);
+
+/**
+ * Conditions which start a pre-triggered recording (see `Options::trigger`).
+ * The recording starts as soon as any condition which is set is met.
+ */
+struct Trigger {
+    /**
+     * Polled between buffers until it returns true, e.g. to check a flag set
+     * by an interrupt or a command read from serial.
+     */
+    bool (*poll)() = nullptr;
+    /**
+     * Digital pin which starts the recording once it reads `pin_level`, or -1
+     * to not watch a pin.
+     */
+    int8_t pin = -1;
+    /**
+     * Level (`HIGH` or `LOW`) which starts the recording on `pin`.
+     */
+    uint8_t pin_level = 1;
+    /**
+     * Start once any sample of the newest slot is at least this far from the
+     * midpoint, in 16-bit units (8-bit samples count 256 per step). 0 does not
+     * look at samples. Cannot be used with `TenPacked`.
+     */
+    uint16_t threshold = 0;
+    /**
+     * Milliseconds to wait for the trigger before giving up (`record` returns
+     * -18), or 0 to wait forever.
+     */
+    uint32_t timeout_ms = 0;
+};
+
+/**
+ * Optional settings for a recording. Defaults match the behavior of the
+ * original double-buffered recorder.
+ */
+struct Options {
+    /**
+     * Number of slots the sample buffer is split into (see `adc::init`).
+     * More slots tolerate longer SD card write stalls.
+     */
+    uint8_t nslots = 2;
+    /**
+     * Encoding for samples written to files. Every encoding other than PCM
+     * works on unpacked samples, so it cannot be used with `TenPacked`.
+     * Lossless encoding sets aside `sz / (nchannels * nslots + 1)` bytes of
+     * the sample buffer to encode blocks into.
+     */
+    Encoding encoding = Encoding::Pcm;
+    /**
+     * Microseconds each block may take to encode with `Lossless` before it is
+     * written raw instead. 0 uses half the time it takes the ADC to fill a
+     * block.
+     */
+    uint32_t budget_us = 0;
+    /**
+     * Measure the true sample rate and start time of the recording against
+     * the `timebase` (timer 5), which is started for the recording if it is
+     * not already running. The measured rate goes in the file header, and a
+     * `TimingChunk` is appended to every file. Otherwise the rate is
+     * estimated from the nominal duration.
+     */
+    bool timing = true;
+    /**
+     * Write every channel into a single interleaved N-channel WAV file named
+     * `filenames[0]` instead of one file per channel, so the card only has
+     * one file growing sequentially. Channels are interleaved in the main
+     * loop once `swap_buffer` has handed out every channel buffer of a slot.
+     * Only works with `Encoding::Pcm` and unpacked resolutions. Sets aside
+     * `INTERLEAVE_BLOCK_SZ` bytes at the end of the sample buffer.
+     */
+    bool interleave = false;
+    /**
+     * Preallocate each file as one contiguous extent big enough for the whole
+     * recording before it starts, so SdFat never has to allocate clusters or
+     * update the FAT while samples are coming in. Samples start on a sector
+     * boundary (the header is padded out with a "JUNK" chunk), so channel
+     * buffers which are a multiple of 512 bytes are written straight from
+     * the sample buffer to the card with multi-sector writes. Files are
+     * shrunk to the size of the recording once it is done. Cannot be used
+     * with `Encoding::Lossless`, whose size is not known ahead of time.
+     */
+    bool preallocate = false;
+    /**
+     * Erase the preallocated extent of each file before recording, so the
+     * card does not have to erase sectors while they are being written. Only
+     * used with `preallocate`.
+     */
+    bool pre_erase = false;
+    /**
+     * Wait for a trigger before writing anything to the card. Until it
+     * fires, the ADC's ring of slots is kept as a history of the most recent
+     * samples (the oldest slot is thrown away whenever the ring is about to
+     * fill up), and once it fires the history is written out first, followed
+     * by `duration_ms` more of samples. The history holds up to
+     * `nslots - 1` slots, so more slots waste less of the buffer. WAV files
+     * get a "cue " chunk at the sample the trigger fired on. Not used by
+     * `record_raw` or `record_continuous`.
+     */
+    const Trigger *trigger = nullptr;
+    /**
+     * Leave channel buffers whose peak stays under this level (in 16-bit
+     * units, see `level::analyze`) out of the recording, or 0 to write
+     * everything. Every channel buffer's level is measured as it comes out
+     * of the ADC, and each run of silent buffers is listed in a sidecar file
+     * named after the recording with a ".sil" extension instead, so it can
+     * be expanded back to full length with
+     * `scripts/recordings/expand_silence.py`. Only works with
+     * `Encoding::Pcm`, one file per channel and unpacked resolutions.
+     */
+    uint16_t gate_threshold = 0;
+    /**
+     * Arm the ADC to start on an edge of the analog comparator
+     * (`AutotriggerSource::AnalogComparator`) or INT0
+     * (`AutotriggerSource::ExternalIrq0`) and sleep until it comes, instead
+     * of starting right away (`AutotriggerSource::TimCnt1CmpB`). See
+     * `adc::arm`. The duration counts from the edge. Cannot be combined with
+     * `trigger`. Not used by `record_raw` or `record_continuous`.
+     */
+    AutotriggerSource start_on = AutotriggerSource::TimCnt1CmpB;
+    /**
+     * Edge to start on with `start_on`.
+     */
+    adc::Edge start_edge = adc::Edge::Rising;
+    /**
+     * Milliseconds to give up on the edge after with `start_on`, in which
+     * case nothing is recorded and -24 is returned. 0 waits forever.
+     */
+    uint32_t start_timeout_ms = 0;
+    /**
+     * Clock every conversion from an external clock on ICP1
+     * (`AutotriggerSource::TimCnt1Cap`) or INT0
+     * (`AutotriggerSource::ExternalIrq0`) instead of timer 1
+     * (`AutotriggerSource::TimCnt1CmpB`), e.g. one shared by several boards
+     * so they sample in lockstep. The clock has to run at the sample rate
+     * times the number of channels (and the oversampling factor), see
+     * `adc::start_external`. Cannot be combined with `start_on`.
+     */
+    AutotriggerSource clock = AutotriggerSource::TimCnt1CmpB;
+    /**
+     * Edge of the clock to convert on with `clock`.
+     */
+    adc::Edge clock_edge = adc::Edge::Rising;
+    /**
+     * With `clock`, give up on the clock once this many sample periods pass
+     * without a sample, e.g. because it stopped or was never connected. The
+     * ADC is stopped, everything recorded so far is finalized and -22 is
+     * returned. 0 waits for the clock forever.
+     */
+    uint16_t clock_timeout_periods = 1000;
+    /**
+     * Pin with an external interrupt which a clock shared between boards
+     * (e.g. a GPS PPS output) is on, or -1 to not log one. The samples each
+     * edge came at are listed in a sidecar file named after the recording
+     * with a ".syn" extension (see `adc::log_sync` and `SyncHeader`), so
+     * recordings from several boards can be lined up with
+     * `scripts/recordings/align_boards.py`. Not used by `record_raw` or
+     * `record_continuous`.
+     */
+    int8_t sync_pin = -1;
+    /**
+     * Edge of the shared clock to log with `sync_pin`.
+     */
+    adc::Edge sync_edge = adc::Edge::Rising;
+};
+
+/**
+ * Header at the start of every sync sidecar file (see `Options::sync_pin`),
+ * followed by an `adc::SyncMark` for every edge of the shared clock.
+ */
+struct SyncHeader {
+    /**
+     * File identifier ("CHRY").
+     */
+    const char magic[4] = {'C', 'H', 'R', 'Y'};
+    /**
+     * Format version.
+     */
+    const uint8_t version = 1;
+    /**
+     * Number of channels the marks count samples across.
+     */
+    uint8_t num_channels = 0;
+    /**
+     * Unused.
+     */
+    const uint8_t reserved[2] = {0, 0};
+    /**
+     * Requested sample rate for each channel in hertz.
+     */
+    uint32_t sample_rate = 0;
+    /**
+     * Per-channel index of the recording's first sample among the samples
+     * the marks count, which is more than 0 when history was thrown away
+     * before a trigger. Filled in once the recording is done.
+     */
+    uint32_t start_sample = 0;
+};
+
+/**
+ * Number of bins in the histogram of write latencies.
+ */
+const uint8_t WRITE_HISTOGRAM_BINS = 16;
+
+/**
+ * log2 of the upper bound (in microseconds) of the first bin of the write
+ * latency histogram. Every bin after it is twice as wide as the last.
+ */
+const uint8_t WRITE_HISTOGRAM_SHIFT = 7;
+
+/**
+ * Statistics about a recording, for sizing buffers and slots against how a
+ * given SD card actually behaves.
+ */
+struct Stats {
+    /**
+     * Per-channel sample rate which was achieved, in millihertz.
+     */
+    uint32_t rate_mhz = 0;
+    /**
+     * Number of samples collected for each channel.
+     */
+    uint32_t samples = 0;
+    /**
+     * Number of samples dropped because the ring was full.
+     */
+    uint32_t dropped = 0;
+    /**
+     * Number of separate events samples were dropped in.
+     */
+    uint16_t overruns = 0;
+    /**
+     * Most slots which were full at once. Reaching `Options::nslots` means
+     * samples were dropped.
+     */
+    uint8_t high_water = 0;
+    /**
+     * Number of buffers written out.
+     */
+    uint32_t nwrites = 0;
+    /**
+     * Longest time spent writing a buffer out (microseconds).
+     */
+    uint32_t write_max_us = 0;
+    /**
+     * Total time spent writing buffers out (microseconds).
+     */
+    uint64_t write_total_us = 0;
+    /**
+     * Histogram of the time spent writing each buffer out. Bin 0 counts
+     * writes under `2^WRITE_HISTOGRAM_SHIFT` microseconds, bin `i` those under
+     * `2^(WRITE_HISTOGRAM_SHIFT + i)` and the last bin everything longer.
+     */
+    uint32_t write_histogram[WRITE_HISTOGRAM_BINS] = {0};
+    /**
+     * Time spent truncating files to a common size (microseconds).
+     */
+    uint32_t truncate_us = 0;
+    /**
+     * Time spent finalizing files (timing chunks, headers and closing them)
+     * (microseconds).
+     */
+    uint32_t finalize_us = 0;
+    /**
+     * With `Options::trigger`, the index in each file of the sample the
+     * trigger fired on, which is how many samples of history came before it.
+     */
+    uint32_t trigger_sample = 0;
+    /**
+     * Number of channel buffers left out for being silent (see
+     * `Options::gate_threshold`).
+     */
+    uint32_t silent_blocks = 0;
+    /**
+     * Number of samples at or beyond `level::CLIP_LEVEL`, when levels are
+     * measured.
+     */
+    uint32_t clipped = 0;
+    /**
+     * Highest RMS level of any channel buffer (in the same units as
+     * `level::Level::rms`), when levels are measured.
+     */
+    uint16_t rms_max = 0;
+    /**
+     * With `Options::start_on`, `timebase` ticks from the edge to the first
+     * sample being stored (see `adc::edge_latency`), if it was measured.
+     */
+    uint32_t edge_latency_ticks = 0;
+    /**
+     * With `Options::sync_pin`, number of edges of the shared clock seen.
+     * More than were written to the sidecar if marks were lost.
+     */
+    uint32_t sync_edges = 0;
+
+    /**
+     * Record the time a buffer took to write out.
+     *
+     * @param us: Microseconds the write took.
+     */
+    void add_write(uint32_t us);
+
+    /**
+     * @returns (uint32_t): Mean time spent writing a buffer out
+     * (microseconds).
+     */
+    uint32_t write_mean_us() const;
+};
+
 /**
  * Initialize recorder with these fields.
  *
@@ -18,10 +362,22 @@ namespace recording {
  * @param sd: SD card to use for recording.
  *
  * @returns (bool): True if the module was successfully initialized.
- *  False otherwise.
+ *  False otherwise (`sd` is null).
  */
 bool init(uint8_t nchannels, adc::Channel *channels, SdFat *sd);
 
+/**
+ * Initialize recorder without an SD card, e.g. to stream recordings out of a
+ * serial port. Only `record_to` works without a card, every other recorder
+ * returns -1.
+ *
+ * @param nchannels: Number of channels in `channels`.
+ * @param channels: Array of channels to record on.
+ *
+ * @returns (bool): True if the module was successfully initialized.
+ */
+bool init(uint8_t nchannels, adc::Channel *channels);
+
 /**
  * Uses the SD singleton to record to every file in `files` with the same
  * sample rate and duration. Truncates all files to be equal to the shortest
@@ -32,16 +388,358 @@ bool init(uint8_t nchannels, adc::Channel *channels, SdFat *sd);
  *  - `files` is of at least `channels` length and contains valid filenames.
  *
  * @param filenames: Array of filenames to record to. Must be at least as
- * long as `nchannels`.
+ * long as `nchannels`, or hold one filename with `Options::interleave`.
  * @param res: Bit resolution to record at.
  * @param sample_rate: Requested sample rate for each channel.
  * @param duration_ms: Length in milliseconds to record for.
  * @param buf: Buffer allocated to receive ADC samples.
  * @param sz: Buffer size.
+ * @param opts: Optional recording settings.
+ * @param stats: Optional out-parameter for statistics about the recording.
+ * Filled in as far as the recording got, even if it fails.
  *
- * @returns (int32_t): The file size in bytes if successful. Returns a
- * negative value if there is an error.
+ * @returns (int64_t): 0 if successful. Returns a negative value if there is
+ * an error, after removing every file it created (recordings and their
+ * `.sil`/`.syn` sidecars) unless the error is -22:
+ *  - -1: The module is not initialized or has no SD card.
+ *  - -2: More channels than the ADC supports.
+ *  - -3: A file could not be created or given its placeholder header.
+ *  - -4: The ADC could not be initialized with `buf`.
+ *  - -5: The ADC could not be started (or armed).
+ *  - -6: A buffer could not be written while recording.
+ *  - -7: What was left in the ADC's buffers could not be written.
+ *  - -8: The files could not be truncated.
+ *  - -9: A header could not be written.
+ *  - -10: `encoding` does not work with `TenPacked`.
+ *  - -11: The timing or cue chunk could not be appended.
+ *  - -12: `interleave` does not work with the encoding, resolution or `sz`.
+ *  - -13: `preallocate` does not work with `Encoding::Lossless`.
+ *  - -14: A file could not be preallocated or erased.
+ *  - -17: A `Trigger::threshold` does not work with `TenPacked`.
+ *  - -18: The trigger timed out.
+ *  - -19: `gate_threshold` does not work with the other options.
+ *  - -20: `start_on` cannot be combined with `trigger`.
+ *  - -21: `start_on` cannot be combined with `clock`.
+ *  - -22: The external clock stalled (see `clock_timeout_periods`). What
+ *  was recorded before it did is kept.
+ *  - -23: `sync_pin` has no external interrupt.
+ *  - -24: The edge armed for with `start_on` timed out.
+ *  - -25: The shared clock could not be logged, e.g. because its interrupt
+ *  also clocks the ADC.
  */
 int64_t record(const char *filenames[], BitResolution res, uint32_t sample_rate,
-               uint32_t duration_ms, uint8_t *buf, size_t sz);
+               uint32_t duration_ms, uint8_t *buf, size_t sz,
+               const Options &opts = Options(), Stats *stats = nullptr);
+
+/**
+ * Record without ever stopping the ADC, rotating to a new set of files (a
+ * take) every `take_ms` so no samples fall between takes. The last sample of
+ * one take is followed directly by the first sample of the next.
+ *
+ * Every take is preallocated (see `Options::preallocate`). The files of the
+ * next take are opened, preallocated and given placeholder headers ahead of
+ * time, and the files of the previous take are truncated, given their timing
+ * chunk and header and closed afterwards. All of that work is done one file
+ * at a time, and only when the ADC has no buffer waiting to be written.
+ * Each step is still a single SdFat call (`preAllocate`, `erase`,
+ * `truncate`, ...) which cannot be split up, and the ISR keeps filling slots
+ * meanwhile, so a step which takes longer than `nslots - 1` slot periods
+ * overruns the ring and drops samples. Size the ring for the slowest step on
+ * the card in use (`Stats::finalize_us` adds them up). Takes rotate on slot
+ * boundaries once each channel has `take_ms` worth of samples. If the next take is not ready by
+ * then, the current one keeps growing until it is.
+ *
+ * Only PCM samples are supported (`Encoding::Pcm`), with or without
+ * `Options::interleave`.
+ *
+ * @param name: Names the files of every take.
+ * @param res: Bit resolution to record at.
+ * @param sample_rate: Requested sample rate for each channel.
+ * @param take_ms: Length in milliseconds of each take.
+ * @param ntakes: Number of takes to record, or 0 to keep going until there
+ * is an error.
+ * @param buf: Buffer allocated to receive ADC samples.
+ * @param sz: Buffer size.
+ * @param opts: Optional recording settings.
+ * @param stats: Optional out-parameter for statistics about the recording.
+ * Time spent opening and finalizing takes in the background is counted in
+ * `truncate_us` and `finalize_us`.
+ *
+ * @returns (int64_t): Number of takes written if successful. Returns a
+ * negative value if there is an error:
+ *  - -1: The module is not initialized or has no SD card.
+ *  - -2: More channels than the ADC supports.
+ *  - -3: A take's file could not be created or given its placeholder
+ *  header.
+ *  - -4: The ADC could not be initialized with `buf`.
+ *  - -5: The ADC could not be started.
+ *  - -6: A buffer could not be written while recording.
+ *  - -8: A take's files could not be truncated.
+ *  - -9: A take's header could not be written or its file closed.
+ *  - -11: A take's timing chunk could not be appended.
+ *  - -12: `interleave` does not work with the resolution or `sz`.
+ *  - -14: A take's file could not be preallocated or erased.
+ *  - -16: `name` is null, `take_ms` is 0 or `encoding` is not PCM.
+ *  - -22: The external clock stalled (see `clock_timeout_periods`). The
+ *  takes recorded before it did are finalized and kept.
+ */
+int64_t record_continuous(TakeNamer name, BitResolution res,
+                          uint32_t sample_rate, uint32_t take_ms,
+                          uint32_t ntakes, uint8_t *buf, size_t sz,
+                          const Options &opts = Options(),
+                          Stats *stats = nullptr);
+
+/**
+ * Record every channel straight to a range of SD card sectors, bypassing the
+ * filesystem entirely for the highest sustainable rates. Buffers are split
+ * into self-describing sector-sized blocks (see `RawBlock.h`) and streamed to
+ * the card with a single multi-sector write, so FAT behavior never gets in
+ * the way. Recording stops early if the range fills up.
+ *
+ * The range must be reserved for recordings, e.g. sectors past the end of
+ * the card's partition, since anything in it is overwritten. Recordings can
+ * be turned back into WAV files from an image of the card with
+ * `scripts/recordings/demux_raw.py`.
+ *
+ * Samples are always stored as they come from the ADC, and only the `nslots`,
+ * `timing` and `clock` options (with `clock_edge` and `clock_timeout_periods`)
+ * apply.
+ *
+ * @param first_sector: First sector of the range.
+ * @param nsectors: Number of sectors in the range. At least 3.
+ * @param res: Bit resolution to record at.
+ * @param sample_rate: Requested sample rate for each channel.
+ * @param duration_ms: Length in milliseconds to record for.
+ * @param buf: Buffer allocated to receive ADC samples. The last
+ * `raw::SECTOR_SZ` bytes are set aside to assemble sectors in.
+ * @param sz: Buffer size.
+ * @param opts: Optional recording settings.
+ * @param stats: Optional out-parameter for statistics about the recording.
+ *
+ * @returns (int64_t): Number of sectors written if successful. Returns a
+ * negative value if there is an error:
+ *  - -1: The module is not initialized or has no SD card.
+ *  - -2: More channels than the ADC supports.
+ *  - -3: The session header could not be written.
+ *  - -4: The ADC could not be initialized with `buf`.
+ *  - -5: The ADC could not be started.
+ *  - -6: A block could not be written while recording.
+ *  - -7: What was left in the ADC's buffers could not be written.
+ *  - -9: The trailer could not be written.
+ *  - -15: `nsectors` is less than 3 or `sz` leaves no room for samples
+ *  after setting aside a sector.
+ *  - -22: The external clock stalled (see `clock_timeout_periods`). What
+ *  was recorded before it did is kept, with its trailer.
+ */
+int64_t record_raw(uint32_t first_sector, uint32_t nsectors, BitResolution res,
+                   uint32_t sample_rate, uint32_t duration_ms, uint8_t *buf,
+                   size_t sz, const Options &opts = Options(),
+                   Stats *stats = nullptr);
+
+/**
+ * @returns (bool): True if `init` was called, with or without an SD card.
+ */
+bool initialized();
+
+/**
+ * @returns (uint8_t): Number of channels the module was initialized with.
+ */
+uint8_t nchannels();
+
+/**
+ * Initialize the ADC with the module's channels and start it, along with the
+ * `timebase` if `Options::timing` is set and it is not running yet. Every
+ * recorder starts sampling through here.
+ *
+ * @param res: Bit resolution to record at.
+ * @param sample_rate: Requested sample rate for each channel.
+ * @param buf: Buffer allocated to receive ADC samples.
+ * @param sz: Buffer size.
+ * @param opts: Recording settings. Only `nslots`, `timing` and `clock`
+ * apply, plus `start_on` and `start_edge` if `armed`.
+ * @param own_timebase: Out-parameter for whether the `timebase` was started
+ * here, to pass on to `end_capture`.
+ * @param armed: Arm the ADC to start on `Options::start_on` (see `adc::arm`)
+ * rather than starting it right away.
+ *
+ * @returns (int8_t): 0 if sampling started. -1 indicates the module is not
+ * initialized, -4 that the ADC could not be initialized and -5 that it
+ * could not be started.
+ */
+int8_t begin_capture(BitResolution res, uint32_t sample_rate, uint8_t *buf,
+                     size_t sz, const Options &opts, bool &own_timebase,
+                     bool armed = false);
+
+/**
+ * Watches an external clock (see `Options::clock`) for a stall while
+ * recording.
+ */
+struct ClockWatch {
+    /**
+     * Microseconds without a sample to give up after, or 0 to never.
+     */
+    uint32_t timeout_us = 0;
+    /**
+     * Samples collected or dropped as of `since_us`.
+     */
+    uint32_t progress = 0;
+    /**
+     * When `progress` last moved.
+     */
+    uint32_t since_us = 0;
+
+    /**
+     * Start watching the ADC, once sampling started.
+     *
+     * @param opts: Recording settings. Only `clock` and
+     * `clock_timeout_periods` apply.
+     * @param sample_rate: Requested sample rate for each channel.
+     */
+    void begin(const Options &opts, uint32_t sample_rate);
+
+    /**
+     * @returns (bool): True if the clock went `Options::clock_timeout_periods`
+     * sample periods without a sample.
+     */
+    bool stalled();
+};
+
+/**
+ * Stop the ADC started with `begin_capture`, leaving its buffers to drain.
+ *
+ * @param duration_ms: Nominal duration of the recording, to estimate the
+ * sample rate from if it was not measured against the `timebase`.
+ * @param own_timebase: Whether `begin_capture` started the `timebase`.
+ * @param stats: Optional out-parameter for statistics about the recording.
+ *
+ * @returns (uint32_t): Per-channel sample rate which was achieved in hertz,
+ * or 0 if it was neither measured nor can be estimated (`duration_ms` is 0).
+ */
+uint32_t end_capture(uint32_t duration_ms, bool own_timebase, Stats *stats);
+
+/**
+ * Release the sinks of a recording which failed.
+ *
+ * @tparam Sink: Type of every channel's sink.
+ * @param sinks: Array of one sink per channel.
+ * @param nopened: Number of sinks which were opened, from the first.
+ */
+template <typename Sink>
+void abort_sinks(Sink *sinks, uint8_t nopened) {
+    for (uint8_t i = 0; i < nopened; ++i) {
+        sinks[i].abort();
+    }
+}
+
+/**
+ * Record each channel to a sink (see `Sink.h`) instead of a file, e.g. to
+ * stream it out of a serial port or throw it away with `NullSink` to measure
+ * the acquisition path without any storage behind it. Buffers from the ADC
+ * are passed to the sink's `write` as they are, and the sink type is a
+ * template parameter so no virtual calls are involved.
+ *
+ * Only the `nslots`, `timing` and `clock` options (with `clock_edge` and
+ * `clock_timeout_periods`) apply. Use `record` for encodings, triggers and
+ * everything else which needs files. This is the only recorder which works
+ * without an SD card (see `init`).
+ *
+ * @tparam Sink: Type of every channel's sink.
+ * @param sinks: Array of one sink per channel.
+ * @param res: Bit resolution to record at.
+ * @param sample_rate: Requested sample rate for each channel.
+ * @param duration_ms: Length in milliseconds to record for.
+ * @param buf: Buffer allocated to receive ADC samples.
+ * @param sz: Buffer size.
+ * @param opts: Optional recording settings.
+ * @param stats: Optional out-parameter for statistics about the recording.
+ * `nwrites` and the write latencies count calls to the sinks' `write`.
+ *
+ * @returns (int64_t): 0 if successful. Returns a negative value if there is
+ * an error, after calling `abort` on every sink which was opened (or, for
+ * -8 and -22, `finalize`):
+ *  - -1: The module is not initialized.
+ *  - -2: `sinks` is null.
+ *  - -3: A sink could not be opened.
+ *  - -4: The ADC could not be initialized with `buf`.
+ *  - -5: The ADC could not be started.
+ *  - -6: A sink could not take a buffer while recording.
+ *  - -7: A sink could not take what was left in the ADC's buffers.
+ *  - -8: A sink could not be finalized. The others still are.
+ *  - -22: The external clock stalled (see `Options::clock_timeout_periods`).
+ *  Everything written before it did is finalized.
+ */
+template <typename Sink>
+int64_t record_to(Sink *sinks, BitResolution res, uint32_t sample_rate,
+                  uint32_t duration_ms, uint8_t *buf, size_t sz,
+                  const Options &opts = Options(), Stats *stats = nullptr) {
+    if (stats != nullptr) {
+        *stats = Stats();
+    }
+    if (!initialized()) {
+        return -1;
+    } else if (sinks == nullptr) {
+        return -2;
+    }
+    SinkInfo info;
+    info.res = res;
+    info.sample_rate = sample_rate;
+    info.nchannels = nchannels();
+    for (uint8_t i = 0; i < info.nchannels; ++i) {
+        if (!sinks[i].open(i, info)) {
+            abort_sinks(sinks, i);
+            return -3;
+        }
+    }
+    bool own_timebase;
+    int8_t rc = begin_capture(res, sample_rate, buf, sz, opts, own_timebase);
+    if (rc != 0) {
+        abort_sinks(sinks, info.nchannels);
+        return rc;
+    }
+    uint32_t required_samples =
+        (static_cast<uint64_t>(duration_ms) * sample_rate * info.nchannels) /
+        1000ull;
+    uint8_t *tmp_buf = nullptr;
+    size_t tmp_sz = 0;
+    size_t ch_index = 0;
+    ClockWatch watch;
+    watch.begin(opts, sample_rate);
+    bool stalled = false;
+    while (adc::collected() < required_samples) {
+        if (adc::swap_buffer(&tmp_buf, tmp_sz, ch_index) != 0 ||
+            tmp_buf == nullptr) {
+            if (watch.stalled()) {
+                stalled = true;
+                break;
+            }
+            continue;
+        }
+        uint32_t start_us = micros();
+        bool written = sinks[ch_index].write(tmp_buf, tmp_sz);
+        if (stats != nullptr) {
+            stats->add_write(micros() - start_us);
+        }
+        if (!written) {
+            end_capture(duration_ms, own_timebase, stats);
+            abort_sinks(sinks, info.nchannels);
+            return -6;
+        }
+    }
+    info.sample_rate = end_capture(duration_ms, own_timebase, stats);
+    while (adc::drain_buffer(&tmp_buf, tmp_sz, ch_index) == 0) {
+        if (tmp_buf != nullptr && !sinks[ch_index].write(tmp_buf, tmp_sz)) {
+            abort_sinks(sinks, info.nchannels);
+            return -7;
+        }
+    }
+    bool finalized = true;
+    for (uint8_t i = 0; i < info.nchannels; ++i) {
+        finalized = sinks[i].finalize(info) && finalized;
+    }
+    if (!finalized) {
+        return -8;
+    }
+    return stalled ? -22 : 0;
+}
+
 };  // namespace recording
@@ -12,6 +12,17 @@ int32_t close_all(SdFile files[], size_t nfiles) {
     return 0;
 }
 
+int32_t remove_all(SdFile files[], size_t nfiles) {
+    // Keep going past a file which cannot be removed to leave no others behind
+    int32_t rc = 0;
+    for (size_t i = 0; i < nfiles; ++i) {
+        if (files[i].isOpen() && !files[i].remove() && rc == 0) {
+            rc = i + 1;
+        }
+    }
+    return rc;
+}
+
 int64_t truncate_to_smallest(SdFile files[], size_t nfiles) {
     if (nfiles == 0 || files == nullptr) {
         return -1;
@@ -0,0 +1,226 @@
+#pragma once
+
+#include <Arduino.h>
+#include <SdFat.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Adc.h"
+#include "Frame.h"
+#include "Uart.h"
+#include "WavHeader.h"
+
+using adc::BitResolution;
+
+/**
+ * Destinations `recording::record_to` writes each channel's samples to.
+ *
+ * A sink is any type with the members below. `record_to` is a template over
+ * the sink type, so every call is resolved at compile time and writing a
+ * buffer costs no more than calling the sink's `write` directly:
+ *
+ * - `bool open(uint8_t ch_index, const SinkInfo& info)`: Get ready to take
+ *   the samples of channel `ch_index`. Called before sampling starts, with
+ *   the requested sample rate.
+ * - `bool write(const uint8_t* buf, size_t sz)`: Take a buffer straight from
+ *   the ADC (packed with `TenPacked`). The buffer goes back to the ADC once
+ *   this returns.
+ * - `bool finalize(const SinkInfo& info)`: Called once sampling has stopped
+ *   and every sample was written, with the measured sample rate.
+ * - `void abort()`: Called instead of `finalize` if the recording fails
+ *   after the sink was opened, to release whatever `open` took hold of.
+ *
+ * All but `abort` return false on an error, which ends the recording.
+ */
+namespace recording {
+
+/**
+ * What a sink is told about the recording.
+ */
+struct SinkInfo {
+    /* !< Bit resolution of samples */
+    BitResolution res;
+    /* !< Per-channel sample rate in hertz */
+    uint32_t sample_rate;
+    /* !< Number of channels recorded, each to its own sink */
+    uint8_t nchannels;
+};
+
+/**
+ * Writes a channel to a WAV file. Works with any SdFat file type with
+ * `open`/`write`/`seekSet`/`close`, e.g. `SdFile`, `File32` and `FsFile`
+ * (FAT or exFAT).
+ *
+ * @tparam File: SdFat file type.
+ */
+template <typename File>
+struct FileSink {
+    /* !< Name of the file to create. Must outlive the sink. */
+    const char* filename;
+    /* !< File being written */
+    File file;
+    /* !< Bytes written after the header */
+    uint32_t nbytes;
+
+    explicit FileSink(const char* _filename = nullptr)
+        : filename(_filename), nbytes(0) {}
+
+    bool open(uint8_t ch_index, const SinkInfo& info) {
+        (void)ch_index;
+        (void)info;
+        WavHeader hdr;
+        nbytes = 0;
+        if (filename == nullptr ||
+            !file.open(filename, O_TRUNC | O_WRITE | O_CREAT)) {
+            return false;
+        } else if (file.write(&hdr, sizeof(hdr)) != sizeof(hdr)) {
+            file.close();
+            return false;
+        }
+        return true;
+    }
+
+    bool write(const uint8_t* buf, size_t sz) {
+        nbytes += sz;
+        return file.write(buf, sz) == sz;
+    }
+
+    bool finalize(const SinkInfo& info) {
+        WavHeader hdr;
+        hdr.fill(info.res, sizeof(hdr) + nbytes, info.sample_rate, 1);
+        bool ok = file.seekSet(0) && file.write(&hdr, sizeof(hdr)) ==
+                                         sizeof(hdr);
+        return file.close() && ok;
+    }
+
+    /**
+     * Close the file, leaving its placeholder header.
+     */
+    void abort() { file.close(); }
+};
+
+typedef FileSink<SdFile> SdFileSink;
+typedef FileSink<FsFile> FsFileSink;
+
+/**
+ * Streams a channel's raw samples out of a serial port (or any other Arduino
+ * `Stream`/`Print`), with nothing added. Writes block until the port has
+ * taken every byte, so the port has to keep up with the channel's data rate
+ * (e.g. 20 kB/s for 8-bit samples at 20 kHz). Give each channel its own port
+ * when recording several.
+ *
+ * @tparam Port: Type of the port, e.g. `HardwareSerial`.
+ */
+template <typename Port>
+struct StreamSink {
+    /* !< Port samples go out of */
+    Port* port;
+
+    explicit StreamSink(Port* _port = nullptr) : port(_port) {}
+
+    bool open(uint8_t ch_index, const SinkInfo& info) {
+        (void)ch_index;
+        (void)info;
+        return port != nullptr;
+    }
+
+    bool write(const uint8_t* buf, size_t sz) {
+        return port->write(buf, sz) == sz;
+    }
+
+    bool finalize(const SinkInfo& info) {
+        (void)info;
+        port->flush();
+        return true;
+    }
+
+    void abort() {}
+};
+
+typedef StreamSink<HardwareSerial> SerialSink;
+
+/**
+ * Streams every channel over a serial link as CRC-checked frames (see
+ * `Frame.h`), sent from the USART's interrupt. A write returns as soon as
+ * the last two frames of its buffer are queued, and those go out while the
+ * main loop carries on. At 1 - 2 Mbaud the link carries 100 - 200 kB/s, less
+ * a few percent for framing.
+ *
+ * Every channel's sink shares the transmitter, which has to be started with
+ * `uart::begin` first. The first channel's sink sends the session header
+ * and the last channel's the trailer. `scripts/recordings/receive_stream.py`
+ * turns the stream back into WAV files and reports anything that was lost.
+ */
+struct FrameSink {
+    /* !< Channel the sink is for */
+    uint8_t ch_index = 0;
+    /* !< Bit resolution of samples */
+    BitResolution res = BitResolution::Eight;
+    /* !< Samples of the channel sent so far */
+    uint32_t sample_index = 0;
+
+    bool open(uint8_t _ch_index, const SinkInfo& info) {
+        ch_index = _ch_index;
+        res = info.res;
+        sample_index = 0;
+        if (ch_index != 0) {
+            return uart::running();
+        }
+        return frame::begin(info.nchannels, info.res, info.sample_rate) == 0;
+    }
+
+    bool write(const uint8_t* buf, size_t sz) {
+        if (frame::send(ch_index, sample_index, res, buf, sz) != 0) {
+            return false;
+        }
+        sample_index += adc::buffer_samples(res, sz);
+        return true;
+    }
+
+    bool finalize(const SinkInfo& info) {
+        return ch_index + 1 != info.nchannels ||
+               frame::end(info.sample_rate) == 0;
+    }
+
+    /**
+     * End the stream with a trailer so the receiver does not wait for one.
+     * The first channel's sink sends it, since it is the one every failed
+     * recording opened.
+     */
+    void abort() {
+        if (ch_index == 0) {
+            frame::end(0);
+        }
+    }
+};
+
+/**
+ * Throws samples away, for measuring the acquisition path (ADC, ISR and
+ * `swap_buffer`) on its own without any storage behind it.
+ */
+struct NullSink {
+    /* !< Bytes which would have been written */
+    uint32_t nbytes = 0;
+
+    bool open(uint8_t ch_index, const SinkInfo& info) {
+        (void)ch_index;
+        (void)info;
+        nbytes = 0;
+        return true;
+    }
+
+    bool write(const uint8_t* buf, size_t sz) {
+        (void)buf;
+        nbytes += sz;
+        return true;
+    }
+
+    bool finalize(const SinkInfo& info) {
+        (void)info;
+        return true;
+    }
+
+    void abort() {}
+};
+
+}  // namespace recording
@@ -0,0 +1,65 @@
+#include "Timebase.h"
+
+#include <util/atomic.h>
+
+namespace timebase {
+
+#define CS_DIV_8 (1 << CS51)
+
+volatile uint32_t OVERFLOWS = 0;
+
+static struct {
+    bool is_active = false;
+    uint8_t tccr5a;
+    uint8_t tccr5b;
+    uint8_t timsk5;
+} STATE;
+
+/**
+ * Extends the timer past 16 bits. Weak so applications which need timer 5
+ * for something else while the timebase is not running can define their own.
+ */
+ISR(TIMER5_OVF_vect, __attribute__((weak))) { ++OVERFLOWS; }
+
+void start() {
+    if (STATE.is_active) {
+        stop();
+    }
+    cli();
+    STATE.tccr5a = TCCR5A;
+    STATE.tccr5b = TCCR5B;
+    STATE.timsk5 = TIMSK5;
+
+    // Normal mode, counting up through the full 16 bits
+    TCCR5A = 0;
+    TCCR5B = 0;
+    TCNT5 = 0;
+    OVERFLOWS = 0;
+    TIFR5 = UINT8_MAX;
+    TIMSK5 = (1 << TOIE5);
+    TCCR5B = CS_DIV_8;
+    STATE.is_active = true;
+    sei();
+}
+
+void stop() {
+    if (!STATE.is_active) {
+        return;
+    }
+    cli();
+    TCCR5A = STATE.tccr5a;
+    TCCR5B = STATE.tccr5b;
+    TIMSK5 = STATE.timsk5;
+    STATE.is_active = false;
+    sei();
+}
+
+bool running() { return STATE.is_active; }
+
+uint64_t now() {
+    uint64_t ticks;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { ticks = now_unlocked(); }
+    return ticks;
+}
+
+}  // namespace timebase
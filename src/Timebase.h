@@ -0,0 +1,69 @@
+#pragma once
+
+#include <Arduino.h>
+#include <stdint.h>
+
+/**
+ * Free-running timebase for timestamping samples.
+ *
+ * Uses the 16-bit timer 5 of the ATMEGA2560 counting at `F_CPU / 8`, extended
+ * to 48 bits in software by counting overflows. Unlike `micros()` it is
+ * cheap to read from within other interrupts and does not depend on timer 0.
+ * The timer is reserved while the timebase is running.
+ */
+namespace timebase {
+
+/**
+ * Prescaler the timer counts with.
+ */
+const uint8_t PRESCALER = 8;
+
+/**
+ * Number of ticks per second.
+ */
+const uint32_t TICKS_PER_SEC = F_CPU / PRESCALER;
+
+/**
+ * Number of timer overflows since the timebase was started. Only modified by
+ * the overflow ISR.
+ */
+extern volatile uint32_t OVERFLOWS;
+
+/**
+ * Start the timebase from 0, saving timer 5's state.
+ */
+void start();
+
+/**
+ * Stop the timebase and restore timer 5's state.
+ */
+void stop();
+
+/**
+ * @returns (bool): True if the timebase is running.
+ */
+bool running();
+
+/**
+ * @returns (uint64_t): Ticks since the timebase was started.
+ */
+uint64_t now();
+
+/**
+ * Read the timebase with interrupts already disabled (e.g. from an ISR).
+ * Accounts for an overflow which happened but whose ISR has not run yet.
+ *
+ * @returns (uint64_t): Ticks since the timebase was started.
+ */
+static inline uint64_t now_unlocked() {
+    uint16_t count = TCNT5;
+    uint32_t overflows = OVERFLOWS;
+    // The counter wrapped after interrupts were disabled. Checking the count
+    // tells whether that happened before or after it was read.
+    if ((TIFR5 & (1 << TOV5)) && count < (UINT16_MAX / 2)) {
+        ++overflows;
+    }
+    return (static_cast<uint64_t>(overflows) << 16) | count;
+}
+
+}  // namespace timebase
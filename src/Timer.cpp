@@ -78,6 +78,7 @@ static struct Timer1 {
         ICR1 = icr1;
         TIMSK1 = timsk1;
         sei();
+        is_active = false;
     }
 } TIMER1;
 
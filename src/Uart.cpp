@@ -0,0 +1,270 @@
+#include "Uart.h"
+
+#include <util/atomic.h>
+#include <util/crc16.h>
+
+namespace uart {
+
+#define NO_PORT UINT8_MAX
+#define CRC_INIT 0xFFFF
+#define CRC_SZ 2
+// Longest run of bytes a COBS code byte can cover
+#define COBS_MAX_RUN 0xFF
+// Bits per byte on the wire with one start and one stop bit
+#define BITS_PER_BYTE 10
+// Most the baud rate may be off by, in percent
+#define MAX_BAUD_ERROR 3
+#define MAX_UBRR 4095
+
+/**
+ * Registers of one USART. The bits within them are at the same positions
+ * for every USART.
+ */
+struct Registers {
+    volatile uint8_t* ucsra;
+    volatile uint8_t* ucsrb;
+    volatile uint8_t* ucsrc;
+    volatile uint16_t* ubrr;
+    volatile uint8_t* prr;
+    uint8_t prr_bit;
+};
+
+static const Registers PORTS[NPORTS] = {
+    {&UCSR0A, &UCSR0B, &UCSR0C, &UBRR0, &PRR0, PRUSART0},
+    {&UCSR1A, &UCSR1B, &UCSR1C, &UBRR1, &PRR1, PRUSART1},
+    {&UCSR2A, &UCSR2B, &UCSR2C, &UBRR2, &PRR1, PRUSART2},
+    {&UCSR3A, &UCSR3B, &UCSR3C, &UBRR3, &PRR1, PRUSART3},
+};
+
+static struct {
+    /* !< USART in use, or `NO_PORT` */
+    uint8_t port = NO_PORT;
+    uint32_t baud;
+    /* !< Frame buffers, `BUFFER_SZ` bytes each */
+    uint8_t* buffers[2];
+    /* !< Encoded size of the frame in each buffer */
+    size_t lens[2];
+    /* !< Flag for whether each buffer holds a frame which has not gone out.
+     * Set by `send` and cleared by the ISR. */
+    volatile bool queued[2];
+    /* !< Buffer `send` encodes into next */
+    uint8_t filling;
+    /* !< Buffer the ISR is sending */
+    uint8_t sending;
+    /* !< Next byte the ISR sends and the end of its frame */
+    const uint8_t* next;
+    const uint8_t* end;
+    uint32_t waits;
+    // Saved state
+    uint8_t ucsra;
+    uint8_t ucsrb;
+    uint8_t ucsrc;
+    uint16_t ubrr;
+    /* !< Power reduction bit of the USART */
+    uint8_t prr;
+} TX;
+
+/**
+ * COBS encoder writing into a frame buffer. Every zero is replaced by the
+ * distance to the next one, so the zero ending the frame is the only one
+ * sent.
+ */
+struct Encoder {
+    /* !< Where the next byte goes */
+    uint8_t* out;
+    /* !< Code byte of the run being encoded */
+    uint8_t* code;
+    /* !< Bytes in the run so far, plus one */
+    uint8_t run;
+    uint16_t crc;
+
+    explicit Encoder(uint8_t* buf)
+        : out(buf + 1), code(buf), run(1), crc(CRC_INIT) {}
+
+    void put(uint8_t b) {
+        if (b != 0) {
+            *out++ = b;
+            ++run;
+        }
+        if (b == 0 || run == COBS_MAX_RUN) {
+            *code = run;
+            code = out++;
+            run = 1;
+        }
+    }
+
+    void put(const uint8_t* p, size_t sz) {
+        for (size_t i = 0; i < sz; ++i) {
+            crc = _crc_xmodem_update(crc, p[i]);
+            put(p[i]);
+        }
+    }
+
+    /**
+     * Append the CRC and the zero ending the frame.
+     *
+     * @param buf: Start of the frame buffer.
+     *
+     * @returns (size_t): Encoded size of the frame.
+     */
+    size_t finish(const uint8_t* buf) {
+        uint16_t sum = crc;
+        put(sum & UINT8_MAX);
+        put(sum >> 8);
+        *code = run;
+        *out++ = 0;
+        return out - buf;
+    }
+};
+
+/**
+ * Move on to the other buffer once the ISR sent the last byte of a frame.
+ *
+ * @returns (bool): True if the other buffer holds a frame to send next.
+ */
+static bool next_frame() {
+    TX.queued[TX.sending] = false;
+    TX.sending ^= 1;
+    if (!TX.queued[TX.sending]) {
+        return false;
+    }
+    TX.next = TX.buffers[TX.sending];
+    TX.end = TX.next + TX.lens[TX.sending];
+    return true;
+}
+
+/**
+ * Send the next byte, turning the interrupt off once nothing is left.
+ */
+template <typename Data>
+static inline void on_data_empty(Data& udr, volatile uint8_t& ucsrb) {
+    udr = *TX.next++;
+    if (TX.next == TX.end && !next_frame()) {
+        ucsrb &= ~(1 << UDRIE0);
+    }
+}
+
+/**
+ * Data register empty ISRs. Only the one of the port in use is ever enabled.
+ * Weak so sketches using another port through `HardwareSerial` keep its ISR.
+ */
+ISR(USART0_UDRE_vect, __attribute__((weak))) { on_data_empty(UDR0, UCSR0B); }
+ISR(USART1_UDRE_vect, __attribute__((weak))) { on_data_empty(UDR1, UCSR1B); }
+ISR(USART2_UDRE_vect, __attribute__((weak))) { on_data_empty(UDR2, UCSR2B); }
+ISR(USART3_UDRE_vect, __attribute__((weak))) { on_data_empty(UDR3, UCSR3B); }
+
+int8_t begin(uint8_t port, uint32_t baud, uint8_t* buf, size_t sz) {
+    if (port >= NPORTS) {
+        return -1;
+    }
+    // Double speed divides the clock by 8 rather than 16
+    uint32_t ubrr = baud == 0 ? 0 : (F_CPU / 8 + baud / 2) / baud;
+    if (ubrr == 0 || ubrr - 1 > MAX_UBRR) {
+        return -2;
+    }
+    uint32_t actual = F_CPU / (8 * ubrr);
+    uint32_t error = actual > baud ? actual - baud : baud - actual;
+    if (error * 100 > baud * MAX_BAUD_ERROR) {
+        return -2;
+    }
+    if (buf == nullptr || sz < 2 * BUFFER_SZ) {
+        return -3;
+    }
+    if (running()) {
+        end();
+    }
+
+    const Registers& regs = PORTS[port];
+    cli();
+    TX.ucsra = *regs.ucsra;
+    TX.ucsrb = *regs.ucsrb;
+    TX.ucsrc = *regs.ucsrc;
+    TX.ubrr = *regs.ubrr;
+    TX.prr = *regs.prr & (1 << regs.prr_bit);
+
+    TX.port = port;
+    TX.baud = baud;
+    TX.buffers[0] = buf;
+    TX.buffers[1] = buf + BUFFER_SZ;
+    TX.queued[0] = false;
+    TX.queued[1] = false;
+    TX.filling = 0;
+    TX.sending = 0;
+    TX.waits = 0;
+
+    *regs.prr &= ~(1 << regs.prr_bit);
+    *regs.ucsrb = 0;
+    *regs.ubrr = ubrr - 1;
+    *regs.ucsra = (1 << U2X0);
+    *regs.ucsrc = (1 << UCSZ01) | (1 << UCSZ00);
+    *regs.ucsrb = (1 << TXEN0);
+    sei();
+    return 0;
+}
+
+void end() {
+    if (!running()) {
+        return;
+    }
+    flush();
+    const Registers& regs = PORTS[TX.port];
+    cli();
+    *regs.ucsrb = TX.ucsrb;
+    *regs.ucsra = TX.ucsra;
+    *regs.ucsrc = TX.ucsrc;
+    *regs.ubrr = TX.ubrr;
+    *regs.prr = (*regs.prr & ~(1 << regs.prr_bit)) | TX.prr;
+    TX.port = NO_PORT;
+    sei();
+}
+
+bool running() { return TX.port != NO_PORT; }
+
+bool ready() { return running() && !TX.queued[TX.filling]; }
+
+int8_t send(const void* head, size_t head_sz, const uint8_t* body,
+            size_t body_sz) {
+    if (!running()) {
+        return -1;
+    } else if (head_sz + body_sz + CRC_SZ > MAX_FRAME_SZ) {
+        return -2;
+    }
+    uint8_t i = TX.filling;
+    if (TX.queued[i]) {
+        ++TX.waits;
+        while (TX.queued[i]) {
+        }
+    }
+    Encoder enc(TX.buffers[i]);
+    enc.put(static_cast<const uint8_t*>(head), head_sz);
+    enc.put(body, body_sz);
+    TX.lens[i] = enc.finish(TX.buffers[i]);
+
+    volatile uint8_t* ucsrb = PORTS[TX.port].ucsrb;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        TX.queued[i] = true;
+        // Idle, so nothing will pick the frame up but this
+        if (!(*ucsrb & (1 << UDRIE0))) {
+            TX.sending = i;
+            TX.next = TX.buffers[i];
+            TX.end = TX.next + TX.lens[i];
+            *ucsrb |= (1 << UDRIE0);
+        }
+    }
+    TX.filling ^= 1;
+    return 0;
+}
+
+void flush() {
+    if (!running()) {
+        return;
+    }
+    while (TX.queued[0] || TX.queued[1]) {
+    }
+    // The last two bytes are still in the data and shift registers
+    delayMicroseconds(2 * BITS_PER_BYTE * 1000000ul / TX.baud + 1);
+}
+
+uint32_t waits() { return TX.waits; }
+
+}  // namespace uart
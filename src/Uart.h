@@ -0,0 +1,108 @@
+#pragma once
+
+#include <Arduino.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Interrupt-driven transmitter for one of the ATMEGA2560's four USARTs,
+ * sending whole frames at up to 2 Mbaud without holding up the caller.
+ *
+ * Every frame is followed by a CRC16 (CCITT, initial value 0xFFFF) and COBS
+ * encoded, so it holds no zero bytes and a single zero ends it. A receiver
+ * can pick up the stream at any point by waiting for the next zero, and
+ * tells corrupted frames apart by their CRC.
+ *
+ * Frames are encoded into one of two buffers while the data register empty
+ * ISR sends the other a byte at a time, so `send` only waits when the link
+ * has fallen a whole frame behind. At 2 Mbaud that interrupt comes every 80
+ * CPU cycles, which leaves noticeably less time for sampling than 1 Mbaud.
+ *
+ * The USART is reserved while the transmitter is running. Its ISR is weak,
+ * and Arduino's `HardwareSerial` defines its own for every port used through
+ * `Serial`/`SerialN`, which takes over. Stream over a port the sketch does
+ * not otherwise use (e.g. `Serial` is USART 0, which the Mega's USB bridge is
+ * on).
+ */
+namespace uart {
+
+/**
+ * Number of USARTs.
+ */
+const uint8_t NPORTS = 4;
+
+/**
+ * Most bytes a frame can hold, including its CRC.
+ */
+const size_t MAX_FRAME_SZ = 252;
+
+/**
+ * Size of each of the transmitter's two buffers, which hold an encoded frame
+ * and the zero ending it.
+ */
+const size_t BUFFER_SZ = MAX_FRAME_SZ + MAX_FRAME_SZ / 254 + 2;
+
+/**
+ * Start the transmitter on a USART, saving its state. Frames are sent as 8
+ * data bits, no parity and one stop bit at double speed. Restarts the
+ * transmitter if it was already running.
+ *
+ * @param port: USART to send on (0 - 3).
+ * @param baud: Baud rate, e.g. 1000000 or 2000000. Must be within 3% of
+ * `F_CPU / (8 * n)` for some whole number n.
+ * @param buf: Buffer for the transmitter to encode frames into. Must stay
+ * valid until `end`.
+ * @param sz: Size of `buf`, at least `2 * BUFFER_SZ`.
+ *
+ * @returns (int8_t): 0 if the transmitter started. -1 indicates an invalid
+ * port, -2 a baud rate which cannot be reached and -3 that `buf` is too
+ * small.
+ */
+int8_t begin(uint8_t port, uint32_t baud, uint8_t* buf, size_t sz);
+
+/**
+ * Wait for every frame to go out, then stop the transmitter and restore the
+ * USART's state.
+ */
+void end();
+
+/**
+ * @returns (bool): True if the transmitter is running.
+ */
+bool running();
+
+/**
+ * @returns (bool): True if `send` would not have to wait for a buffer.
+ */
+bool ready();
+
+/**
+ * Encode a frame made of a header and a body and queue it. Waits for the
+ * frame queued before the last one to go out if neither buffer is free, so
+ * interrupts must be enabled.
+ *
+ * @param head: Start of the frame.
+ * @param head_sz: Size of `head`.
+ * @param body: Rest of the frame. May be null if `body_sz` is 0.
+ * @param body_sz: Size of `body`.
+ *
+ * @returns (int8_t): 0 if the frame was queued. -1 indicates the transmitter
+ * is not running and -2 that the frame is longer than `MAX_FRAME_SZ` with its
+ * CRC.
+ */
+int8_t send(const void* head, size_t head_sz, const uint8_t* body,
+            size_t body_sz);
+
+/**
+ * Wait until every queued frame has gone out.
+ */
+void flush();
+
+/**
+ * @returns (uint32_t): Number of frames `send` had to wait for a buffer for
+ * since the transmitter started. Anything but 0 means the link did not keep
+ * up and the caller was held up.
+ */
+uint32_t waits();
+
+}  // namespace uart
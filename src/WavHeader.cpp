@@ -1,15 +1,42 @@
 #include "WavHeader.h"
 
 void WavHeader::fill(BitResolution res, uint32_t file_size,
-                     uint32_t sample_rate) {
+                     uint32_t sample_rate, uint16_t nchannels) {
+    this->audio_format = WAV_FORMAT_PCM;
+    this->num_channels = nchannels;
     if (res == BitResolution::Eight) {
         this->bits_per_sample = U8_BITS;
+    } else if (res == BitResolution::TenPacked) {
+        this->audio_format = WAV_FORMAT_PACKED_TEN;
+        this->bits_per_sample = TEN_BITS;
     } else {
         this->bits_per_sample = U16_BITS;
     }
     this->chunk_size = file_size - sizeof(chunk_id) - sizeof(chunk_size);
     this->sample_rate = sample_rate;
     this->byte_rate = sample_rate * num_channels * bits_per_sample / U8_BITS;
-    this->block_align = num_channels * this->bits_per_sample / U8_BITS;
+    if (res == BitResolution::TenPacked) {
+        this->block_align = num_channels * adc::PACKED_GROUP_SZ;
+    } else {
+        this->block_align = num_channels * this->bits_per_sample / U8_BITS;
+    }
     this->sub_chunk_2_size = file_size - sizeof(WavHeader);
 }
+
+void ImaAdpcmWavHeader::fill(uint32_t file_size, uint32_t sample_rate,
+                             uint32_t nsamples) {
+    this->chunk_size = file_size - sizeof(chunk_id) - sizeof(chunk_size);
+    this->sample_rate = sample_rate;
+    this->byte_rate = static_cast<uint64_t>(sample_rate) * block_align /
+                      samples_per_block;
+    this->data_size = file_size - sizeof(ImaAdpcmWavHeader);
+
+    // Data may have been truncated partway through a block
+    uint32_t nblocks = data_size / block_align;
+    uint32_t remainder = data_size % block_align;
+    uint32_t capacity = nblocks * samples_per_block;
+    if (remainder >= adpcm::BLOCK_HEADER_SZ) {
+        capacity += 1 + 2 * (remainder - adpcm::BLOCK_HEADER_SZ);
+    }
+    this->sample_length = min(nsamples, capacity);
+}
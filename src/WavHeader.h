@@ -4,11 +4,22 @@
 #include <stdint.h>
 
 #include "Adc.h"
+#include "Adpcm.h"
 
 using adc::BitResolution;
 
 #define U8_BITS CHAR_BIT
 #define U16_BITS (2 * U8_BITS)
+#define TEN_BITS 10
+
+// Audio format codes
+#define WAV_FORMAT_PCM 0x0001
+/* Packed 10-bit samples (`BitResolution::TenPacked`). Uses the format code
+ * reserved for development so no standard reader mistakes it for PCM. See
+ * `scripts/recordings` for converting these files to 16-bit PCM. */
+#define WAV_FORMAT_PACKED_TEN 0xFFFF
+#define WAV_FORMAT_IMA_ADPCM 0x0011
+#define IMA_ADPCM_BITS 4
 
 /**
  * Header of a standard PCM WAV file.
@@ -40,16 +51,15 @@ struct WavHeader {
      */
     const uint32_t subchunk_size = 16;
     /**
-     * Audio format code (PCM = 1).
+     * Audio format code (PCM = 1, `WAV_FORMAT_PACKED_TEN` for packed 10-bit).
      */
-    const uint16_t audio_format = 1;
+    uint16_t audio_format = WAV_FORMAT_PCM;
     /**
      * Number of channels.
      * 1 = Mono, 2 = Stereo
-     * With the current implementation, each recording gets its own file and
-     * thus makes this mono.
+     * Mono unless the recording interleaves every channel into one file.
      */
-    const uint16_t num_channels = 1;
+    uint16_t num_channels = 1;
     /**
      * Sampling rate in hertz (samples per second). Filled in later.
      */
@@ -63,12 +73,13 @@ struct WavHeader {
     /**
      * Byte alignment of each sample.
      *
-     * NumChannels * BitsPerSample / 8
+     * NumChannels * BitsPerSample / 8, or NumChannels * 5 for a group of 4
+     * packed 10-bit samples.
      */
     uint16_t block_align = 2;
     /**
      * Number of bits per sample. Rounded to next byte-increment, so 10-bit
-     * or 12-bit audio would both become 16-bit.
+     * or 12-bit audio would both become 16-bit unless it is packed.
      */
     uint16_t bits_per_sample;
     /**
@@ -88,6 +99,190 @@ struct WavHeader {
      * @param res: Bit resolution of samples.
      * @param file_size: Size in bytes of the recording file.
      * @param sample_rate: Sample rate in hertz of audio recording.
+     * @param nchannels: Number of channels interleaved in the file.
+     */
+    void fill(BitResolution res, uint32_t file_size, uint32_t sample_rate,
+              uint16_t nchannels = 1);
+};
+
+/**
+ * Header of a mono IMA ADPCM WAV file (`WAVE_FORMAT_IMA_ADPCM`).
+ *
+ * Same idea as `WavHeader`, but with the extended "fmt " subchunk holding
+ * the number of samples per block and the "fact" subchunk holding the total
+ * number of samples, which compressed formats are required to have.
+ */
+struct ImaAdpcmWavHeader {
+    /**
+     * RIFF chunk identifier ("RIFF").
+     */
+    const char chunk_id[4] = {'R', 'I', 'F', 'F'};
+    /**
+     * Size of (entire file in bytes - 8 bytes). Rewritten after data is fully
+     * written to file.
+     */
+    uint32_t chunk_size = 52;
+    /**
+     * Format identifier (always "WAVE").
+     */
+    const char format[4] = {'W', 'A', 'V', 'E'};
+    /**
+     * Subchunk ID (always "fmt ").
+     */
+    const char subchunk_id[4] = {'f', 'm', 't', ' '};
+    /**
+     * Size of the "fmt " subchunk (always 20).
+     */
+    const uint32_t subchunk_size = 20;
+    /**
+     * Audio format code (IMA ADPCM = 0x11).
+     */
+    const uint16_t audio_format = WAV_FORMAT_IMA_ADPCM;
+    /**
+     * Number of channels. Each recording gets its own file.
+     */
+    const uint16_t num_channels = 1;
+    /**
+     * Sampling rate in hertz (samples per second). Filled in later.
+     */
+    uint32_t sample_rate = 0;
+    /**
+     * Average byte rate.
+     *
+     * SampleRate * BlockAlign / SamplesPerBlock.
+     */
+    uint32_t byte_rate = 0;
+    /**
+     * Size of each ADPCM block in bytes.
+     */
+    const uint16_t block_align = adpcm::BLOCK_SZ;
+    /**
+     * Number of bits per encoded sample (always 4).
+     */
+    const uint16_t bits_per_sample = IMA_ADPCM_BITS;
+    /**
+     * Size of the format extension (always 2).
+     */
+    const uint16_t extra_size = 2;
+    /**
+     * Number of samples in each block.
+     */
+    const uint16_t samples_per_block = adpcm::SAMPLES_PER_BLOCK;
+    /**
+     * Fact subchunk ID (always "fact").
+     */
+    const char fact_id[4] = {'f', 'a', 'c', 't'};
+    /**
+     * Size of the "fact" subchunk (always 4).
+     */
+    const uint32_t fact_size = 4;
+    /**
+     * Total number of samples in the file.
+     */
+    uint32_t sample_length = 0;
+    /**
+     * Data subchunk ID. Always "data".
+     */
+    const char data_id[4] = {'d', 'a', 't', 'a'};
+    /**
+     * Size of data chunk in bytes.
+     */
+    uint32_t data_size = 0;
+
+    /**
+     * Fill in WAV header fields once all details are known.
+     *
+     * @param file_size: Size in bytes of the recording file.
+     * @param sample_rate: Sample rate in hertz of audio recording.
+     * @param nsamples: Number of samples encoded in the file. Clamped to
+     * the number which fit in the file's data.
+     */
+    void fill(uint32_t file_size, uint32_t sample_rate, uint32_t nsamples);
+};
+
+/**
+ * Chunk appended to the end of recordings with the timing measured by
+ * `adc::timing`. Standard readers skip chunks they do not know.
+ */
+struct TimingChunk {
+    /**
+     * Chunk ID (always "time").
+     */
+    const char chunk_id[4] = {'t', 'i', 'm', 'e'};
+    /**
+     * Size of the rest of the chunk (always 16).
+     */
+    const uint32_t chunk_size = 16;
+    /**
+     * Measured sample rate in millihertz.
+     */
+    uint32_t rate_mhz = 0;
+    /**
+     * Number of `start_ticks` per second.
+     */
+    uint32_t ticks_per_sec = 0;
+    /**
+     * `timebase` ticks when the first sample was taken.
+     */
+    uint64_t start_ticks = 0;
+};
+
+/**
+ * Standard chunk marking a single point in a recording, appended to the end
+ * of pre-triggered recordings at the sample the trigger fired on.
+ */
+struct CueChunk {
+    /**
+     * Chunk ID (always "cue ").
+     */
+    const char chunk_id[4] = {'c', 'u', 'e', ' '};
+    /**
+     * Size of the rest of the chunk (always 28).
+     */
+    const uint32_t chunk_size = 28;
+    /**
+     * Number of cue points (always 1).
+     */
+    const uint32_t num_points = 1;
+    /**
+     * Identifier of the cue point.
+     */
+    uint32_t id = 1;
+    /**
+     * Position of the cue point in the playlist (unused, always 0).
+     */
+    uint32_t position = 0;
+    /**
+     * Chunk the cue point is in (always "data").
+     */
+    const char data_chunk_id[4] = {'d', 'a', 't', 'a'};
+    /**
+     * Offset of the chunk the cue point is in (always 0, for "data").
+     */
+    uint32_t chunk_start = 0;
+    /**
+     * Offset of the block the cue point is in (always 0 for PCM).
+     */
+    uint32_t block_start = 0;
+    /**
+     * Index of the frame the cue point is at.
+     */
+    uint32_t sample_offset = 0;
+};
+
+/**
+ * Chunk which pads out the header of a file so its samples start on a
+ * sector boundary. Goes right before the "data" subchunk header, and is
+ * followed by `chunk_size` bytes of padding. Standard readers skip chunks they
+ * do not know.
+ */
+struct PadChunk {
+    /**
+     * Chunk ID (always "JUNK").
+     */
+    const char chunk_id[4] = {'J', 'U', 'N', 'K'};
+    /**
+     * Number of bytes of padding after this.
      */
-    void fill(BitResolution res, uint32_t file_size, uint32_t sample_rate);
+    uint32_t chunk_size = 0;
 };